@@ -0,0 +1,54 @@
+#!/usr/bin/python
+#
+# Measures how long short foreground commands take, from sending the
+# command line to seeing the next prompt, while CPU-bound jobs run in
+# the background.  Each round is run with fgboost off and on.
+#
+# Usage: fg_latency.py [path-to-cush] [iterations] [background-hogs]
+#
+import sys, os, re, time, signal, pexpect
+
+shell = sys.argv[1] if len(sys.argv) > 1 else "./cush"
+iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+hogs = int(sys.argv[3]) if len(sys.argv) > 3 else 4
+
+# '\c' renders as "cush", so the confirmation printed by 'prompt'
+# does not itself match the prompt
+prompt = "bench-cush> "
+
+console = pexpect.spawn(shell, drainpty=True)
+console.timeout = 10
+console.delaybeforesend = 0
+
+def run(line):
+    console.sendline(line)
+    console.expect_exact(prompt)
+
+console.sendline('prompt "bench-\\c> "')
+console.expect_exact(prompt)
+
+hog_pids = []
+for i in range(hogs):
+    run('sh -c "while :; do :; done" &')
+    hog_pids.append(int(re.search(r"\[\d+\] (\d+)", console.before).group(1)))
+
+def measure(label):
+    samples = []
+    for i in range(iterations):
+        start = time.time()
+        run("/bin/true")
+        samples.append((time.time() - start) * 1000.0)
+    samples.sort()
+    print "%-12s mean %7.2f ms  p50 %7.2f ms  p95 %7.2f ms  max %7.2f ms" % (
+        label, sum(samples) / len(samples), samples[len(samples) / 2],
+        samples[int(len(samples) * 0.95)], samples[-1])
+
+print "%d iterations of /bin/true with %d CPU-bound background jobs" % (iterations, hogs)
+run("fgboost off")
+measure("fgboost off")
+run("fgboost on")
+measure("fgboost on")
+
+for pid in hog_pids:
+    os.killpg(pid, signal.SIGKILL)
+console.sendline("exit")
@@ -0,0 +1,74 @@
+#!/usr/bin/python
+#
+# Measures how long a recursive glob over a tree of 1M files takes,
+# from sending the command line to seeing the next prompt, with the
+# directory walk spread over 1, 2, 4 and 8 threads.  The tree is
+# generated on the first run and kept for later runs.  If the page
+# cache can be dropped (as root), each round is also run cold.
+#
+# Usage: glob_recursive.py [path-to-cush] [tree-directory] [iterations]
+#
+import sys, os, time, pexpect
+
+shell = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./cush")
+tree = sys.argv[2] if len(sys.argv) > 2 else "/tmp/cush-glob-tree"
+iterations = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+
+# 10^4 leaf directories, four levels deep, with 100 files each
+FANOUT, DEPTH, FILES = 10, 4, 100
+pattern = "**/f07.c"            # one file per leaf directory
+drop_caches = "/proc/sys/vm/drop_caches"
+
+def generate(dir, depth):
+    if depth == 0:
+        for i in range(FILES / 2):
+            for ext in ("c", "h"):
+                os.close(os.open(os.path.join(dir, "f%02d.%s" % (i, ext)),
+                                 os.O_CREAT | os.O_WRONLY, 0644))
+        return
+    for i in range(FANOUT):
+        sub = os.path.join(dir, "d%d" % i)
+        os.mkdir(sub)
+        generate(sub, depth - 1)
+
+done_marker = os.path.join(tree, ".generated")
+if not os.path.exists(done_marker):
+    print "generating %d files below %s" % (FANOUT ** DEPTH * FILES, tree)
+    if not os.path.isdir(tree):
+        os.makedirs(tree)
+    for entry in os.listdir(tree):
+        os.system("rm -rf '%s'" % os.path.join(tree, entry))
+    generate(tree, DEPTH)
+    open(done_marker, "w").close()
+
+prompt = "bench-cush> "
+
+def measure(label, threads, cold):
+    env = dict(os.environ, CUSH_GLOB_THREADS=str(threads), PWD=tree)
+    console = pexpect.spawn(shell, cwd=tree, env=env, drainpty=True)
+    console.timeout = 600
+    console.delaybeforesend = 0
+    console.sendline('prompt "bench-\\c> "')
+    console.expect_exact(prompt)
+
+    samples = []
+    for i in range(iterations):
+        if cold:
+            os.system("sync; echo 3 > %s" % drop_caches)
+        start = time.time()
+        console.sendline("/bin/true " + pattern)
+        console.expect_exact(prompt)
+        samples.append((time.time() - start) * 1000.0)
+    console.sendline("exit")
+    samples.sort()
+    print "%-16s mean %8.2f ms  p50 %8.2f ms  max %8.2f ms" % (
+        label, sum(samples) / len(samples), samples[len(samples) / 2], samples[-1])
+
+print "%d iterations of /bin/true %s in %s" % (iterations, pattern, tree)
+cold_rounds = [False]
+if os.access(drop_caches, os.W_OK):
+    cold_rounds.append(True)
+for cold in cold_rounds:
+    for threads in (1, 2, 4, 8):
+        measure("%d thread%s%s" % (threads, "s" if threads > 1 else "",
+                                   ", cold" if cold else ""), threads, cold)
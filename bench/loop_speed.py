@@ -0,0 +1,50 @@
+#!/usr/bin/python
+#
+# Measures how long a loop of shell builtins and assignments takes to
+# run, from sending the command line to seeing the next prompt, with
+# the loop compiled ('bytecode on') and with its syntax tree walked as
+# a tree-walking interpreter would run it ('bytecode off'), and prints
+# how many times faster the first is.  The two take turns in the same
+# shell, so that a busy machine slows both alike.
+#
+# Usage: loop_speed.py [path-to-cush] [turns] [iterations]
+#
+import sys, os, time, pexpect
+
+shell = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./cush")
+turns = int(sys.argv[2]) if len(sys.argv) > 2 else 1000000
+iterations = int(sys.argv[3]) if len(sys.argv) > 3 else 3
+
+loop = "for i in {1..%d}; do x=$i; unset y; done" % turns
+prompt = "bench-cush> "
+
+console = pexpect.spawn(shell, drainpty=True)
+console.timeout = 600
+console.delaybeforesend = 0
+console.sendline('prompt "bench-\\c> "')
+console.expect_exact(prompt)
+
+def measure(mode):
+    console.sendline("bytecode " + mode)
+    console.expect_exact(prompt)
+    start = time.time()
+    console.sendline(loop)
+    console.expect_exact(prompt)
+    return (time.time() - start) * 1000.0
+
+def report(mode, samples):
+    samples.sort()
+    print "bytecode %-4s mean %9.1f ms  p50 %9.1f ms  %6.0f ns/turn" % (
+        mode, sum(samples) / len(samples), samples[len(samples) / 2],
+        samples[len(samples) / 2] * 1e6 / turns)
+    return samples[len(samples) / 2]
+
+print "%d iterations of %s" % (iterations, loop)
+fast, slow = [], []
+for i in range(iterations):
+    fast.append(measure("on"))
+    slow.append(measure("off"))
+console.sendline("exit")
+fast_p50 = report("on", fast)
+slow_p50 = report("off", slow)
+print "bytecode is %.1fx as fast as walking the tree (goal: 10x)" % (slow_p50 / fast_p50)
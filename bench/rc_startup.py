@@ -0,0 +1,91 @@
+#!/usr/bin/python
+#
+# Measures what a 5,000-line rc file adds to the time 'cush script'
+# takes from start to exit: the file is run as a script, with the
+# compiled script cache off (CUSH_CACHE_DIR empty, so every start lexes,
+# parses and compiles it) and on (after a first run has stored it),
+# and the time of an empty script is subtracted from both.  The empty
+# script and the rc file take turns, so that a busy machine slows both
+# alike, and what the rc file adds is the median of the differences of
+# the turns.  The goal is for the cached rc file to add under 1 ms in
+# the build that is measured, which is named, as the sanitizers of the
+# Makefile's default build cost a good part of it.
+#
+# Usage: rc_startup.py [path-to-cush] [lines] [iterations]
+#
+import sys, os, time, shutil, tempfile, pty, fcntl, termios, subprocess
+
+shell = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./cush")
+lines = int(sys.argv[2]) if len(sys.argv) > 2 else 5000
+iterations = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+
+# blocks of what rc files consist of: comments, exports, assignments,
+# aliases and functions
+def rc_text(lines):
+    text = []
+    for i in range(lines / 5 + 1):
+        text += ["# settings for part %d" % i,
+                 "export RC_PATH_%d=/usr/local/part%d/bin" % (i, i),
+                 "rc_count_%d=%d" % (i, i),
+                 "alias rc_ls_%d=ls -l /tmp/part%d" % (i, i),
+                 "rc_func_%d() { echo part %d $1; rc_last=%d; }" % (i, i, i)]
+    return "\n".join(text[:lines]) + "\n"
+
+workdir = tempfile.mkdtemp(prefix="cush-bench-")
+rc = os.path.join(workdir, "rc")
+empty = os.path.join(workdir, "empty")
+open(rc, "w").write(rc_text(lines))
+open(empty, "w").write("")
+# the cache leaves alone files modified in the last seconds
+past = time.time() - 60
+os.utime(rc, (past, past))
+os.utime(empty, (past, past))
+
+# the shell runs on a pty of its own, as it would from a terminal, and
+# is timed from fork to exit
+def run(script, env):
+    master, slave = pty.openpty()
+    def controlling_terminal():
+        os.setsid()
+        fcntl.ioctl(0, termios.TIOCSCTTY, 0)   # the slave, as stdin by now
+    start = time.time()
+    subprocess.Popen([shell, script], stdin=slave, stdout=slave, stderr=slave,
+                     env=env, preexec_fn=controlling_terminal).wait()
+    elapsed = (time.time() - start) * 1000.0
+    os.close(slave)
+    os.close(master)
+    return elapsed
+
+# the build of the shell, from the sanitizer runtime it calls
+def build():
+    binary = open(shell, "rb").read()
+    sanitizers = [name for name, symbol in (("address", "__asan_init"), ("undefined", "__ubsan_handle_"))
+                  if symbol in binary]
+    if not sanitizers:
+        return "without sanitizers"
+    return "with -fsanitize=%s" % ",".join(sanitizers)
+
+# medians of the times of script and, in turns with it, of what it adds
+# to the time of the empty script
+def measure(script, cache):
+    env = dict(os.environ, CUSH_CACHE_DIR=cache)
+    run(script, env)                    # fills the cache
+    run(empty, env)
+    samples, extra = [], []
+    for i in range(iterations):
+        base = run(empty, env)
+        samples.append(run(script, env))
+        extra.append(samples[-1] - base)
+    return sorted(samples)[len(samples) / 2], sorted(extra)[len(extra) / 2]
+
+print "%d runs each of 'cush script' with a %d-line rc file as the script" % (iterations, lines)
+print "cush built %s" % build()
+cache = os.path.join(workdir, "cache")
+base, _ = measure(empty, cache)
+uncached, uncached_extra = measure(rc, "")
+cached, cached_extra = measure(rc, cache)
+print "empty script       p50 %7.2f ms" % base
+print "rc, cache off      p50 %7.2f ms  (+%.2f ms)" % (uncached, uncached_extra)
+print "rc, cache on       p50 %7.2f ms  (+%.2f ms, goal: under 1 ms, %s in this build)" % (
+    cached, cached_extra, "met" if cached_extra < 1.0 else "not met")
+shutil.rmtree(workdir)
@@ -0,0 +1,77 @@
+#!/usr/bin/python
+#
+# Measures how long cush takes to start: from main to the exec of the
+# first command of 'cush script', as --startup-profile reports it, the
+# wall time 'cush script' adds to running that command by itself, which
+# includes loading the shell and its libraries, and from main to the
+# first prompt of an interactive shell on a pty.
+#
+# Usage: startup.py [path-to-cush] [iterations]
+#
+import sys, os, time, shutil, tempfile, pty, fcntl, termios, subprocess
+
+shell = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./cush")
+iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 50
+
+workdir = tempfile.mkdtemp(prefix="cush-bench-")
+script = os.path.join(workdir, "script")
+open(script, "w").write("/bin/true\n")
+env = dict(os.environ, CUSH_CACHE_DIR=os.path.join(workdir, "cache"),
+           CUSHRC=os.path.join(workdir, "none"), HISTFILE=os.path.join(workdir, "history"))
+devnull = open(os.devnull, "r+")
+
+def median(samples):
+    return sorted(samples)[len(samples) / 2]
+
+# the time since main of 'phase' in the profile printed on stderr
+def profiled(text, phase):
+    for line in text.splitlines():
+        if line.startswith(phase):
+            return float(line.split()[-1])
+    raise Exception("no '%s' in the startup profile:\n%s" % (phase, text))
+
+def first_exec():
+    p = subprocess.Popen([shell, "--startup-profile", script], stdin=devnull,
+                         stdout=devnull, stderr=subprocess.PIPE, env=env)
+    text = p.communicate()[1]
+    return profiled(text, "first exec")
+
+def wall(argv):
+    start = time.time()
+    subprocess.call(argv, stdin=devnull, stdout=devnull, env=env)
+    return (time.time() - start) * 1000.0
+
+# the shell runs on a pty of its own, as it would from a terminal
+def first_prompt():
+    master, slave = pty.openpty()
+    def controlling_terminal():
+        os.setsid()
+        fcntl.ioctl(0, termios.TIOCSCTTY, 0)   # the slave, as stdin by now
+    p = subprocess.Popen([shell, "--startup-profile"], stdin=slave, stdout=slave,
+                         stderr=slave, env=dict(env, TERM="dumb"),
+                         preexec_fn=controlling_terminal)
+    os.close(slave)
+    os.write(master, "exit\n")
+    text = ""
+    while True:
+        try:
+            data = os.read(master, 4096)
+        except OSError:         # EIO once the shell has exited
+            break
+        if not data:
+            break
+        text += data
+    p.wait()
+    os.close(master)
+    return profiled(text, "prompt")
+
+first_exec()                            # fills the cache
+print "%d runs each of cush starting up" % iterations
+exec_ms = median([first_exec() for i in range(iterations)])
+alone = median([wall(["/bin/true"]) for i in range(iterations)])
+with_shell = median([wall([shell, script]) for i in range(iterations)])
+prompt_ms = median([first_prompt() for i in range(iterations)])
+print "main to first exec       p50 %7.3f ms  (goal: under 1 ms)" % exec_ms
+print "'cush script' wall time  p50 %7.3f ms  (+%.3f ms over /bin/true alone)" % (with_shell, with_shell - alone)
+print "main to first prompt     p50 %7.3f ms" % prompt_ms
+shutil.rmtree(workdir)
@@ -1384,8 +1384,8 @@ class spawn (object):
                     self.readQueue.put(None)
                 except TIMEOUT:
                     pass
-                    
-            self.pexpect_inst.drainpty = False
+            # drainpty is turned off by expect_loop once it has taken
+            # everything read before the EOF from the queue
 
         
         def stop(self):
@@ -1438,6 +1438,9 @@ class spawn (object):
                         if c != None:
                             freshlen = len(c)
                             incoming = incoming + c
+                        else:
+                            self.drainpty = False
+                            raise EOF ('End Of File (EOF) in read_nonblocking(). Empty string style platform.')
                     except Queue.Empty:
                         c = ""
 
@@ -0,0 +1,57 @@
+#!/usr/bin/python
+#
+# Tests 'admit', which queues new background jobs while the system is
+# under pressure: a queued job is listed as Queued, and 'fg' starts it
+# right away.  Its settings are parsed without changing the words of
+# the command, so a loop can run the same 'admit' again.
+#
+import os, time
+from testutils import *
+
+def load_average():
+    return float(open('/proc/loadavg').read().split()[0])
+
+# a threshold of load=0.0001 queues every job unless the machine is
+# completely idle; then keep a CPU busy until the load average shows it
+busy = None
+if load_average() == 0:
+    busy = os.fork()
+    if busy == 0:
+        while True:
+            pass
+    deadline = time.time() + 15
+    while load_average() == 0 and time.time() < deadline:
+        time.sleep(0.5)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. Under the threshold, a background job is queued, and 'jobs'
+# lists it as Queued.
+#
+sendline('for i in 1 2; do admit load=0.0001; done')
+expect_prompt("a loop could not run the same admit twice")
+
+sendline('echo admitted &')
+expect_exact('[1] queued', "the background job was not queued")
+expect_prompt("Shell did not print expected prompt (2)")
+
+run_builtin('jobs')
+expect_exact('Queued', "the queued job was not listed as Queued")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. 'fg' starts a queued job in the foreground right away.
+#
+run_builtin('fg %s', '1')
+expect_exact('admitted', "fg did not start the queued job")
+expect_prompt("Shell did not print expected prompt (4)")
+
+if busy is not None:
+    os.kill(busy, 9)
+    os.waitpid(busy, 0)
+
+test_success()
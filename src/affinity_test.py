@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# Tests the 'pin' prefix, which installs a CPU affinity in each command
+# of a job before it execs, and the placement 'jobs -l' lists.
+#
+import atexit, proc_check, time, os
+from testutils import *
+
+# the last CPU the tests may use, so that a pinned job differs from an
+# unpinned one on machines with more than one
+allowed = [line for line in open('/proc/self/status')
+           if line.startswith('Cpus_allowed_list:')][0].split()[1]
+cpu = int(allowed.replace('-', ',').split(',')[-1])
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. A pinned command runs on the CPUs it was given.
+#
+sendline('pin %d grep Cpus_allowed_list /proc/self/status' % cpu)
+expect_exact('Cpus_allowed_list:\t%d\r\n' % cpu, "the command was not pinned")
+expect_prompt("Shell did not print expected prompt (2)")
+
+# one CPU list per stage of a pipeline
+sendline('pin %d:%d grep Cpus_allowed_list /proc/self/status | cat' % (cpu, cpu))
+expect_exact('Cpus_allowed_list:\t%d\r\n' % cpu, "the pipeline was not pinned")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. 'jobs -l' lists the pid and CPUs of each command.
+#
+sendline('pin %d sleep 30 &' % cpu)
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (4)")
+
+run_builtin('jobs -l')
+expect_exact('\t%s\tsleep\tcpus %d' % (pid, cpu), "jobs -l did not list the placement")
+expect_prompt("Shell did not print expected prompt (5)")
+
+run_builtin('kill %s', jobid)
+expect_prompt("Shell did not print expected prompt (6)")
+
+#################################################################
+# Step 3. An invalid CPU list is rejected without running the command.
+#
+sendline('pin x,y echo notrun')
+expect_exact("pin: invalid cpu list 'x,y'", "an invalid cpu list was accepted")
+
+test_success()
@@ -0,0 +1,74 @@
+#!/usr/bin/python
+#
+# Tests && and || with short-circuit evaluation, $? and PIPESTATUS,
+# which hold the exit status of each command of the last pipeline.
+#
+import os, tempfile
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. && runs the next pipeline only after success, || only
+# after failure.
+#
+sendline('true && echo and-ran || echo or-ran')
+expect_exact('and-ran', "&& did not run after success")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('false && echo and-ran || echo or-ran')
+expect_exact('or-ran', "|| did not run after failure")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. A pipeline that is skipped is not started at all.
+#
+marker = tempfile.mktemp()
+sendline('true || touch %s' % marker)
+expect_prompt("Shell did not print expected prompt (4)")
+assert not os.path.exists(marker), "|| started a pipeline after success"
+
+sendline('false && sleep 10')
+expect_prompt("&& started a pipeline after failure")
+
+#################################################################
+# Step 3. $? is the status of the last pipeline, PIPESTATUS that of
+# each of its commands, including the 128 + n of a signal.
+#
+sendline('sh -c "exit 3"; echo status $?')
+expect_exact('status 3', "$? is not the exit status")
+expect_prompt("Shell did not print expected prompt (5)")
+
+sendline('true | sh -c "exit 4" | sh -c "kill -TERM $$"')
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline('echo ${PIPESTATUS[0]} ${PIPESTATUS[1]} ${PIPESTATUS[2]} / ${PIPESTATUS[@]} / $?')
+expect_exact('0 4 143 / 0 4 143 / 143', "PIPESTATUS does not hold each command's status")
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline('nosuchcommand || echo failed with $?')
+expect_exact('failed with 127', "a command that was not found did not fail")
+expect_prompt("Shell did not print expected prompt (8)")
+
+#################################################################
+# Step 4. Groups pass their status on: a subshell exits with it.
+#
+sendline('( exit 5 ); echo subshell $?')
+expect_exact('subshell 5', "the subshell's status was lost")
+expect_prompt("Shell did not print expected prompt (9)")
+
+#################################################################
+# Step 5. & applies to a whole and-or list, which runs as one job.
+#
+sendline('sleep 1 && echo second &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (10)")
+
+sendline('jobs')
+expect_exact('[1]\tRunning\t\t(( sleep 1 && echo second ))', "the and-or list is not one job")
+expect_prompt("Shell did not print expected prompt (11)")
+
+test_success()
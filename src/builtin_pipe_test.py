@@ -0,0 +1,58 @@
+#!/usr/bin/python
+#
+# Tests builtins inside pipelines: they run in the shell and their
+# output goes into the pipe, at any position, or into a redirection.
+#
+import os, tempfile
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline('sleep 30 &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 1. A builtin feeds the commands after it.
+#
+sendline('jobs | grep Running | tr a-z A-Z')
+expect_exact('RUNNING\t\t(SLEEP 30)', "jobs output did not go through the pipeline")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. A builtin last in a pipeline prints to the terminal.
+#
+sendline('echo ignored | jobs')
+expect_exact('Running\t\t(sleep 30)', "jobs did not run at the end of a pipeline")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 3. A builtin on its own honors an output redirection, which
+# '>' truncates for it and for an external command alike.
+#
+out = tempfile.mktemp()
+sendline('jobs > %s' % out)
+expect_prompt("Shell did not print expected prompt (5)")
+sendline('cat %s' % out)
+expect_exact('Running\t\t(sleep 30)', "jobs output was not redirected")
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline('/bin/echo x > %s' % out)
+expect_prompt("Shell did not print expected prompt (7)")
+assert open(out).read() == 'x\n', "'>' did not truncate the file for an external command"
+os.unlink(out)
+
+#################################################################
+# Step 4. Builtins that take over the terminal are refused.
+#
+sendline('echo x | fg')
+expect_exact('fg: cannot be used in a pipeline', "fg was accepted in a pipeline")
+expect_prompt("Shell did not print expected prompt (8)")
+
+sendline('kill 1')
+expect_prompt("Shell did not print expected prompt (9)")
+
+test_success()
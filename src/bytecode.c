@@ -0,0 +1,830 @@
+/*
+ * Bytecode for compound commands.
+ *
+ * The body of a loop runs many times, and run_pipeline expands and
+ * frees the tree it is given, so running a tree would mean copying it
+ * on every turn.  A compound command is therefore compiled once into
+ * a flat array of instructions, which the shell runs with a dispatch
+ * loop: control flow, assignments and simple commands whose name is a
+ * literal word become instructions of their own, which run straight
+ * from the words of the program; any other pipeline is encoded word by
+ * word and rebuilt into a tree when it runs.
+ *
+ * Every word is kept once in a pool of constants, as an offset into
+ * one block of strings, and code refers to words by their index.
+ * Since a program holds no pointers, it can be saved as an image and
+ * run from wherever that is mapped later.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bytecode.h"
+#include "glob_expansion.h"
+#include "variables.h"
+#include "utils.h"
+
+/* Kinds of commands in an encoded pipeline */
+enum {
+    CMD_SIMPLE,
+    CMD_BRACES,
+    CMD_SUBSHELL,
+    CMD_COMPOUND,
+};
+#define CMD_DUP_STDERR      (1 << 8)
+#define CMD_FUNCTION_NAME   (1 << 9)
+
+#define PIPE_BG             (1 << 0)
+#define PIPE_APPEND         (1 << 1)
+
+struct compiler {
+    uint32_t *code;
+    size_t length, code_capacity;
+    uint32_t *constants;
+    size_t nconstants, constants_capacity;
+    uint32_t *slot_of;          /* per constant: its slot + 1, or 0 */
+    size_t slot_of_capacity;
+    char *strings;
+    size_t strings_length, strings_capacity;
+    uint32_t *table;            /* constant + 1 by hash, 0 if free */
+    size_t table_size;          /* power of 2 */
+    uint32_t *slot_names;
+    size_t nslots, slots_capacity;
+    size_t depth, max_depth;
+    bool use_slots;
+};
+
+/* Make room for 'needed' elements of 'size' bytes in '*array' */
+static void
+grow(void *array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return;
+    size_t n = *capacity ? *capacity : BYTECODE_INITIAL_SIZE;
+    while (n < needed)
+        n *= 2;
+    void *p = realloc(*(void **) array, n * size);
+    if (p == NULL)
+        utils_fatal_error("out of memory compiling a command: ");
+    *(void **) array = p;
+    *capacity = n;
+}
+
+static size_t
+emit(struct compiler *c, uint32_t word)
+{
+    grow(&c->code, &c->code_capacity, c->length + 1, sizeof *c->code);
+    c->code[c->length] = word;
+    return c->length++;
+}
+
+static size_t
+emit_op(struct compiler *c, enum bytecode_op op, size_t a)
+{
+    assert(a <= BC_NONE);
+    return emit(c, op | (uint32_t) a << 8);
+}
+
+/* Set the operand of the instruction at 'at' */
+static void
+patch(struct compiler *c, size_t at, size_t target)
+{
+    c->code[at] = BC_OP(c->code[at]) | (uint32_t) target << 8;
+}
+
+/* Jumps whose target is not known yet are chained through their
+ * operands, ending with BC_NONE; point all of them at 'target' */
+static void
+patch_chain(struct compiler *c, size_t at, size_t target)
+{
+    while (at != BC_NONE) {
+        size_t next = BC_ARG(c->code[at]);
+        patch(c, at, target);
+        at = next;
+    }
+}
+
+/* The same for chains of target words, such as those of BC_MATCH */
+static void
+patch_word_chain(struct compiler *c, size_t at, size_t target)
+{
+    while (at != BC_NONE) {
+        size_t next = c->code[at];
+        c->code[at] = target;
+        at = next;
+    }
+}
+
+static uint32_t
+hash_word(const char *word)
+{
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (; *word; word++)
+        h = (h ^ (unsigned char) *word) * 16777619u;
+    return h;
+}
+
+static void
+grow_table(struct compiler *c)
+{
+    free(c->table);
+    c->table_size = c->table_size ? 2 * c->table_size : BYTECODE_INITIAL_SIZE;
+    c->table = calloc(c->table_size, sizeof *c->table);
+    if (c->table == NULL)
+        utils_fatal_error("out of memory compiling a command: ");
+
+    for (size_t i = 0; i < c->nconstants; i++) {
+        size_t h = hash_word(c->strings + c->constants[i]) & (c->table_size - 1);
+        while (c->table[h] != 0)
+            h = (h + 1) & (c->table_size - 1);
+        c->table[h] = i + 1;
+    }
+}
+
+/* Return the index of constant 'word', adding it if it is new */
+static size_t
+constant(struct compiler *c, const char *word)
+{
+    if (2 * (c->nconstants + 1) > c->table_size)
+        grow_table(c);
+
+    size_t h = hash_word(word) & (c->table_size - 1);
+    for (; c->table[h] != 0; h = (h + 1) & (c->table_size - 1))
+        if (strcmp(c->strings + c->constants[c->table[h] - 1], word) == 0)
+            return c->table[h] - 1;
+
+    size_t len = strlen(word) + 1;
+    grow(&c->strings, &c->strings_capacity, c->strings_length + len, 1);
+    memcpy(c->strings + c->strings_length, word, len);
+
+    grow(&c->constants, &c->constants_capacity, c->nconstants + 1,
+         sizeof *c->constants);
+    grow(&c->slot_of, &c->slot_of_capacity, c->nconstants + 1,
+         sizeof *c->slot_of);
+    c->constants[c->nconstants] = c->strings_length;
+    c->slot_of[c->nconstants] = 0;
+    c->strings_length += len;
+    c->table[h] = c->nconstants + 1;
+    return c->nconstants++;
+}
+
+static size_t
+optional_constant(struct compiler *c, const char *word)
+{
+    return word ? constant(c, word) : BC_NONE;
+}
+
+/* Return the slot of the command named by constant 'name' */
+static size_t
+slot(struct compiler *c, size_t name)
+{
+    if (c->slot_of[name] == 0) {
+        grow(&c->slot_names, &c->slots_capacity, c->nslots + 1,
+             sizeof *c->slot_names);
+        c->slot_names[c->nslots] = name;
+        c->slot_of[name] = ++c->nslots;
+    }
+    return c->slot_of[name] - 1;
+}
+
+static void
+emit_words(struct compiler *c, char **words)
+{
+    size_t n = 0;
+    while (words[n])
+        n++;
+    emit(c, n);
+    for (size_t i = 0; i < n; i++)
+        emit(c, constant(c, words[i]));
+}
+
+static void encode_list(struct compiler *c, struct ast_command_line *cmdline);
+
+static void
+encode_optional_list(struct compiler *c, struct ast_command_line *cmdline)
+{
+    emit(c, cmdline != NULL);
+    if (cmdline)
+        encode_list(c, cmdline);
+}
+
+static void
+encode_compound(struct compiler *c, struct ast_compound *compound)
+{
+    emit(c, compound->kind);
+    encode_optional_list(c, compound->condition);
+    encode_optional_list(c, compound->body);
+    encode_optional_list(c, compound->else_part);
+    emit(c, optional_constant(c, compound->variable));
+    emit(c, compound->words != NULL);
+    if (compound->words)
+        emit_words(c, compound->words);
+    emit(c, optional_constant(c, compound->subject));
+    emit(c, list_size(&compound->items));
+    for (struct list_elem * e = list_begin(&compound->items);
+         e != list_end(&compound->items);
+         e = list_next(e)) {
+        struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+        emit_words(c, item->patterns);
+        encode_list(c, item->body);
+    }
+}
+
+static void
+encode_command(struct compiler *c, struct ast_command *cmd)
+{
+    uint32_t header = cmd->compound ? CMD_COMPOUND
+                    : cmd->group ? (cmd->subshell ? CMD_SUBSHELL : CMD_BRACES)
+                    : CMD_SIMPLE;
+    if (cmd->dup_stderr_to_stdout)
+        header |= CMD_DUP_STDERR;
+    if (cmd->function_name)
+        header |= CMD_FUNCTION_NAME;
+    emit(c, header);
+    if (cmd->function_name)
+        emit(c, constant(c, cmd->function_name));
+
+    if (cmd->compound)
+        encode_compound(c, cmd->compound);
+    else if (cmd->group)
+        encode_list(c, cmd->group);
+    else
+        emit_words(c, cmd->argv);
+}
+
+static void
+encode_pipeline(struct compiler *c, struct ast_pipeline *pipe)
+{
+    uint32_t flags = (pipe->bg_job ? PIPE_BG : 0)
+                   | (pipe->append_to_output ? PIPE_APPEND : 0);
+    emit(c, flags | (uint32_t) list_size(&pipe->commands) << 8);
+    emit(c, optional_constant(c, pipe->iored_input));
+    emit(c, optional_constant(c, pipe->iored_output));
+    for (struct list_elem * e = list_begin(&pipe->commands);
+         e != list_end(&pipe->commands);
+         e = list_next(e))
+        encode_command(c, list_entry(e, struct ast_command, elem));
+}
+
+static void
+encode_list(struct compiler *c, struct ast_command_line *cmdline)
+{
+    emit(c, list_size(&cmdline->pipes));
+    for (struct list_elem * e = list_begin(&cmdline->pipes);
+         e != list_end(&cmdline->pipes);
+         e = list_next(e)) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        emit(c, pipe->connector);
+        encode_pipeline(c, pipe);
+    }
+}
+
+/* True if 'word' is NAME=value with a value that globbing leaves alone */
+static bool
+is_assignment(const char *word)
+{
+    const char *eq = strchr(word, '=');
+    return eq != NULL && variables_valid_name(word, eq - word)
+        && !glob_has_chars(word);
+}
+
+/* True if 'word' is the same whatever the variables and files are */
+static bool
+is_literal_word(const char *word)
+{
+    return strpbrk(word, "$*?[") == NULL && strchr(word, GLOB_CTLESC) == NULL;
+}
+
+/* True if 'word' names the same command whatever the variables are */
+static bool
+is_literal_name(const char *word)
+{
+    return is_literal_word(word) && strchr(word, '=') == NULL;
+}
+
+/* Return the end of the integer 's' starts with, or NULL if none */
+static const char *
+skip_number(const char *s)
+{
+    if (*s == '-')
+        s++;
+    size_t digits = strspn(s, "0123456789");
+    return digits > 0 ? s + digits : NULL;
+}
+
+/* True if 'word' is {M..N}, which a for loop counts through without
+ * making a word of each value */
+static bool
+is_range(const char *word, char **first, char **last)
+{
+    if (word[0] != '{')
+        return false;
+    const char *dots = skip_number(word + 1);
+    if (dots == NULL || strncmp(dots, "..", 2) != 0)
+        return false;
+    const char *end = skip_number(dots + 2);
+    if (end == NULL || strcmp(end, "}") != 0)
+        return false;
+    *first = strndup(word + 1, dots - (word + 1));
+    *last = strndup(dots + 2, end - (dots + 2));
+    return true;
+}
+
+static void compile_list(struct compiler *c, struct ast_command_line *cmdline);
+
+static void
+enter(struct compiler *c)
+{
+    if (++c->depth > c->max_depth)
+        c->max_depth = c->depth;
+    emit_op(c, BC_LOOP, 0);
+}
+
+static void
+compile_if(struct compiler *c, struct ast_compound *compound)
+{
+    compile_list(c, compound->condition);
+    size_t skip = emit_op(c, BC_JUMP_FALSE, 0);
+    compile_list(c, compound->body);
+    size_t end = emit_op(c, BC_JUMP, 0);
+    patch(c, skip, c->length);
+    if (compound->else_part)
+        compile_list(c, compound->else_part);
+    else
+        emit_op(c, BC_STATUS, 0);       /* no branch ran */
+    patch(c, end, c->length);
+}
+
+static void
+compile_while(struct compiler *c, struct ast_compound *compound)
+{
+    enter(c);
+    size_t top = c->length;
+    compile_list(c, compound->condition);
+    size_t exit = emit_op(c, compound->kind == AST_WHILE ? BC_JUMP_FALSE
+                                                         : BC_JUMP_TRUE, 0);
+    compile_list(c, compound->body);
+    emit_op(c, BC_KEEP, 0);
+    emit_op(c, BC_JUMP, top);
+    patch(c, exit, c->length);
+    emit_op(c, BC_LOOP_END, 0);
+    c->depth--;
+}
+
+static void
+compile_for(struct compiler *c, struct ast_compound *compound)
+{
+    enter(c);
+    char *first, *last;
+    if (compound->words[0] != NULL && compound->words[1] == NULL
+        && is_range(compound->words[0], &first, &last)) {
+        emit_op(c, BC_RANGE, constant(c, first));
+        emit(c, constant(c, last));
+        free(first);
+        free(last);
+    } else {
+        size_t n = 0;
+        while (compound->words[n])
+            n++;
+        emit_op(c, BC_FOR, n);
+        for (size_t i = 0; i < n; i++)
+            emit(c, constant(c, compound->words[i]));
+    }
+    size_t top = emit_op(c, BC_NEXT, constant(c, compound->variable));
+    size_t exit = emit(c, 0);
+    compile_list(c, compound->body);
+    emit_op(c, BC_KEEP, 0);
+    emit_op(c, BC_JUMP, top);
+    c->code[exit] = c->length;
+    emit_op(c, BC_LOOP_END, 0);
+    c->depth--;
+}
+
+static void
+compile_case(struct compiler *c, struct ast_compound *compound)
+{
+    if (++c->depth > c->max_depth)
+        c->max_depth = c->depth;
+    emit_op(c, BC_CASE, constant(c, compound->subject));
+    size_t done = BC_NONE;
+    for (struct list_elem * e = list_begin(&compound->items);
+         e != list_end(&compound->items);
+         e = list_next(e)) {
+        struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+        size_t matched = BC_NONE;
+        for (char **pattern = item->patterns; *pattern; pattern++) {
+            emit_op(c, BC_MATCH, constant(c, *pattern));
+            matched = emit(c, matched);
+        }
+        size_t next = emit_op(c, BC_JUMP, 0);
+        patch_word_chain(c, matched, c->length);
+        compile_list(c, item->body);
+        done = emit_op(c, BC_JUMP, done);
+        patch(c, next, c->length);
+    }
+    patch_chain(c, done, c->length);
+    emit_op(c, BC_ESAC, 0);
+    c->depth--;
+}
+
+static void
+compile_compound(struct compiler *c, struct ast_compound *compound)
+{
+    switch (compound->kind) {
+    case AST_IF:
+        compile_if(c, compound);
+        break;
+    case AST_WHILE:
+    case AST_UNTIL:
+        compile_while(c, compound);
+        break;
+    case AST_FOR:
+        compile_for(c, compound);
+        break;
+    case AST_CASE:
+        compile_case(c, compound);
+        break;
+    }
+}
+
+static void
+compile_pipeline(struct compiler *c, struct ast_pipeline *pipe)
+{
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands),
+                                         struct ast_command, elem);
+    bool alone = list_size(&pipe->commands) == 1 && !pipe->bg_job
+              && pipe->iored_input == NULL && pipe->iored_output == NULL
+              && !cmd->dup_stderr_to_stdout && cmd->function_name == NULL;
+
+    if (alone && c->use_slots && cmd->compound) {
+        compile_compound(c, cmd->compound);
+        return;
+    }
+    if (alone && c->use_slots && cmd->group && !cmd->subshell) {
+        compile_list(c, cmd->group);
+        return;
+    }
+    if (c->use_slots && list_size(&pipe->commands) == 1 && cmd->function_name) {
+        size_t at = emit_op(c, BC_DEFINE, 0);
+        emit(c, constant(c, cmd->function_name));
+        encode_pipeline(c, pipe);
+        patch(c, at, c->length - at - 1);
+        return;
+    }
+    if (alone && c->use_slots && !cmd->group && !cmd->compound) {
+        char **argv = cmd->argv;
+        if (argv[1] == NULL && is_assignment(argv[0])) {
+            char *eq = strchr(argv[0], '=');
+            char *name = strndup(argv[0], eq - argv[0]);
+            bool copy = eq[1] == '$' && variables_valid_name(eq + 2, strlen(eq + 2));
+            emit_op(c, copy ? BC_COPY : BC_ASSIGN, constant(c, name));
+            emit(c, constant(c, copy ? eq + 2 : eq + 1));
+            free(name);
+            return;
+        }
+        if (is_literal_name(argv[0])) {
+            emit_op(c, BC_COMMAND, slot(c, constant(c, argv[0])));
+            size_t count = c->length;
+            emit_words(c, argv);
+            bool literal = true;
+            for (char **word = argv; *word != NULL; word++)
+                literal = literal && is_literal_word(*word);
+            if (literal)
+                c->code[count] |= BC_LITERAL;
+            return;
+        }
+    }
+
+    size_t at = emit_op(c, BC_PIPELINE, 0);
+    encode_pipeline(c, pipe);
+    patch(c, at, c->length - at - 1);
+}
+
+static void
+compile_list(struct compiler *c, struct ast_command_line *cmdline)
+{
+    for (struct list_elem * e = list_begin(&cmdline->pipes);
+         e != list_end(&cmdline->pipes);
+         e = list_next(e)) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        size_t skip = BC_NONE;
+        if (pipe->connector == AST_AND)
+            skip = emit_op(c, BC_JUMP_FALSE, 0);
+        else if (pipe->connector == AST_OR)
+            skip = emit_op(c, BC_JUMP_TRUE, 0);
+        compile_pipeline(c, pipe);
+        if (skip != BC_NONE)
+            patch(c, skip, c->length);
+    }
+}
+
+static struct bytecode_program *
+finish(struct compiler *c)
+{
+    emit_op(c, BC_RETURN, 0);
+
+    struct bytecode_program *prog = calloc(1, sizeof *prog);
+    struct bytecode_slot *slots = calloc(c->nslots + 1, sizeof *slots);
+    struct variables_hint *hints = c->max_depth > 0
+        ? calloc(c->nconstants + 1, sizeof *hints) : NULL;
+    if (prog == NULL || slots == NULL || (c->max_depth > 0 && hints == NULL))
+        utils_fatal_error("out of memory compiling a command: ");
+    prog->code = c->code;
+    prog->length = c->length;
+    prog->constants = c->constants;
+    prog->nconstants = c->nconstants;
+    prog->strings = c->strings;
+    prog->strings_length = c->strings_length;
+    prog->slot_names = c->slot_names;
+    prog->nslots = c->nslots;
+    prog->max_depth = c->max_depth;
+    prog->slots = slots;
+    prog->hints = hints;
+    free(c->slot_of);
+    free(c->table);
+    return prog;
+}
+
+struct bytecode_program *
+bytecode_compile(struct ast_command_line *cmdline, bool use_slots)
+{
+    struct compiler c = { .use_slots = use_slots };
+    compile_list(&c, cmdline);
+    return finish(&c);
+}
+
+struct bytecode_program *
+bytecode_compile_compound(struct ast_compound *compound, bool use_slots)
+{
+    struct compiler c = { .use_slots = use_slots };
+    compile_compound(&c, compound);
+    return finish(&c);
+}
+
+const char *
+bytecode_constant(const struct bytecode_program *prog, uint32_t index)
+{
+    return prog->strings + prog->constants[index];
+}
+
+/* Decoding: reads the words of an encoded pipeline in order */
+struct decoder {
+    const struct bytecode_program *prog;
+    const uint32_t *at;
+};
+
+static uint32_t
+next(struct decoder *d)
+{
+    return *d->at++;
+}
+
+static char *
+decode_word(struct decoder *d)
+{
+    uint32_t index = next(d);
+    return index == BC_NONE ? NULL : strdup(bytecode_constant(d->prog, index));
+}
+
+static char **
+decode_words(struct decoder *d)
+{
+    uint32_t n = next(d);
+    char **words = malloc((n + 1) * sizeof *words);
+    for (uint32_t i = 0; i < n; i++)
+        words[i] = strdup(bytecode_constant(d->prog, next(d)));
+    words[n] = NULL;
+    return words;
+}
+
+static struct ast_command_line *decode_list(struct decoder *d);
+
+static struct ast_command_line *
+decode_optional_list(struct decoder *d)
+{
+    return next(d) ? decode_list(d) : NULL;
+}
+
+static struct ast_compound *
+decode_compound(struct decoder *d)
+{
+    struct ast_compound *compound = ast_compound_create(next(d));
+    compound->condition = decode_optional_list(d);
+    compound->body = decode_optional_list(d);
+    compound->else_part = decode_optional_list(d);
+    compound->variable = decode_word(d);
+    if (next(d))
+        compound->words = decode_words(d);
+    compound->subject = decode_word(d);
+    for (uint32_t n = next(d); n > 0; n--) {
+        char **patterns = decode_words(d);
+        ast_compound_add_case(compound, patterns, decode_list(d));
+    }
+    return compound;
+}
+
+static struct ast_command *
+decode_command(struct decoder *d)
+{
+    uint32_t header = next(d);
+    bool dup = header & CMD_DUP_STDERR;
+    char *function_name = header & CMD_FUNCTION_NAME ? decode_word(d) : NULL;
+
+    struct ast_command *cmd;
+    switch (header & 0xff) {
+    case CMD_COMPOUND:
+        cmd = ast_command_create_compound(decode_compound(d), dup);
+        break;
+    case CMD_BRACES:
+    case CMD_SUBSHELL:
+        cmd = ast_command_create_group(decode_list(d),
+                                       (header & 0xff) == CMD_SUBSHELL, dup);
+        break;
+    default:
+        cmd = ast_command_create(decode_words(d), dup);
+        break;
+    }
+    cmd->function_name = function_name;
+    return cmd;
+}
+
+static struct ast_pipeline *
+decode_pipeline(struct decoder *d)
+{
+    uint32_t flags = next(d);
+    char *input = decode_word(d);
+    char *output = decode_word(d);
+    struct ast_pipeline *pipe = ast_pipeline_create(input, output,
+                                                    flags & PIPE_APPEND);
+    pipe->bg_job = flags & PIPE_BG;
+    for (uint32_t n = flags >> 8; n > 0; n--)
+        ast_pipeline_add_command(pipe, decode_command(d));
+    return pipe;
+}
+
+static struct ast_command_line *
+decode_list(struct decoder *d)
+{
+    struct ast_command_line *cmdline = ast_command_line_create_empty();
+    for (uint32_t n = next(d); n > 0; n--) {
+        enum ast_connector connector = next(d);
+        struct ast_pipeline *pipe = decode_pipeline(d);
+        pipe->connector = connector;
+        list_push_back(&cmdline->pipes, &pipe->elem);
+    }
+    return cmdline;
+}
+
+struct ast_pipeline *
+bytecode_decode_pipeline(const struct bytecode_program *prog,
+                         const uint32_t *at)
+{
+    struct decoder d = { prog, at };
+    return decode_pipeline(&d);
+}
+
+struct ast_command_line *
+bytecode_decode_function(const struct bytecode_program *prog,
+                         const uint32_t *at)
+{
+    struct ast_pipeline *pipe = bytecode_decode_pipeline(prog, at + 2);
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands),
+                                         struct ast_command, elem);
+    free(cmd->function_name);
+    cmd->function_name = NULL;
+    pipe->bg_job = false;
+
+    struct ast_command_line *body = ast_command_line_create_empty();
+    list_push_back(&body->pipes, &pipe->elem);
+    return body;
+}
+
+struct bytecode_program *
+bytecode_share(struct bytecode_program *prog)
+{
+    prog->shares++;
+    return prog;
+}
+
+/* An image is this header, followed by the code, the constants and
+ * the slot names as arrays of words, and then the strings */
+#define BYTECODE_MAGIC      0x32636263      /* "cbc2", changed with the encoding */
+struct image_header {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t nconstants;
+    uint32_t nslots;
+    uint32_t max_depth;
+    uint32_t strings_length;
+};
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+bool
+bytecode_save(const struct bytecode_program *prog, int fd)
+{
+    struct image_header header = {
+        .magic = BYTECODE_MAGIC,
+        .length = prog->length,
+        .nconstants = prog->nconstants,
+        .nslots = prog->nslots,
+        .max_depth = prog->max_depth,
+        .strings_length = prog->strings_length,
+    };
+    return write_all(fd, &header, sizeof header)
+        && write_all(fd, prog->code, prog->length * sizeof *prog->code)
+        && write_all(fd, prog->constants,
+                     prog->nconstants * sizeof *prog->constants)
+        && write_all(fd, prog->slot_names,
+                     prog->nslots * sizeof *prog->slot_names)
+        && write_all(fd, prog->strings, prog->strings_length);
+}
+
+struct bytecode_program *
+bytecode_load(const void *image, size_t size)
+{
+    const struct image_header *header = image;
+    if (size < sizeof *header || header->magic != BYTECODE_MAGIC)
+        return NULL;
+
+    size_t words = (size_t) header->length + header->nconstants + header->nslots;
+    if (header->length == 0 || header->strings_length == 0
+        || size != sizeof *header + words * sizeof(uint32_t)
+                   + header->strings_length)
+        return NULL;
+
+    const uint32_t *code = (const uint32_t *) (header + 1);
+    const uint32_t *constants = code + header->length;
+    const uint32_t *slot_names = constants + header->nconstants;
+    const char *strings = (const char *) (slot_names + header->nslots);
+
+    /* The code itself is trusted, but an image cut short or grown must
+     * not make the shell read outside of it */
+    if (BC_OP(code[header->length - 1]) != BC_RETURN
+        || strings[header->strings_length - 1] != '\0')
+        return NULL;
+    for (size_t i = 0; i < header->nconstants; i++)
+        if (constants[i] >= header->strings_length)
+            return NULL;
+    for (size_t i = 0; i < header->nslots; i++)
+        if (slot_names[i] >= header->nconstants)
+            return NULL;
+
+    struct bytecode_program *prog = calloc(1, sizeof *prog);
+    struct bytecode_slot *slots = calloc(header->nslots + 1, sizeof *slots);
+    struct variables_hint *hints = header->max_depth > 0
+        ? calloc(header->nconstants + 1, sizeof *hints) : NULL;
+    if (prog == NULL || slots == NULL || (header->max_depth > 0 && hints == NULL))
+        utils_fatal_error("out of memory loading a command: ");
+    prog->code = code;
+    prog->length = header->length;
+    prog->constants = constants;
+    prog->nconstants = header->nconstants;
+    prog->strings = strings;
+    prog->strings_length = header->strings_length;
+    prog->slot_names = slot_names;
+    prog->nslots = header->nslots;
+    prog->max_depth = header->max_depth;
+    prog->slots = slots;
+    prog->hints = hints;
+    return prog;
+}
+
+void
+bytecode_free(struct bytecode_program *prog)
+{
+    if (prog->shares > 0) {
+        prog->shares--;
+        return;
+    }
+    for (size_t i = 0; i < prog->nslots; i++)
+        free(prog->slots[i].path);
+    free(prog->slots);
+    free(prog->hints);
+    if (prog->mapping != NULL) {
+        munmap(prog->mapping, prog->mapping_size);
+        free(prog);
+        return;
+    }
+    free((void *) prog->code);
+    free((void *) prog->constants);
+    free((void *) prog->strings);
+    free((void *) prog->slot_names);
+    free(prog);
+}
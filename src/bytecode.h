@@ -0,0 +1,133 @@
+#ifndef __BYTECODE_H
+#define __BYTECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shell-ast.h"
+
+/* An instruction is a 32-bit word with the opcode in its low 8 bits
+ * and an operand 'a' in the upper 24, followed by the words of any
+ * further operands.  Jump targets are indices into the code, and
+ * words are indices into the constant pool. */
+#define BC_OP(insn)     ((insn) & 0xff)
+#define BC_ARG(insn)    ((insn) >> 8)
+#define BC_NONE         0xffffff    /* no constant, e.g. no redirection */
+#define BC_LITERAL      0x80000000  /* in the word count of BC_COMMAND */
+#define BC_WORDS(count) ((count) & ~BC_LITERAL)
+
+/* Initial capacity of the arrays a program is compiled into */
+#define BYTECODE_INITIAL_SIZE 64
+
+enum bytecode_op {
+    BC_PIPELINE,    /* a: length of the encoded pipeline that follows,
+                       which is rebuilt into a syntax tree and run */
+    BC_DEFINE,      /* a: length of what follows: the NAME of a function
+                       and its encoded definition, decoded when the
+                       function is first called */
+    BC_COMMAND,     /* a: slot; then the number of words, with BC_LITERAL
+                       set if none needs expanding, and the words of a
+                       simple command, which runs through the slot */
+    BC_ASSIGN,      /* a: NAME; then the value, expanded */
+    BC_COPY,        /* a: NAME; then the name of the variable whose value
+                       it gets, for the common NAME=$OTHER */
+    BC_JUMP,        /* a: target */
+    BC_JUMP_FALSE,  /* a: target, taken if $? is not 0 */
+    BC_JUMP_TRUE,   /* a: target, taken if $? is 0 */
+    BC_STATUS,      /* set $? to a */
+    BC_LOOP,        /* a loop starts; its status is 0 unless a body runs */
+    BC_KEEP,        /* the loop's status is now $? */
+    BC_LOOP_END,    /* set $? to the loop's status */
+    BC_FOR,         /* a: number of words that follow, expanded and
+                       globbed into the values of a for loop */
+    BC_RANGE,       /* a: first value; then the last, for {M..N} */
+    BC_NEXT,        /* a: NAME, set to the next value of the loop; then the
+                       target taken, dropping the values, after the last */
+    BC_CASE,        /* a: subject of a case, expanded */
+    BC_MATCH,       /* a: pattern; then the target taken if the subject
+                       matches it */
+    BC_ESAC,        /* drop the subject */
+    BC_RETURN,      /* end of the program */
+};
+
+/* How a command name used by BC_COMMAND was resolved the last time
+ * the shell looked, which it does again when 'generation' or
+ * 'path_changes' is stale */
+struct builtin;
+struct bytecode_slot {
+    unsigned long generation;       /* of the definitions, 0 if never
+                                       resolved */
+    unsigned long path_changes;     /* times PATH had been set */
+    const struct builtin *builtin;  /* a builtin, run from the words */
+    char *path;                     /* or the program found in PATH */
+};
+
+struct variables_hint;
+
+/* A compiled command line.  Code and constants refer to nothing
+ * outside of themselves, so that they could be used from wherever
+ * they were loaded. */
+struct bytecode_program {
+    const uint32_t *code;
+    size_t length;                  /* of code, in words */
+    const uint32_t *constants;      /* offset of each one in 'strings' */
+    size_t nconstants;
+    const char *strings;            /* the constants, NUL-terminated */
+    size_t strings_length;
+    const uint32_t *slot_names;     /* constant naming each slot */
+    size_t nslots;
+    size_t max_depth;               /* of nested loops and case commands */
+    struct bytecode_slot *slots;    /* filled in by the shell */
+    struct variables_hint *hints;   /* one per constant, for those that
+                                       name variables the code uses, or
+                                       NULL if none of it runs twice */
+    void *mapping;                  /* if not NULL, the mapped file that
+                                       code and constants point into */
+    size_t mapping_size;
+    size_t shares;                  /* references taken by bytecode_share */
+};
+
+/* Compile 'cmdline', or the compound command 'compound'.  Pipelines
+ * that run on their own in the shell become code, except that with
+ * 'use_slots' false, every pipeline, compound commands included, is
+ * rebuilt from its syntax tree and run as a tree-walking interpreter
+ * would run it. */
+struct bytecode_program *bytecode_compile(struct ast_command_line *cmdline,
+                                          bool use_slots);
+struct bytecode_program *bytecode_compile_compound(struct ast_compound *compound,
+                                                   bool use_slots);
+
+/* Return constant 'index' */
+const char *bytecode_constant(const struct bytecode_program *prog,
+                              uint32_t index);
+
+/* Build the syntax tree of the pipeline encoded at 'at', after its
+ * BC_PIPELINE instruction */
+struct ast_pipeline *bytecode_decode_pipeline(const struct bytecode_program *prog,
+                                              const uint32_t *at);
+
+/* Build the body of the function defined by the BC_DEFINE at 'at':
+ * its pipeline, without the name */
+struct ast_command_line *bytecode_decode_function(const struct bytecode_program *prog,
+                                                  const uint32_t *at);
+
+/* Take another reference to 'prog', for code that uses it after its
+ * compiler has called bytecode_free */
+struct bytecode_program *bytecode_share(struct bytecode_program *prog);
+
+/* Write 'prog' to 'fd' as an image that bytecode_load can run in
+ * place.  Returns false if writing failed. */
+bool bytecode_save(const struct bytecode_program *prog, int fd);
+
+/* Return the program in the image of 'size' bytes at 'image', which
+ * must be aligned to 4 bytes and stay valid while the program is used,
+ * or NULL if it is not a whole image.  The caller stores the mapping
+ * that holds the image in 'mapping' and 'mapping_size', which
+ * bytecode_free unmaps. */
+struct bytecode_program *bytecode_load(const void *image, size_t size);
+
+/* Drop a reference to 'prog', which is freed with the last one */
+void bytecode_free(struct bytecode_program *prog);
+
+#endif /* __BYTECODE_H */
@@ -0,0 +1,278 @@
+/*
+ * Command name completion.
+ *
+ * The executables found in the PATH directories, and the builtins,
+ * are kept in a trie, so that completing a command costs time in
+ * proportion to the prefix and the number of matches, not to the
+ * size of the PATH directories.  The directories are read once;
+ * afterwards an inotify watch on each of them, serviced by the
+ * event loop, keeps the trie current.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "completion.h"
+#include "event_loop.h"
+#include "utils.h"
+
+/* Trie of command names, one byte per level */
+struct trie_node {
+    struct trie_node *child;    /* first child; children are sorted by byte */
+    struct trie_node *sibling;
+    unsigned char c;
+    uint64_t where;             /* bit i: executable in PATH directory i */
+};
+
+#define BUILTIN_BIT (1ULL << COMPLETION_MAX_DIRS)
+
+static struct trie_node root;
+
+/* The PATH directories, in PATH order */
+static struct path_dir {
+    int fd;                     /* used to check files named by inotify */
+    int wd;                     /* inotify watch, -1 if none */
+} dirs[COMPLETION_MAX_DIRS];
+static int ndirs;
+
+static int inotify_fd = -1;
+
+#define WATCHED_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+                        | IN_ATTRIB | IN_ONLYDIR)
+
+/* Return the node for 'word', adding it if 'create' is set */
+static struct trie_node *
+trie_find(const char *word, bool create)
+{
+    struct trie_node *node = &root;
+
+    for (const unsigned char *p = (const unsigned char *) word; *p; p++) {
+        struct trie_node **link = &node->child;
+        while (*link != NULL && (*link)->c < *p)
+            link = &(*link)->sibling;
+
+        if (*link == NULL || (*link)->c != *p) {
+            if (!create)
+                return NULL;
+            struct trie_node *n = calloc(1, sizeof *n);
+            if (n == NULL)
+                utils_fatal_error("out of memory growing the command trie: ");
+            n->c = *p;
+            n->sibling = *link;
+            *link = n;
+        }
+        node = *link;
+    }
+    return node;
+}
+
+/* Clear 'bits' in every node at or below 'node' and its siblings */
+static void
+trie_clear_bits(struct trie_node *node, uint64_t bits)
+{
+    for (; node != NULL; node = node->sibling) {
+        node->where &= ~bits;
+        trie_clear_bits(node->child, bits);
+    }
+}
+
+/* Record whether 'name' in PATH directory 'i' is an executable file */
+static void
+update_entry(int i, const char *name)
+{
+    struct stat st;
+    bool executable = fstatat(dirs[i].fd, name, &st, 0) == 0
+                   && S_ISREG(st.st_mode)
+                   && faccessat(dirs[i].fd, name, X_OK, AT_EACCESS) == 0;
+
+    if (executable) {
+        trie_find(name, true)->where |= 1ULL << i;
+    } else {
+        struct trie_node *node = trie_find(name, false);
+        if (node != NULL)
+            node->where &= ~(1ULL << i);
+    }
+}
+
+/* Add all executables in PATH directory 'i' */
+static void
+scan_dir(int i)
+{
+    DIR *d = fdopendir(openat(dirs[i].fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (d == NULL)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_type == DT_REG || e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+            update_entry(i, e->d_name);
+    }
+    closedir(d);
+}
+
+/* Forget PATH directory 'i', e.g. after it was removed */
+static void
+drop_dir(int i)
+{
+    trie_clear_bits(root.child, 1ULL << i);
+    if (dirs[i].wd != -1)
+        inotify_rm_watch(inotify_fd, dirs[i].wd);
+    dirs[i].wd = -1;
+    if (dirs[i].fd != -1)
+        close(dirs[i].fd);
+    dirs[i].fd = -1;
+}
+
+static void
+handle_event(struct inotify_event *ev)
+{
+    /* Events were lost, start over. */
+    if (ev->mask & IN_Q_OVERFLOW) {
+        for (int i = 0; i < ndirs; i++) {
+            trie_clear_bits(root.child, 1ULL << i);
+            if (dirs[i].fd != -1)
+                scan_dir(i);
+        }
+        return;
+    }
+
+    /* Two PATH entries can name the same directory and thus share a watch. */
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].wd != ev->wd)
+            continue;
+
+        if (ev->mask & IN_IGNORED) {            /* directory went away */
+            dirs[i].wd = -1;
+            drop_dir(i);
+        } else if (ev->len > 0) {
+            update_entry(i, ev->name);
+        }
+    }
+}
+
+/* Event loop callback for the inotify descriptor */
+static void
+inotify_ready(int fd, void *ctx)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof buf)) > 0) {
+        struct inotify_event *ev;
+        for (char *p = buf; p < buf + len; p += sizeof *ev + ev->len) {
+            ev = (struct inotify_event *) p;
+            handle_event(ev);
+        }
+    }
+}
+
+void
+completion_set_path(const char *path)
+{
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1)
+            utils_error("inotify_init1 failed, completion will not see new commands: ");
+        else
+            event_loop_add_fd(inotify_fd, inotify_ready, NULL);
+    }
+
+    for (int i = 0; i < ndirs; i++)
+        drop_dir(i);
+    ndirs = 0;
+
+    char *copy = strdup(path);
+    char *save;
+    for (char *dir = strtok_r(copy, ":", &save);
+         dir != NULL && ndirs < COMPLETION_MAX_DIRS;
+         dir = strtok_r(NULL, ":", &save)) {
+        int i = ndirs;
+        dirs[i].fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirs[i].fd == -1)
+            continue;
+
+        /* Watch before reading, so that no change is missed. */
+        dirs[i].wd = inotify_fd == -1 ? -1
+                   : inotify_add_watch(inotify_fd, dir, WATCHED_EVENTS);
+        ndirs++;
+        scan_dir(i);
+    }
+    free(copy);
+}
+
+void
+completion_add_builtin(const char *name)
+{
+    trie_find(name, true)->where |= BUILTIN_BIT;
+}
+
+struct match_list {
+    char **words;
+    size_t n, capacity;
+};
+
+/* Add every command at or below 'node', whose name is word[0..len) */
+static void
+collect(struct trie_node *node, char *word, size_t len, struct match_list *list)
+{
+    if (node->where != 0) {
+        if (list->n == list->capacity) {
+            list->capacity = list->capacity ? 2 * list->capacity : 16;
+            list->words = realloc(list->words, list->capacity * sizeof *list->words);
+            if (list->words == NULL)
+                utils_fatal_error("out of memory collecting completions: ");
+        }
+        list->words[list->n++] = strndup(word, len);
+    }
+
+    if (len == NAME_MAX)
+        return;
+    for (struct trie_node *c = node->child; c != NULL; c = c->sibling) {
+        word[len] = c->c;
+        collect(c, word, len + 1, list);
+    }
+}
+
+char **
+completion_command_matches(const char *prefix)
+{
+    size_t len = strlen(prefix);
+    struct trie_node *node = trie_find(prefix, false);
+    if (node == NULL || len > NAME_MAX)
+        return NULL;
+
+    char word[NAME_MAX + 1];
+    struct match_list list = { .words = NULL };
+    memcpy(word, prefix, len);
+    collect(node, word, len, &list);
+    if (list.n == 0)
+        return NULL;
+
+    /* readline wants a single match alone, else the common prefix first */
+    char **matches = malloc((list.n + 2) * sizeof *matches);
+    if (matches == NULL)
+        utils_fatal_error("out of memory collecting completions: ");
+    if (list.n == 1) {
+        matches[0] = list.words[0];
+        matches[1] = NULL;
+    } else {
+        while (node->where == 0 && node->child != NULL && node->child->sibling == NULL) {
+            node = node->child;
+            word[len++] = node->c;
+        }
+        matches[0] = strndup(word, len);
+        memcpy(matches + 1, list.words, list.n * sizeof *matches);
+        matches[list.n + 1] = NULL;
+    }
+    free(list.words);
+    return matches;
+}
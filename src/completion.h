@@ -0,0 +1,20 @@
+#ifndef __COMPLETION_H
+#define __COMPLETION_H
+
+/* At most this many PATH directories are used for completion */
+#define COMPLETION_MAX_DIRS 63
+
+/* Index the executables in the colon-separated directory list 'path'
+ * and keep watching those directories, through the event loop, for
+ * executables being added or removed.  Replaces a previous PATH. */
+void completion_set_path(const char *path);
+
+/* Add a builtin command name to the set of completed commands */
+void completion_add_builtin(const char *name);
+
+/* Return the commands starting with 'prefix' as a readline match
+ * list (the longest common prefix, then each match, then NULL),
+ * or NULL if there is none. */
+char **completion_command_matches(const char *prefix);
+
+#endif /* __COMPLETION_H */
@@ -0,0 +1,43 @@
+#!/usr/bin/python
+#
+# Tests tab completion of commands: an executable that appears in a
+# PATH directory while the shell runs must be completed without a
+# rescan, and builtins are completed as well.
+#
+import atexit, os, shutil, tempfile, time
+from testutils import *
+
+bindir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, bindir)
+os.environ['PATH'] = bindir + ':' + os.environ['PATH']
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. A new executable is completed once inotify reports it.
+#
+script = os.path.join(bindir, 'cushtestcmd_unique')
+with open(script, 'w') as f:
+    f.write('#!/bin/sh\necho completed-and-ran\n')
+os.chmod(script, 0755)
+time.sleep(0.2)
+
+console.send('cushtestcmd_un\t')
+time.sleep(0.2)
+sendline('')
+expect_exact('completed-and-ran', "new executable was not completed")
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 2. Builtins are completed.
+#
+console.send('histo\t')
+time.sleep(0.2)
+sendline('1')
+expect_exact('  history 1\r\n', "builtin was not completed")
+expect_prompt("Shell did not print expected prompt (3)")
+
+test_success()
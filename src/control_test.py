@@ -0,0 +1,119 @@
+#!/usr/bin/python
+#
+# Tests if, while, until, for and case: their branches and loops,
+# their exit status, and that a loop notices when one of its commands
+# is redefined or PATH changes while it runs.
+#
+import atexit, os, shutil, tempfile
+from testutils import *
+
+# a program 'whichdir' in two directories, printing which one it is in
+workdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, workdir)
+for name in ('first', 'second'):
+    os.mkdir(os.path.join(workdir, name))
+    program = os.path.join(workdir, name, 'whichdir')
+    open(program, 'w').write('#!/bin/sh\necho %s\n' % name)
+    os.chmod(program, 0755)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. if runs the branch its condition selects; elif and else.
+#
+sendline('if false; then echo then; elif true; then echo elif; else echo else; fi')
+expect_exact('elif', "if did not take the elif branch")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('if false; then echo then; fi; echo status $?')
+expect_exact('status 0', "an if without a branch that ran did not succeed")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. while and until loop on their condition; a loop has the
+# status of the last turn of its body.
+#
+sendline('x=a; while test $x != aaa; do echo turn $x; x=${x}a; done')
+expect_exact('turn a\r\nturn aa\r\n', "while did not loop on its condition")
+expect_prompt("Shell did not print expected prompt (4)")
+
+sendline('until test $x = a; do x=a; sh -c "exit 3"; done; echo status $?')
+expect_exact('status 3', "the loop did not take the status of its body")
+expect_prompt("Shell did not print expected prompt (5)")
+
+#################################################################
+# Step 3. for loops over words, globs and {M..N} ranges.
+#
+sendline('for w in one "two words" three; do echo word $w; done')
+expect_exact('word one\r\nword two words\r\nword three\r\n', "for did not loop over its words")
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline('for n in {3..1}; do echo -n $n; done; echo')
+expect_exact('321', "for did not count down the range")
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline('for n in {1..5}; do echo $n; done | wc -l')
+expect_exact('5', "the loop's output did not go through the pipe")
+expect_prompt("Shell did not print expected prompt (8)")
+
+#################################################################
+# Step 4. case runs the commands of the first pattern that matches.
+#
+sendline('for f in main.c README x; do case $f in *.c|*.h) echo $f source;; R*) echo $f doc;; *) echo $f other;; esac; done')
+expect_exact('main.c source\r\nREADME doc\r\nx other\r\n', "case did not pick the matching patterns")
+expect_prompt("Shell did not print expected prompt (9)")
+
+#################################################################
+# Step 5. A command redefined in the middle of a loop runs as its
+# new definition from then on, with or without the fast paths, and
+# a program is found again once PATH changes; defining other names
+# changes neither.
+#
+for mode in ('on', 'off'):
+    sendline('bytecode %s' % mode)
+    expect_prompt("Shell did not print expected prompt (10)")
+
+    sendline('unset -f jobs; for i in 1 2; do jobs; jobs() { echo mine $i; }; done')
+    expect_exact('mine 2', "the redefined builtin did not run as the function")
+    expect_prompt("Shell did not print expected prompt (11)")
+
+    sendline('for i in 1 2; do echo kept $i; alias other%s$i=ls; done' % mode)
+    expect_exact('kept 1\r\nkept 2\r\n', "defining other names changed the builtin")
+    expect_prompt("Shell did not print expected prompt (12)")
+
+    sendline('p=$PATH; PATH=%s/first:$p; for i in 1 2; do whichdir; PATH=%s/second:$p; done; PATH=$p'
+             % (workdir, workdir))
+    expect_exact('first\r\nsecond\r\n', "the loop did not look for the program in the new PATH")
+    expect_prompt("Shell did not print expected prompt (13)")
+
+#################################################################
+# Step 6. A loop finds the variables it sets where they are, after
+# they were unset and after more variables moved them in the table.
+#
+for mode in ('on', 'off'):
+    sendline('bytecode %s' % mode)
+    expect_prompt("Shell did not print expected prompt (14)")
+
+    sendline('x=0; for i in 1 2; do x=$i; unset x; x=$i$i; echo x=$x; done')
+    expect_exact('x=11\r\nx=22\r\n', "the loop did not set the variable it unset")
+    expect_prompt("Shell did not print expected prompt (15)")
+
+    sendline('for i in {1..300}; do v%s$i=$i; y=$i; done; echo $y $v%s1 $v%s300' % (mode, mode, mode))
+    expect_exact('300 1 300', "the loop lost its variables as the table grew")
+    expect_prompt("Shell did not print expected prompt (16)")
+
+#################################################################
+# Step 7. A loop in the background is one job.
+#
+sendline('for i in 1 2; do sleep 1; done &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (17)")
+
+sendline('unset -f jobs; jobs')
+expect_exact('[1]\tRunning\t\t(for i in 1 2; do sleep 1; done)', "the loop is not one job")
+expect_prompt("Shell did not print expected prompt (18)")
+
+test_success()
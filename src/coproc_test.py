@@ -0,0 +1,82 @@
+#!/usr/bin/python
+#
+# Tests coprocesses: 'coproc NAME cmd' starts a background job whose
+# input and output are pipes to the shell, exposed as NAME_IN and
+# NAME_OUT, so that one long-running process answers many commands.
+#
+import os, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. Start the coprocess, which is listed as a job.
+#
+sendline('coproc EDIT sed -u s/a/X/')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('jobs -l')
+expect_exact('coprocess EDIT', "coprocess is not listed by jobs -l")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. The same process answers several queries.
+#
+for word, answer in (('banana', 'bXnana'), ('apple', 'Xpple')):
+    sendline('echo %s > /dev/fd/$EDIT_IN' % word)
+    expect_prompt("Shell did not print expected prompt (4)")
+    sendline('head -n 1 < /dev/fd/$EDIT_OUT')
+    expect_exact(answer, "coprocess did not answer %s" % word)
+    expect_prompt("Shell did not print expected prompt (5)")
+
+sendline('echo $EDIT_PID')
+expect_regex(r'(\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (6)")
+
+#################################################################
+# Step 3. Only commands whose words expand $EDIT_IN or $EDIT_OUT inherit
+# the coprocess's fds: a job that does not, and may outlive the
+# coprocess, does not hold its pipes open, even when one of its words
+# is the fd's number, while 'sh -c' given $EDIT_IN writes to it.
+#
+sendline('echo $EDIT_IN')
+(edit_in,) = expect_regex(r'(\d+)\r\n')
+edit_in = int(edit_in)
+expect_prompt("Shell did not print expected prompt (7)")
+
+for cmd in ('sleep 30 &', 'sleep %d0 &' % edit_in, 'sleep %d &' % edit_in):
+    sendline(cmd)
+    (jobid, pid) = parse_bg_status()
+    expect_prompt("Shell did not print expected prompt (7)")
+    # until it has exec'd, the child still holds the shell's close-on-exec fds
+    while open('/proc/%s/comm' % pid).read().strip() != 'sleep':
+        time.sleep(0.05)
+    fds = [os.readlink('/proc/%s/fd/%s' % (pid, fd)) for fd in os.listdir('/proc/%s/fd' % pid)]
+    assert not any(fd.startswith('pipe:') for fd in fds), "'%s' inherited the coprocess's pipes" % cmd
+    sendline('kill %s' % jobid)
+    expect_prompt("Shell did not print expected prompt (8)")
+
+sendline('sh -c "echo cherry > /dev/fd/$EDIT_IN"')
+expect_prompt("Shell did not print expected prompt (9)")
+sendline('head -n 1 < /dev/fd/$EDIT_OUT')
+expect_exact('cherry', "a command given $EDIT_IN could not write to the coprocess")
+expect_prompt("Shell did not print expected prompt (10)")
+
+#################################################################
+# Step 4. Once the coprocess is gone, its variables are removed.
+#
+sendline('kill 1')
+expect_prompt("Shell did not print expected prompt (11)")
+# finished jobs are removed after the next command
+time.sleep(0.5)
+sendline('jobs')
+expect_prompt("Shell did not print expected prompt (12)")
+sendline('echo [$EDIT_IN]')
+expect_exact('[]', "coprocess variables were not removed")
+expect_prompt("Shell did not print expected prompt (13)")
+
+test_success()
@@ -0,0 +1,340 @@
+/*
+ * CPU placement for jobs and pipeline stages, used by the 'pin'
+ * builtin and the shell's default placement policy.
+ *
+ * The "spread" policy reads the CPU topology from
+ * /sys/devices/system/cpu and places adjacent pipeline stages on
+ * sibling hyperthreads, or at least on CPUs that share an L3 cache,
+ * so that data passed through a pipe stays cache-local.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "cpu_affinity.h"
+#include "utils.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+/* Topology, loaded on first use */
+static struct {
+    bool loaded;
+    int ncpus;                  /* number of online CPUs */
+    int order[CPU_SETSIZE];     /* online CPUs: grouped by L3 domain,
+                                   sibling threads adjacent */
+    int core[CPU_SETSIZE];      /* lowest-numbered sibling of each CPU */
+    int llc[CPU_SETSIZE];       /* lowest-numbered CPU sharing its L3 */
+} topology;
+
+/* Position in topology.order at which the next spread job starts,
+ * so that consecutive jobs do not pile up on the same cores. */
+static int spread_cursor;
+
+/* Parse a kernel-style CPU list such as "0-3,8,10-11" */
+static bool
+parse_cpulist(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    bool any = false;
+
+    while (*s != '\0' && !isspace((unsigned char) *s)) {
+        char *end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (end == s || first < 0)
+            return false;
+
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first)
+                return false;
+        }
+        if (last >= CPU_SETSIZE)
+            return false;
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+        any = true;
+
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s != '\0' && !isspace((unsigned char) *s))
+            return false;
+    }
+    return any;
+}
+
+static int
+first_cpu(const cpu_set_t *set, int fallback)
+{
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, set))
+            return cpu;
+    return fallback;
+}
+
+/* Read a short sysfs attribute into buf.  Returns false if it
+ * does not exist. */
+static bool
+read_sysfs(const char *path, char *buf, size_t len)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    bool ok = fgets(buf, len, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+/* Read a CPU list attribute of 'cpu' and return its lowest CPU */
+static int
+sysfs_first_cpu(int cpu, const char *attr, int fallback)
+{
+    char path[256], buf[4096];
+    cpu_set_t set;
+
+    snprintf(path, sizeof path, SYSFS_CPU "/cpu%d/%s", cpu, attr);
+    if (!read_sysfs(path, buf, sizeof buf) || !parse_cpulist(buf, &set))
+        return fallback;
+    return first_cpu(&set, fallback);
+}
+
+/* Find the lowest CPU that shares the last-level cache with 'cpu'.
+ * Falls back to the physical package if no L3 is reported. */
+static int
+find_llc(int cpu)
+{
+    char path[256], level[16];
+
+    for (int index = 0; index < 10; index++) {
+        snprintf(path, sizeof path, SYSFS_CPU "/cpu%d/cache/index%d/level",
+                 cpu, index);
+        if (!read_sysfs(path, level, sizeof level))
+            break;
+
+        if (atoi(level) == 3) {
+            char attr[64];
+            snprintf(attr, sizeof attr, "cache/index%d/shared_cpu_list", index);
+            return sysfs_first_cpu(cpu, attr, cpu);
+        }
+    }
+    return sysfs_first_cpu(cpu, "topology/core_siblings_list", 0);
+}
+
+static int
+compare_spread_order(const void *a, const void *b)
+{
+    int ca = *(const int *) a, cb = *(const int *) b;
+
+    if (topology.llc[ca] != topology.llc[cb])
+        return topology.llc[ca] - topology.llc[cb];
+    if (topology.core[ca] != topology.core[cb])
+        return topology.core[ca] - topology.core[cb];
+    return ca - cb;
+}
+
+static void
+load_topology(void)
+{
+    if (topology.loaded)
+        return;
+
+    char buf[4096];
+    cpu_set_t online;
+    if (!read_sysfs(SYSFS_CPU "/online", buf, sizeof buf)
+            || !parse_cpulist(buf, &online)) {
+        /* No sysfs; fall back to the CPUs the shell may run on. */
+        if (sched_getaffinity(0, sizeof online, &online) == -1)
+            utils_fatal_error("sched_getaffinity failed: ");
+    }
+
+    topology.ncpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &online))
+            continue;
+
+        topology.core[cpu] = sysfs_first_cpu(cpu, "topology/thread_siblings_list", cpu);
+        topology.llc[cpu] = find_llc(cpu);
+        topology.order[topology.ncpus++] = cpu;
+    }
+    qsort(topology.order, topology.ncpus, sizeof topology.order[0],
+          compare_spread_order);
+    topology.loaded = true;
+}
+
+bool
+affinity_parse_policy(const char *word, struct affinity_policy *policy)
+{
+    if (strcmp(word, "none") == 0) {
+        policy->mode = AFFINITY_NONE;
+        return true;
+    }
+    if (strcmp(word, "spread") == 0) {
+        policy->mode = AFFINITY_SPREAD;
+        return true;
+    }
+
+    char *copy = strdup(word), *save, *list;
+    policy->mode = AFFINITY_LISTS;
+    policy->nlists = 0;
+
+    bool ok = true;
+    for (list = strtok_r(copy, ":", &save); list != NULL && ok;
+         list = strtok_r(NULL, ":", &save)) {
+        if (policy->nlists == AFFINITY_MAX_LISTS)
+            ok = false;
+        else
+            ok = parse_cpulist(list, &policy->lists[policy->nlists++]);
+    }
+    free(copy);
+    return ok && policy->nlists > 0;
+}
+
+/* Number of positions in topology.order from 'pos' on that belong
+ * to the same L3 domain as the CPU at 'pos'. */
+static int
+llc_run_length(int pos)
+{
+    int llc = topology.llc[topology.order[pos]];
+    int n = 0;
+    while (pos + n < topology.ncpus && topology.llc[topology.order[pos + n]] == llc)
+        n++;
+    return n;
+}
+
+/* Pick the first position for a spread pipeline of 'nstages' commands */
+static int
+spread_start(int nstages)
+{
+    int n = topology.ncpus;
+    int start = spread_cursor % n;
+
+    /* Begin at the first thread of a core, so stages 0 and 1 share it. */
+    while (start > 0 && start < n
+            && topology.core[topology.order[start - 1]]
+               == topology.core[topology.order[start]])
+        start++;
+    if (start == n)
+        start = 0;
+
+    /* Keep the whole pipeline in one L3 domain if it fits into one. */
+    int domain = start;
+    while (domain > 0 && topology.llc[topology.order[domain - 1]]
+                         == topology.llc[topology.order[start]])
+        domain--;
+    if (llc_run_length(start) < nstages && llc_run_length(domain) >= nstages) {
+        start += llc_run_length(start);
+        if (start == n)
+            start = 0;
+    }
+    return start;
+}
+
+void
+affinity_place(const struct affinity_policy *policy,
+               int nstages, cpu_set_t *stages)
+{
+    switch (policy->mode) {
+    case AFFINITY_LISTS:
+        for (int i = 0; i < nstages; i++)
+            stages[i] = policy->lists[i % policy->nlists];
+        break;
+
+    case AFFINITY_SPREAD: {
+        load_topology();
+        int start = spread_start(nstages);
+        for (int i = 0; i < nstages; i++) {
+            CPU_ZERO(&stages[i]);
+            CPU_SET(topology.order[(start + i) % topology.ncpus], &stages[i]);
+        }
+        spread_cursor = start + nstages;
+        break;
+    }
+
+    case AFFINITY_NONE:
+        assert(0 && "affinity_place called without a placement policy");
+        break;
+    }
+}
+
+bool
+affinity_apply(const cpu_set_t *cpus)
+{
+    if (sched_setaffinity(0, sizeof *cpus, cpus) == -1) {
+        utils_error("sched_setaffinity failed: ");
+        return false;
+    }
+    return true;
+}
+
+void
+affinity_format_cpulist(const cpu_set_t *cpus, char *buf, size_t len)
+{
+    size_t used = 0;
+    buf[0] = '\0';
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && used < len; cpu++) {
+        if (!CPU_ISSET(cpu, cpus))
+            continue;
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+
+        const char *sep = used > 0 ? "," : "";
+        if (last == cpu)
+            used += snprintf(buf + used, len - used, "%s%d", sep, cpu);
+        else
+            used += snprintf(buf + used, len - used, "%s%d-%d", sep, cpu, last);
+        cpu = last;
+    }
+}
+
+void
+affinity_format_policy(const struct affinity_policy *policy,
+                       char *buf, size_t len)
+{
+    switch (policy->mode) {
+    case AFFINITY_NONE:
+        snprintf(buf, len, "none");
+        break;
+    case AFFINITY_SPREAD:
+        snprintf(buf, len, "spread");
+        break;
+    case AFFINITY_LISTS: {
+        size_t used = 0;
+        for (int i = 0; i < policy->nlists && used + 1 < len; i++) {
+            if (i > 0)
+                buf[used++] = ':';
+            affinity_format_cpulist(&policy->lists[i], buf + used, len - used);
+            used += strlen(buf + used);
+        }
+        break;
+    }
+    }
+}
+
+void
+affinity_print_topology(FILE *out)
+{
+    load_topology();
+    fprintf(out, "%d online CPUs, spread order by L3 domain (siblings joined by ','):\n",
+           topology.ncpus);
+
+    for (int pos = 0; pos < topology.ncpus; pos++) {
+        int cpu = topology.order[pos];
+        bool new_llc = pos == 0 || topology.llc[topology.order[pos - 1]] != topology.llc[cpu];
+        bool new_core = pos == 0 || topology.core[topology.order[pos - 1]] != topology.core[cpu];
+
+        if (new_llc)
+            fprintf(out, "%s  L3 %d:", pos == 0 ? "" : "\n", topology.llc[cpu]);
+        fprintf(out, new_core ? " %d" : ",%d", cpu);
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,52 @@
+#ifndef __CPU_AFFINITY_H
+#define __CPU_AFFINITY_H
+
+#include <sched.h>         /* cpu_set_t requires _GNU_SOURCE */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Maximum number of per-stage CPU lists in one placement policy */
+#define AFFINITY_MAX_LISTS 16
+
+enum affinity_mode {
+    AFFINITY_NONE,      /* leave placement to the kernel */
+    AFFINITY_LISTS,     /* explicit CPU lists, one per pipeline stage;
+                           the lists are reused cyclically */
+    AFFINITY_SPREAD,    /* adjacent stages on sibling hyperthreads,
+                           or at least on CPUs sharing an L3 cache */
+};
+
+/* A placement policy, either the shell's default set with 'pin -p'
+ * or one given to a single job with the 'pin' prefix. */
+struct affinity_policy {
+    enum affinity_mode mode;
+    int nlists;                             /* for AFFINITY_LISTS */
+    cpu_set_t lists[AFFINITY_MAX_LISTS];
+};
+
+/* Parse a policy: "none", "spread", or colon-separated CPU lists
+ * such as "0-3" or "0,1:2,3".  Returns false if 'word' is malformed. */
+bool affinity_parse_policy(const char *word, struct affinity_policy *policy);
+
+/* Compute the CPUs for each of the 'nstages' commands of a pipeline
+ * according to 'policy' and store them in stages[0..nstages-1].
+ * Must not be called with an AFFINITY_NONE policy. */
+void affinity_place(const struct affinity_policy *policy,
+                    int nstages, cpu_set_t *stages);
+
+/* Restrict the calling process to 'cpus'.
+ * Meant to be called in the child between fork() and exec. */
+bool affinity_apply(const cpu_set_t *cpus);
+
+/* Format 'cpus' as a CPU list such as "0-3,8" into buf */
+void affinity_format_cpulist(const cpu_set_t *cpus, char *buf, size_t len);
+
+/* Format 'policy' in the syntax accepted by affinity_parse_policy */
+void affinity_format_policy(const struct affinity_policy *policy,
+                            char *buf, size_t len);
+
+/* Print the CPU topology used for the "spread" policy to 'out' */
+void affinity_print_topology(FILE *out);
+
+#endif /* __CPU_AFFINITY_H */
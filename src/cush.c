@@ -6,6 +6,7 @@
  */
 #define _GNU_SOURCE    1
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <readline/readline.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -15,6 +16,13 @@
 #include <fcntl.h>
 #include <assert.h>
 #include <time.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <getopt.h>
 
 /* Since the handed out code contains a number of unused functions. */
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -23,21 +31,59 @@
 #include "signal_support.h"
 #include "shell-ast.h"
 #include "utils.h"
+#include "resource_limits.h"
+#include "cpu_affinity.h"
+#include "job_sched.h"
+#include "event_loop.h"
+#include "pressure.h"
+#include "history_log.h"
+#include "completion.h"
+#include "glob_expansion.h"
+#include "variables.h"
+#include "pipe_writer.h"
+#include "trace.h"
+#include "probes.h"
+#include "job_log.h"
+#include "definitions.h"
+#include "bytecode.h"
+#include "script_cache.h"
+#include "startup_profile.h"
 
-static void handle_child_status(pid_t pid, int status);
+static void handle_child_status(pid_t pid, int status, const struct rusage* usage);
+static void sigchld_handler(int sig, siginfo_t *info, void *_ctxt);
+struct job;
+static void throttle_stop(struct job* j);
+static void launch_job(struct job* j, bool announce);
+static void coproc_close(struct job* j);
+static void coproc_share(struct job* j);
+static void coproc_inherit(struct job* cur_job, struct ast_command* cmd);
+struct builtin;
+static const struct builtin* find_builtin(const char* name);
+static void run_builtin_stage(const struct builtin* b, char** argv, int fd, bool last);
+static bool changes_shell(struct ast_command_line* cline);
+static void run_group(struct ast_command* cmd, struct ast_pipeline* pipe);
+static void run_subshell(struct ast_command* cmd);
+static void run_compound(struct ast_compound* compound);
+static bool run_script(const char* path, char** argv);
+static bool is_simple(struct ast_command* cmd);
 
-static char* custom_prompt = "\\! \\u@\\h in \\W> ";
+static char default_prompt[] = "\\! \\u@\\h in \\W> ";
+static char* custom_prompt = default_prompt; //malloc'd once set by the prompt builtin
+static int command_number = 0; //number of the command being read, shown by '\!' in the prompt
 
 static void
 usage(char *progname){
-    printf("Usage: %s -h\n"
-        " -h            print this help\n",
+    printf("Usage: %s [-h] [--startup-profile] [script [args]]\n"
+        " -h            print this help\n"
+        " --startup-profile\n"
+        "               print how long each phase of startup takes\n"
+        " script        run the commands in script, then exit\n",
         progname);
 
     exit(EXIT_SUCCESS);
 }
 
-/*prints a custom prompt that the suer specifies*/
+/*returns the custom prompt that the user specifies, for readline to print and redraw*/
 static char*
 build_prompt(int* com_num){
 	
@@ -48,6 +94,12 @@ build_prompt(int* com_num){
 	time_t t = time(NULL); //time object for the date and time functionality
 	bool special = false; //bool to determine if a backslash is used in the prompt
 	int count = 0; //keeps track of the character position in the custom prompt
+	char* prompt = NULL;
+	size_t size = 0;
+	FILE* out = open_memstream(&prompt, &size);
+	if(out == NULL){
+		utils_fatal_error("out of memory building the prompt: ");
+	}
 	
 	//loop through custom_prmpt
 	while(count < prompt_size){
@@ -56,40 +108,40 @@ build_prompt(int* com_num){
 		if(special){
 			switch(cur_char){ //switch case for characters following a backslash
 				case 'u': //prints the user
-					printf("%s", getenv("USER"));
+					fprintf(out, "%s", getenv("USER") != NULL ? getenv("USER") : ""); //fprintf of a NULL string would be fputs(NULL)
 					break;
 				case 'h': ; //prints the hostname
 					char host_field[33];
 					gethostname(host_field, 32);
 					host_field[32] = '\0';
-					printf("%s", host_field);
+					fprintf(out, "%s", host_field);
 					break;
 				case 'w': //prints the entire working directory path
-					printf("%s", getenv("PWD"));
+					fprintf(out, "%s", getenv("PWD") != NULL ? getenv("PWD") : "");
 					break;
 				case 'W': //pints only the current directory name (not the full path)
-					printf("%s", basename(getenv("PWD")));
+					fprintf(out, "%s", getenv("PWD") != NULL ? basename(getenv("PWD")) : ""); //GNU basename does not take NULL
 					break;
 				case 'd': ;//displays the date
 					struct tm tm = *localtime(&t);
-					printf("%02d-%02d-%d", tm.tm_mon + 1, tm.tm_mday, tm.tm_year + 1900);
+					fprintf(out, "%02d-%02d-%d", tm.tm_mon + 1, tm.tm_mday, tm.tm_year + 1900);
 					break;
 				case 'T': ;//displays the time
 					struct tm tm2 = *localtime(&t);
-					printf("%02d:%02d", tm2.tm_hour, tm2.tm_min);
+					fprintf(out, "%02d:%02d", tm2.tm_hour, tm2.tm_min);
 					break;
 				case 'n': //new line character
-					printf("\n");
+					fprintf(out, "\n");
 					break;
 				case 'c': //prints the name of the program 'cush'
-					printf("cush");
+					fprintf(out, "cush");
 					break;
 				case '!': //incase a user wants to actually use an '!' they can just add a slash to it
-					printf("%d", *com_num);
+					fprintf(out, "%d", *com_num);
 					break;
 				default: //if the character following the slash isn't a special character
-					printf("\\");
-					printf("%c", cur_char);
+					fprintf(out, "\\");
+					fprintf(out, "%c", cur_char);
 					break;
 			}
 			special = false; //reset the special character boolean
@@ -98,12 +150,13 @@ build_prompt(int* com_num){
 			special = true;
 		}
 		else{ //otherwise print the current character
-			printf("%c", cur_char);
+			fprintf(out, "%c", cur_char);
 		}
 		count++; //increase character position
 		cur_char = *(custom_prompt + count); //get next character
 	}
-	return strdup(""); //return
+	fclose(out);
+	return prompt;
 }
 
 enum job_status {
@@ -113,6 +166,7 @@ enum job_status {
     STOPPED,        /* job is stopped via SIGSTOP */
     NEEDSTERMINAL,  /* job is stopped because it was a background job
                        and requires exclusive terminal access */
+    QUEUED,         /* background job waiting for 'admit' to start it */
 };
 
 struct job {
@@ -126,8 +180,50 @@ struct job {
 	
     /* Add additional fields here if needed. */
 	int pid;
+	struct resource_limits limits; //rlimits set with the 'limit' prefix, applied in each child
+	int num_stages; //number of commands in the pipeline
+	pid_t* stage_pids; //pid of each command, 0 until it has been forked
+	cpu_set_t* placement; //cpus of each command, NULL if the job is not pinned
+	struct job_sched sched; //scheduling policy and nice value set with the 'sched' and 'nice' prefixes
+	bool deprioritized; //true while fgboost has lowered the priority of this background job
+	int saved_nice; //nice value of the job's process group before fgboost lowered it
+	int throttle_fd; //timerfd driving the 'throttle' duty cycle, -1 if the job is not throttled
+	int throttle_percent; //share of each period the job may run
+	long long throttle_period_ns; //length of one stop/continue cycle
+	int held; //HELD_BY_* bits of the shell features that currently keep the job stopped, 0 if none
+	char* coproc_name; //NAME given to 'coproc NAME cmd', NULL if the job is not a coprocess
+	int coproc_fds[2]; //shell's ends of a coprocess's pipes: [0] reads its output, [1] writes its input
+	int coproc_child_fds[2]; //coprocess's ends: [0] becomes its stdin, [1] its stdout
+	int exit_status; //waitpid status of the last command, shown in the Done or Exit notice
+	int* stage_status; //waitpid status of each command as it was reaped or stopped, 0 for builtins
+	bool notify; //print a notice when it finishes, true unless it finished in the foreground
+	int log_fd; //pipe into the job's joblog capture until it is launched, -1 if its output is not captured
+};
+
+#define COPROC_VAR_SIZE 264 //room for a coprocess's name and the suffix of its variables
+#define THROTTLE_PERIOD_MS 100 //default length of one throttle cycle
+#define ADMISSION_INTERVAL_MS 1000 //how often 'admit' samples the pressure
+
+//reasons for the shell, rather than the user, to keep a background job stopped
+#define HELD_BY_THROTTLE 1 //in the stopped part of a 'throttle' cycle
+#define HELD_BY_PRESSURE 2 //stopped by 'admit ... stop' until the pressure drops
+
+/* Settings recorded by builtin prefixes such as 'limit' and 'pin'
+ * for the job started by the rest of the command line. */
+struct job_settings {
+	struct resource_limits limits;
+	struct affinity_policy affinity;
+	struct job_sched sched;
+	char* coproc_name; //set by 'coproc NAME', which connects the job's input and output to the shell
 };
 
+static struct affinity_policy shell_affinity = { .mode = AFFINITY_NONE }; //default placement policy, set with 'pin -p'
+static int fgboost_penalty = 0; //nice increment for background jobs while another job owns the terminal, 0 if fgboost is off
+static struct pressure_policy admission = { .enabled = false }; //pressure thresholds set with 'admit'
+static int admission_fd = -1; //timerfd sampling the pressure while admission control is on, -1 if it is off
+static size_t joblog_size = 0; //bytes of output kept for each new background job, 0 while 'joblog' is off
+
+
 /* Utility functions for job list management.
  * We use 2 data structures: 
  * (a) an array jid2job to quickly find a job based on its id
@@ -142,10 +238,40 @@ static struct job* jid2job[MAXJOBS];
 static int stopped_jobs[MAXJOBS]; //stores the stopped jobs in an array, with the highest non-zero index being the moost recently stopped job
 static int num_stop_job = 0; //stores the number of stopped jobs, used for indexing the array for only valid indexes
 
+static int current_jid = 0; //job most recently started in the background or stopped, marked with '+' in notices
+
+//variables for jobs whose processes have all been reaped
+static struct job* finished_jobs[MAXJOBS]; //background jobs, filled by handle_child_status in the order they finish, emptied by clear_finished_jobs
+static int num_finished_jobs = 0;
+static FILE* pending_notices = NULL; //notices of deleted jobs, printed at the next prompt; NULL if there are none
+static char* pending_notices_text = NULL; //what has been written to pending_notices
+static size_t pending_notices_size = 0;
+static int finished_fd = -1; //eventfd signaled when a background job finishes, polled while at the prompt; -1 if not interactive
+
+static int last_status = 0; //exit status of the last pipeline that ran, $?, which decides whether && and || run the next one
+static bool status_set = false; //true while $? and PIPESTATUS are both last_status, as set_status left them
+
+static bool interactive = false; //reading commands typed at a terminal; a script or commands from a file or pipe need no terminal, readline, history or completion
+
+//variables for ( ) and { } groups
+static bool job_control = true; //false in the process forked to run a group and in a shell that is not interactive, whose commands stay in its process group
+static bool exec_last_command = false; //true while a subshell runs its last pipeline, whose lone external command then replaces the subshell
+
+//variables for aliases and functions
+#define ALIAS_MAX_DEPTH 16 //aliases expanded for one command, whose definitions may start with another alias
+#define FUNCTION_MAX_DEPTH 256 //nested calls of functions, which run in the shell and use its stack
+static int function_depth = 0; //calls of functions and sourced scripts running in the shell
+
+//variables for compiled compound commands
+static bool bytecode_on = true; //false with 'bytecode off', which walks the syntax tree of compound commands instead of compiling them, for comparison
+static unsigned long path_changes = 0; //times PATH was set, which makes the programs found for command names stale
+static bool commands_indexed = false; //true once tab completion has indexed the programs in PATH, which it does on the first Tab
+
 /*adds a job to the stopped_jobs array*/
 static void add_stopped_job(int jid){
 	stopped_jobs[num_stop_job] = jid; //places jid in highest array index
 	num_stop_job++; //increments counter
+	current_jid = jid;
 }
 
 /*removes a job from the stopped_jobs array*/
@@ -191,7 +317,20 @@ add_job(struct ast_pipeline *pipe)
     job->pipe = pipe;
     job->num_processes_alive = 0;
 	job->pid = 0;
+	job->limits.count = 0;
+	job->num_stages = list_size(&pipe->commands);
+	job->stage_pids = calloc(job->num_stages, sizeof *job->stage_pids);
+	job->stage_status = calloc(job->num_stages, sizeof *job->stage_status);
+	job->placement = NULL;
+	job->deprioritized = false;
+	job->throttle_fd = -1;
+	job->held = 0;
+	job->coproc_name = NULL;
+	job->exit_status = 0;
+	job->notify = false;
+	job->log_fd = -1;
 	
+	job->status = FOREGROUND;
 	if(pipe->bg_job){
 		job->status = BACKGROUND;
 	}
@@ -201,6 +340,7 @@ add_job(struct ast_pipeline *pipe)
         if (jid2job[i] == NULL) {
             jid2job[i] = job;
             job->jid = i;
+            CUSH_PROBE2(job_add, job->jid, job->num_stages);
             return job;
         }
     }
@@ -220,7 +360,15 @@ delete_job(struct job *job)
     assert(jid != -1);
     jid2job[jid]->jid = -1;
     jid2job[jid] = NULL;
+	throttle_stop(job);
+	coproc_close(job);
+	if(job->log_fd != -1){ //queued, never launched
+		close(job->log_fd);
+	}
     ast_pipeline_free(job->pipe);
+	free(job->stage_pids);
+	free(job->stage_status);
+	free(job->placement);
     free(job);
 }
 
@@ -236,34 +384,626 @@ get_status(enum job_status status)
         return "Stopped";
     case NEEDSTERMINAL:
         return "Stopped (tty)";
+    case QUEUED:
+        return "Queued";
     default:
         return "Unknown";
     }
 }
 
+static void print_group(struct ast_command *cmd, FILE *out);
+static void print_compound(struct ast_compound *compound, FILE *out);
+
 /* Print the command line that belongs to one job. */
 static void
-print_cmdline(struct ast_pipeline *pipeline)
+print_cmdline(struct ast_pipeline *pipeline, FILE *out)
 {
     struct list_elem * e = list_begin (&pipeline->commands); 
     for (; e != list_end (&pipeline->commands); e = list_next(e)) {
         struct ast_command *cmd = list_entry(e, struct ast_command, elem);
         if (e != list_begin(&pipeline->commands))
-            printf("| ");
+            fprintf(out, "| ");
+        if (cmd->group && *cmd->argv == NULL) {    /* not a function call */
+            print_group(cmd, out);
+            continue;
+        }
+        if (cmd->compound) {
+            print_compound(cmd->compound, out);
+            continue;
+        }
         char **p = cmd->argv;
-        printf("%s", *p++);
+        fprintf(out, "%s", *p++);
         while (*p)
-            printf(" %s", *p++);
+            fprintf(out, " %s", *p++);
+    }
+}
+
+/* Print the pipelines of a list, each after a space, e.g. ' sleep 1;
+ * echo done', with a ';' after the last one if 'terminated' */
+static void
+print_list(struct ast_command_line *cline, bool terminated, FILE *out)
+{
+    static const char *connectors[] = {
+        [AST_SEQUENCE] = ";", [AST_AND] = " &&", [AST_OR] = " ||"
+    };
+    struct list *pipes = &cline->pipes;
+    bool separated = true;   /* by an &, or at the start */
+    for (struct list_elem * e = list_begin(pipes); e != list_end(pipes); e = list_next(e)) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        if (!separated)
+            fprintf(out, "%s", connectors[pipe->connector]);
+        fprintf(out, " ");
+        print_cmdline(pipe, out);
+        separated = pipe->bg_job;
+        if (separated)
+            fprintf(out, " &");
+    }
+    if (!separated && terminated)
+        fprintf(out, ";");
+}
+
+/* Print a ( ) or { } group, e.g. '( sleep 1; echo done )' */
+static void
+print_group(struct ast_command *cmd, FILE *out)
+{
+    fprintf(out, cmd->subshell ? "(" : "{");
+    print_list(cmd->group, !cmd->subshell, out);
+    fprintf(out, cmd->subshell ? " )" : " }");
+}
+
+/* Print the words of a for loop or of the patterns of a case item */
+static void
+print_words(char **words, const char *separator, FILE *out)
+{
+    for (char **p = words; *p; p++)
+        fprintf(out, "%s%s", p == words ? "" : separator, *p);
+}
+
+/* Print a compound command, e.g. 'while true; do sleep 1; done' */
+static void
+print_compound(struct ast_compound *compound, FILE *out)
+{
+    switch (compound->kind) {
+    case AST_IF:
+        fprintf(out, "if");
+        print_list(compound->condition, true, out);
+        fprintf(out, " then");
+        print_list(compound->body, true, out);
+        if (compound->else_part) {
+            fprintf(out, " else");
+            print_list(compound->else_part, true, out);
+        }
+        fprintf(out, " fi");
+        break;
+    case AST_WHILE:
+    case AST_UNTIL:
+        fprintf(out, compound->kind == AST_WHILE ? "while" : "until");
+        print_list(compound->condition, true, out);
+        fprintf(out, " do");
+        print_list(compound->body, true, out);
+        fprintf(out, " done");
+        break;
+    case AST_FOR:
+        fprintf(out, "for %s in ", compound->variable);
+        print_words(compound->words, " ", out);
+        fprintf(out, "; do");
+        print_list(compound->body, true, out);
+        fprintf(out, " done");
+        break;
+    case AST_CASE:
+        fprintf(out, "case %s in", compound->subject);
+        for (struct list_elem * e = list_begin(&compound->items);
+             e != list_end(&compound->items);
+             e = list_next(e)) {
+            struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+            fprintf(out, " ");
+            print_words(item->patterns, "|", out);
+            fprintf(out, ")");
+            print_list(item->body, false, out);
+            fprintf(out, " ;;");
+        }
+        fprintf(out, " esac");
+        break;
     }
 }
 
+/* Name of a command in traces and 'jobs -l'; a group or compound
+ * command, which has no words of its own, is named after its opening
+ * bracket or keyword. */
+static const char *
+command_name(struct ast_command *cmd)
+{
+    static const char *keywords[] = {
+        [AST_IF] = "if", [AST_WHILE] = "while", [AST_UNTIL] = "until",
+        [AST_FOR] = "for", [AST_CASE] = "case"
+    };
+    if (cmd->group)
+        return cmd->subshell ? "(" : "{";
+    if (cmd->compound)
+        return keywords[cmd->compound->kind];
+    return *cmd->argv;
+}
+
 /* Print a job */
 static void
-print_job(struct job *job)
+print_job(struct job *job, FILE *out)
+{
+    fprintf(out, "[%d]\t%s\t\t(", job->jid, get_status(job->status));
+    print_cmdline(job->pipe, out);
+    fprintf(out, ")\n");
+}
+
+/*prints the pid and cpu placement of each command in a job, used by 'jobs -l'*/
+static void
+print_job_stages(struct job *job, FILE *out)
+{
+	int stage = 0;
+	for (struct list_elem * e = list_begin(&job->pipe->commands); 
+	e != list_end(&job->pipe->commands); 
+	e = list_next(e)) {
+		struct ast_command* cmd = list_entry(e, struct ast_command, elem);
+		char cpus[256] = "any";
+		if(job->placement != NULL){ //job was pinned when it was started
+			affinity_format_cpulist(&job->placement[stage], cpus, sizeof cpus);
+		}
+		fprintf(out, "\t%d\t%s\tcpus %s\n", job->stage_pids[stage], command_name(cmd), cpus);
+		stage++;
+	}
+	if(job->throttle_fd != -1){
+		fprintf(out, "\tthrottled to %d%% of a CPU\n", job->throttle_percent);
+	}
+	if(job->held & HELD_BY_PRESSURE){
+		fprintf(out, "\tstopped until the system pressure drops\n");
+	}
+	if(job->coproc_name != NULL){
+		fprintf(out, "\tcoprocess %s, input fd %d, output fd %d\n", job->coproc_name, job->coproc_fds[1], job->coproc_fds[0]);
+	}
+}
+
+/*prints the bash-style notice of a finished job, e.g. '[1]+  Done    sleep 1' or 'Exit 2'*/
+static void
+print_finished_job(struct job *job, FILE *out)
+{
+	char state[64];
+	if(WIFSIGNALED(job->exit_status)){ //named after the signal, e.g. 'Terminated' or 'Killed'
+		snprintf(state, sizeof state, "%s%s", strsignal(WTERMSIG(job->exit_status)),
+			WCOREDUMP(job->exit_status) ? " (core dumped)" : "");
+	}
+	else if(WEXITSTATUS(job->exit_status) != 0){
+		snprintf(state, sizeof state, "Exit %d", WEXITSTATUS(job->exit_status));
+	}
+	else{
+		snprintf(state, sizeof state, "Done");
+	}
+	fprintf(out, "[%d]%c  %-24s", job->jid, job->jid == current_jid ? '+' : ' ', state);
+	print_cmdline(job->pipe, out);
+	fprintf(out, "\n");
+}
+
+/*takes a job whose processes have all been reaped out of the job list, so that its pids, which may be reused, no longer match it; a background job is queued for its notice, a foreground job is deleted by whoever waited for it*/
+static void
+job_finished(struct job *job, bool notify)
+{
+	list_remove(&job->elem);
+	job->notify = notify;
+	if(!notify){
+		return;
+	}
+	finished_jobs[num_finished_jobs++] = job;
+	if(finished_fd != -1){ //wake the prompt, see report_at_prompt
+		uint64_t one = 1;
+		write(finished_fd, &one, sizeof one);
+	}
+}
+
+/*deletes a finished job and the references to it*/
+static void
+forget_job(struct job *job)
+{
+	start_stopped_job(job->jid); //it may have been killed while stopped
+	if(current_jid == job->jid){
+		current_jid = 0;
+	}
+	delete_job(job);
+}
+
+/*deletes the queued finished jobs, keeping only their notices, so that scripts and loops that start many jobs need no prompt to free them; SIGCHLD must be blocked*/
+static void
+clear_finished_jobs(void)
+{
+	if(!list_empty(&job_list)){ //reap what the background jobs left while SIGCHLD was blocked for the command line or loop
+		sigchld_handler(SIGCHLD, NULL, NULL);
+	}
+	for(int i = 0; i < num_finished_jobs; i++){
+		struct job* j = finished_jobs[i];
+		if(interactive){ //like bash, scripts get no notices
+			if(pending_notices == NULL){
+				pending_notices = open_memstream(&pending_notices_text, &pending_notices_size);
+			}
+			print_finished_job(j, pending_notices != NULL ? pending_notices : stdout);
+		}
+		forget_job(j);
+	}
+	num_finished_jobs = 0;
+}
+
+/*prints the notices of finished background jobs, in the order they finished, and deletes the jobs*/
+static void
+report_finished_jobs(void)
+{
+	signal_block(SIGCHLD);
+	clear_finished_jobs();
+	if(pending_notices != NULL){
+		fclose(pending_notices);
+		fputs(pending_notices_text, stdout);
+		free(pending_notices_text);
+		pending_notices = NULL;
+	}
+	fflush(stdout);
+	signal_unblock(SIGCHLD);
+}
+
+/*event loop callback while readline waits for input: prints the notices on a line of their own and redraws the prompt and what has been typed so far*/
+static void
+report_at_prompt(int fd, void *ctx)
+{
+	uint64_t count;
+	if(read(fd, &count, sizeof count) != sizeof count || num_finished_jobs == 0){
+		return;
+	}
+	printf("\n");
+	report_finished_jobs();
+	rl_on_new_line(); //readline still has the prompt it was given, with the same number
+	rl_redisplay();
+}
+
+/*converts a waitpid status into an exit status: the exit code, or 128 plus the signal that killed or stopped the process*/
+static int
+shell_status(int wait_status)
+{
+	if(WIFSIGNALED(wait_status)){
+		return 128 + WTERMSIG(wait_status);
+	}
+	if(WIFSTOPPED(wait_status)){
+		return 128 + WSTOPSIG(wait_status);
+	}
+	return WEXITSTATUS(wait_status);
+}
+
+/*sets $? and PIPESTATUS for a pipeline that started no foreground processes*/
+static void
+set_status(int status)
+{
+	if(status_set && status == last_status){ //as in a loop of builtins, nothing to do
+		return;
+	}
+	char value[16];
+	snprintf(value, sizeof value, "%d", status);
+	variables_set("?", value, false);
+	variables_set("PIPESTATUS", value, false);
+	last_status = status;
+	status_set = true;
+}
+
+/*sets $? and PIPESTATUS from the statuses that the reaping path recorded for the commands of a job, once it left the foreground*/
+static void
+set_job_status(struct job* j)
+{
+	char pipestatus[16 * j->num_stages];
+	int used = 0;
+	int status = shell_status(j->stage_status[j->num_stages - 1]);
+	for(int i = 0; i < j->num_stages; i++){
+		used += snprintf(pipestatus + used, sizeof pipestatus - used, i == 0 ? "%d" : " %d", shell_status(j->stage_status[i]));
+		if(j->status == STOPPED && WIFSTOPPED(j->stage_status[i])){ //like bash, a stopped job's status is that of the stop
+			status = shell_status(j->stage_status[i]);
+		}
+	}
+	set_status(status);
+	variables_set("PIPESTATUS", pipestatus, false);
+	status_set = j->num_stages == 1;
+}
+
+/*returns the stage of job j that pid was forked for, or -1 if pid is not one of its processes*/
+static int
+job_stage(struct job* j, pid_t pid)
+{
+	for(int i = 0; i < j->num_stages; i++){
+		if(j->stage_pids[i] == pid){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*lowers the priority of all background jobs while a job owns the terminal, if fgboost is on*/
+static void
+deprioritize_background_jobs(void)
+{
+	if(fgboost_penalty == 0){
+		return;
+	}
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j->status != BACKGROUND || j->deprioritized){
+			continue;
+		}
+		errno = 0; //getpriority may legitimately return -1
+		int nice = getpriority(PRIO_PGRP, j->pid);
+		if(nice == -1 && errno != 0){ //process group has already exited
+			continue;
+		}
+		int lowered = nice + fgboost_penalty > 19 ? 19 : nice + fgboost_penalty;
+		if(setpriority(PRIO_PGRP, j->pid, lowered) == 0){
+			j->saved_nice = nice;
+			j->deprioritized = true;
+		}
+	}
+}
+
+/*restores the priorities lowered by deprioritize_background_jobs, called when the foreground job finishes or stops*/
+static void
+restore_background_jobs(void)
 {
-    printf("[%d]\t%s\t\t(", job->jid, get_status(job->status));
-    print_cmdline(job->pipe);
-    printf(")\n");
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(!j->deprioritized){
+			continue;
+		}
+		if(setpriority(PRIO_PGRP, j->pid, j->saved_nice) == -1){
+			if(errno == EACCES || errno == EPERM){ //raising a priority needs CAP_SYS_NICE or RLIMIT_NICE, as 'fgboost on' warned
+				continue; //stays lowered and marked, so the next handover does not lower it again
+			}
+			if(errno != ESRCH){ //ESRCH: job exited meanwhile
+				utils_error("fgboost: could not restore the priority of job %d: ", j->jid);
+			}
+		}
+		j->deprioritized = false;
+	}
+}
+
+/*gives the terminal to a job that is about to run in the foreground*/
+static void
+give_terminal_to_job(struct job* j)
+{
+	deprioritize_background_jobs();
+	termstate_give_terminal_to(&j->saved_tty_state, j->pid);
+}
+
+/*stops a background job on behalf of the shell, reason is one of the HELD_BY_* bits*/
+static void
+job_hold(struct job* j, int reason)
+{
+	if(j->held == 0){
+		killpg(j->pid, SIGSTOP);
+	}
+	j->held |= reason;
+}
+
+/*withdraws one reason for holding a job, continuing the job once no reason is left*/
+static void
+job_release(struct job* j, int reason)
+{
+	if((j->held & reason) == 0){
+		return;
+	}
+	j->held &= ~reason;
+	if(j->held == 0){
+		killpg(j->pid, SIGCONT);
+	}
+}
+
+/*arms a job's throttle timer to fire once after ns nanoseconds*/
+static void
+arm_throttle_timer(struct job* j, long long ns)
+{
+	struct itimerspec when = { .it_value = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 } };
+	if(timerfd_settime(j->throttle_fd, 0, &when, NULL) == -1){
+		utils_fatal_error("timerfd_settime failed: ");
+	}
+}
+
+/*event loop callback, alternates SIGSTOP and SIGCONT to a throttled job*/
+static void
+throttle_tick(int fd, void* ctx)
+{
+	struct job* j = ctx;
+	uint64_t expirations;
+	if(read(fd, &expirations, sizeof expirations) != sizeof expirations){ //spurious wakeup
+		return;
+	}
+	
+	long long running = j->throttle_period_ns * j->throttle_percent / 100; //length of the running part of a cycle
+	if(j->status != BACKGROUND){ //the user stopped the job or brought it to the foreground, leave it alone
+		j->held &= ~HELD_BY_THROTTLE;
+		arm_throttle_timer(j, j->throttle_period_ns);
+	}
+	else if(j->held & HELD_BY_THROTTLE){ //stopped part is over, let the job run
+		job_release(j, HELD_BY_THROTTLE);
+		arm_throttle_timer(j, running);
+	}
+	else{ //running part is over, stop the job for the rest of the cycle
+		job_hold(j, HELD_BY_THROTTLE);
+		arm_throttle_timer(j, j->throttle_period_ns - running);
+	}
+}
+
+/*starts or adjusts the throttle of a job*/
+static void
+throttle_start(struct job* j, int percent, int period_ms)
+{
+	if(j->throttle_fd == -1){
+		j->throttle_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(j->throttle_fd == -1){
+			utils_error("timerfd_create failed: ");
+			return;
+		}
+		event_loop_add_fd(j->throttle_fd, throttle_tick, j);
+	}
+	j->throttle_percent = percent;
+	j->throttle_period_ns = period_ms * 1000000LL;
+	if((j->held & HELD_BY_THROTTLE) == 0){ //start a new running part, otherwise the next tick continues the job
+		arm_throttle_timer(j, j->throttle_period_ns * percent / 100);
+	}
+}
+
+/*removes the throttle of a job, continuing it if the throttle had stopped it*/
+static void
+throttle_stop(struct job* j)
+{
+	if(j->throttle_fd == -1){
+		return;
+	}
+	event_loop_remove_fd(j->throttle_fd);
+	close(j->throttle_fd);
+	j->throttle_fd = -1;
+	job_release(j, HELD_BY_THROTTLE);
+}
+
+/*returns the nice value the user gave a running job, ignoring fgboost*/
+static int
+job_nice(struct job* j)
+{
+	if(j->deprioritized){
+		return j->saved_nice;
+	}
+	errno = 0; //getpriority may legitimately return -1
+	int nice = getpriority(PRIO_PGRP, j->pid);
+	return nice == -1 && errno != 0 ? -20 : nice; //a job that already exited is the last one to stop
+}
+
+/*stops the running background job with the lowest priority (highest nice value, newest on ties)*/
+static void
+stop_lowest_priority_job(void)
+{
+	struct job* victim = NULL;
+	int victim_nice = 0;
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j->status != BACKGROUND || (j->held & HELD_BY_PRESSURE) || j->num_processes_alive == 0){
+			continue;
+		}
+		int nice = job_nice(j);
+		if(victim == NULL || nice > victim_nice || (nice == victim_nice && j->jid > victim->jid)){
+			victim = j;
+			victim_nice = nice;
+		}
+	}
+	if(victim != NULL){
+		job_hold(victim, HELD_BY_PRESSURE);
+	}
+}
+
+/*returns the oldest job that is waiting to be admitted, NULL if there is none*/
+static struct job*
+first_queued_job(void)
+{
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j->status == QUEUED){
+			return j;
+		}
+	}
+	return NULL;
+}
+
+/*resumes one job stopped under pressure or, if there is none, starts the oldest queued job; returns false if there was nothing to do*/
+static bool
+admit_one_job(void)
+{
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j->held & HELD_BY_PRESSURE){
+			job_release(j, HELD_BY_PRESSURE);
+			return true;
+		}
+	}
+	struct job* j = first_queued_job();
+	if(j == NULL){
+		return false;
+	}
+	j->status = BACKGROUND;
+	launch_job(j, false); //the user may be typing, so start it silently; 'jobs' shows it
+	return true;
+}
+
+/*event loop callback, samples the pressure and stops or admits at most one job per interval*/
+static void
+admission_tick(int fd, void* ctx)
+{
+	uint64_t expirations;
+	struct pressure_sample sample;
+	if(read(fd, &expirations, sizeof expirations) != sizeof expirations || !pressure_read(&sample)){
+		return;
+	}
+	
+	if(pressure_exceeded(&admission, &sample, 1.0)){
+		if(admission.stop_jobs){
+			stop_lowest_priority_job();
+		}
+	}
+	else if(!pressure_exceeded(&admission, &sample, PRESSURE_RESUME_FACTOR)){ //comfortably below the thresholds
+		//one job per interval, so the pressure it adds shows up before the next one starts
+		admit_one_job();
+	}
+}
+
+/*returns true if a new background job has to wait for the pressure to drop*/
+static bool
+admission_must_queue(void)
+{
+	struct pressure_sample sample;
+	if(!admission.enabled){
+		return false;
+	}
+	if(first_queued_job() != NULL){ //first come, first served
+		return true;
+	}
+	return pressure_read(&sample) && pressure_exceeded(&admission, &sample, 1.0);
+}
+
+/*turns admission control off, starting every queued job and resuming every job stopped under pressure*/
+static void
+admission_stop(void)
+{
+	admission.enabled = false;
+	if(admission_fd != -1){
+		event_loop_remove_fd(admission_fd);
+		close(admission_fd);
+		admission_fd = -1;
+	}
+	while(admit_one_job()){
+		continue;
+	}
+}
+
+/*turns admission control on with the given thresholds*/
+static void
+admission_start(struct pressure_policy* policy)
+{
+	if(admission_fd == -1){
+		admission_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(admission_fd == -1){
+			utils_error("timerfd_create failed: ");
+			return;
+		}
+		struct itimerspec every = { .it_interval = { .tv_nsec = ADMISSION_INTERVAL_MS % 1000 * 1000000, .tv_sec = ADMISSION_INTERVAL_MS / 1000 } };
+		every.it_value = every.it_interval;
+		if(timerfd_settime(admission_fd, 0, &every, NULL) == -1){
+			utils_fatal_error("timerfd_settime failed: ");
+		}
+		event_loop_add_fd(admission_fd, admission_tick, NULL);
+	}
+	admission = *policy;
 }
 
 /*
@@ -286,11 +1026,12 @@ sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
 {
     pid_t child;
     int status;
+    struct rusage usage;
 
     assert(sig == SIGCHLD);
 
-    while ((child = waitpid(-1, &status, WUNTRACED|WNOHANG)) > 0) {
-        handle_child_status(child, status);
+    while ((child = wait4(-1, &status, WUNTRACED|WNOHANG, &usage)) > 0) {
+        handle_child_status(child, status, &usage);
     }
 }
 
@@ -324,8 +1065,23 @@ wait_for_job(struct job *job)
 
     while (job->status == FOREGROUND && job->num_processes_alive > 0) {
         int status;
+        struct rusage usage;     /* tells limit violations from other deaths */
+
+        // With event sources registered (e.g. throttled background jobs),
+        // wait for SIGCHLD through the event loop so they keep being
+        // serviced while the foreground job runs.
+        if (event_loop_active()) {
+            pid_t child = wait4(-1, &status, WUNTRACED|WNOHANG, &usage);
+            if (child > 0)
+                handle_child_status(child, status, &usage);
+            else if (child == 0)
+                event_loop_wait_signal(SIGCHLD);
+            else
+                utils_fatal_error("waitpid failed, see code for explanation");
+            continue;
+        }
 
-        pid_t child = waitpid(-1, &status, WUNTRACED);
+        pid_t child = wait4(-1, &status, WUNTRACED, &usage);
 
         // When called here, any error returned by waitpid indicates a logic
         // bug in the shell.
@@ -337,14 +1093,14 @@ wait_for_job(struct job *job)
         // Since SIGCHLD is blocked, there cannot be races where a child's exit
         // was handled via the SIGCHLD signal handler.
         if (child != -1)
-            handle_child_status(child, status);
+            handle_child_status(child, status, &usage);
         else
             utils_fatal_error("waitpid failed, see code for explanation");
     }
 }
 
 static void
-handle_child_status(pid_t pid, int status){
+handle_child_status(pid_t pid, int status, const struct rusage* usage){
 	
     assert(signal_is_blocked(SIGCHLD));
 
@@ -363,12 +1119,14 @@ handle_child_status(pid_t pid, int status){
 	//make sure pid is a valid pid
 	if(pid > 0){
 		struct job* j = NULL; //job variable
+		int stage = -1; //command of the job that pid runs
 		//loops through job list to fid job that refers to pid
 		for (struct list_elem * e = list_begin(&job_list); 
 		e != list_end(&job_list); 
 		e = list_next(e)) {
 			j = list_entry(e, struct job, elem);
-			if(j->pid == pid){ //if job matches pid, break out of loop
+			stage = job_stage(j, pid);
+			if(stage != -1){ //if pid belongs to any command of the job, break out of loop
 				break;
 			}
 			j = NULL;
@@ -382,12 +1140,31 @@ handle_child_status(pid_t pid, int status){
 			//utils_fatal_error("Error: No job was found matching the ended process pid");
 		//}
 		else{
+			//check if the status change was caused by a limit set with the 'limit' prefix
+			const char* violation = resource_limits_explain(&j->limits, status, usage);
+			bool was_foreground = j->status == FOREGROUND;
+			enum job_status old_status = j->status;
+			CUSH_PROBE3(child_reaped, j->jid, pid, status);
+			if(WIFEXITED(status) || WIFSIGNALED(status)){
+				trace_record(TRACE_REAP, j->jid, pid, status, NULL);
+				j->stage_status[stage] = status; //for PIPESTATUS, so nothing needs to wait for it again
+			}
+			
 			if(WIFEXITED(status)){ //test if the program exited
+				if(violation != NULL){ //exec or allocation failed under a memory limit
+					fprintf(stderr, "%s\n", violation);
+				}
+				if(stage == j->num_stages - 1){ //the pipeline's status is its last command's
+					j->exit_status = status;
+				}
 				j->num_processes_alive--; //decrement processes counter for job
 			}
 			else if(WIFSIGNALED(status)){ //test if the program was terminated with a signal, send error message based on signal recieved
 				int termsig = WTERMSIG(status);
-				if (termsig == 6) { //aborted signal
+				if (violation != NULL) { //limit violations (SIGXCPU, SIGXFSZ, ...) are reported distinctly
+					fprintf(stderr, "%s\n", violation);
+				}
+				else if (termsig == 6) { //aborted signal
 					utils_error("aborted\n");
 				}
 				else if (termsig == 8) { //floating point exception signal
@@ -402,27 +1179,43 @@ handle_child_status(pid_t pid, int status){
 				else if (termsig == 15) { //terminated signal
 					utils_error("terminated\n");
 				}
+				if(stage == j->num_stages - 1){
+					j->exit_status = status;
+				}
 				j->num_processes_alive--; //decrement processes counter for job
 			}
+			else if(WIFSTOPPED(status) && j->held != 0 && WSTOPSIG(status) == SIGSTOP){
+				//stopped by 'throttle' or 'admit', not by the user: not a visible STOPPED transition
+			}
 			else if(WIFSTOPPED(status)){ //test if job was stopped
 				j->status = STOPPED; //set stopped status
+				j->stage_status[stage] = status;
 				int stop_sig = WSTOPSIG(status); //get the specific stopped signal
+				trace_record(TRACE_STOP, j->jid, pid, stop_sig, NULL);
 				//test if program was a foreground command to save terminal state
-				if(j->status == FOREGROUND){
+				if(was_foreground){
 					termstate_save(&j->saved_tty_state); //save tty state
-					print_job(j);
+					print_job(j, stdout);
 				}
 				else{ //runs if job was in the background
 					if(stop_sig == SIGTTOU || stop_sig == SIGTTIN){ //tests if the job was stoped do to needing terminal access
 						j->status = NEEDSTERMINAL;
 					}
 					else{
-						print_job(j);
+						print_job(j, stdout);
 					}
 				}
 				add_stopped_job(j->jid); //add job to stopped_job array
 			}
-			termstate_give_terminal_back_to_shell(); //return termianl access back to shell
+			if(j->status != old_status){
+				CUSH_PROBE3(job_state_change, j->jid, old_status, j->status);
+			}
+			if(!WIFSTOPPED(status) && j->num_processes_alive == 0){ //last process reaped, report and delete it before the next prompt
+				job_finished(j, !was_foreground);
+			}
+			if(was_foreground){ //a background job must not take the terminal from a foreground job
+				termstate_give_terminal_back_to_shell(); //return termianl access back to shell
+			}
 		}
 	}
 	else{ //error if pid is invalid
@@ -430,42 +1223,52 @@ handle_child_status(pid_t pid, int status){
 	}
 }
 
-static void execute(struct ast_pipeline* pipeline){
+/*starts the processes of a job and waits for it if it runs in the foreground; announce prints the pid of a background job*/
+static void launch_job(struct job* cur_job, bool announce){
 	
-	//make job from pipeline
-	struct job* cur_job = add_job(pipeline);
+	struct ast_pipeline* pipeline = cur_job->pipe;
 				
 	//make pipes
 	int size = list_size(&pipeline->commands);
 	int pipes[size][2];
-	for(int i = 0; i < size+1; i++){
+	for(int i = 0; i < size; i++){
 		pipe(pipes[i]);
 	}
 		
 	//int READ_END = 0;
 	//int WRITE_END = 1;
 		
-	//input file
+	//input file; the children get it as stdin, and none of them keeps it open besides
 	int input_fd = -1;
 	if(pipeline->iored_input != NULL){
-		input_fd = open(pipeline->iored_input, O_RDONLY);
+		input_fd = open(pipeline->iored_input, O_RDONLY | O_CLOEXEC);
 	}
 	
-	//output file
+	//output file, truncated by '>' as for a builtin or a group
 	int output_fd = -1;
 	if(pipeline->iored_output != NULL){
-		if(pipeline->append_to_output){
-			output_fd = open(pipeline->iored_output, O_WRONLY | O_CREAT | O_APPEND, 0750);
-		}
-		else{
-			output_fd = open(pipeline->iored_output, O_WRONLY | O_CREAT, 0750);
-		}
+		int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (pipeline->append_to_output ? O_APPEND : O_TRUNC);
+		output_fd = open(pipeline->iored_output, flags, 0666);
+	}
+		
+	//a coprocess reads from and writes to pipes connected to the shell
+	if(cur_job->coproc_name != NULL){
+		input_fd = cur_job->coproc_child_fds[0];
+		output_fd = cur_job->coproc_child_fds[1];
+	}
+	
+	//a captured job writes its stdout and stderr into the pipe of its joblog
+	int log_fd = cur_job->log_fd;
+	if(log_fd != -1){
+		output_fd = log_fd; //closed with output_fd once the children are started
+		cur_job->log_fd = -1;
 	}
 		
 	int com_num= 0;
 	int pid = 0;
+	char** envp = variables_envp(); //prebuilt, only changes when an exported variable does
 		
-	signal_block(SIGCHLD);
+	signal_block(SIGCHLD); //nests, e.g. when 'admit' starts the job from the event loop
 		
 	//parse pipeline
 	for (struct list_elem * e = list_begin(&pipeline->commands); 
@@ -473,10 +1276,23 @@ static void execute(struct ast_pipeline* pipeline){
 	e = list_next(e)) {
 		struct ast_command* cmd = list_entry(e, struct ast_command, elem);
 		
-		//split to child and parent processes
-		pid = fork(); 
+		//builtins run in the shell once the other commands are started
+		if(find_builtin(command_name(cmd)) != NULL){
+			com_num++;
+			continue;
+		}
+		
+		//split to child and parent processes, unless the last command of a subshell takes the subshell's place
+		CUSH_PROBE3(spawn_start, cur_job->jid, com_num, command_name(cmd));
+		bool in_place = exec_last_command && size == 1 && cur_job->status == FOREGROUND;
+		pid = in_place ? 0 : fork(); 
 			
 		if(pid == 0){
+			
+			//lead the job or join it before anything else, as the parent does too: a command that execs before the parent's setpgid could no longer be moved, and a group's commands follow it
+			if(job_control){
+				setpgid(0, cur_job->pid);
+			}
 				
 			//child pipes
 			for(int i = 0; i <= size; i++){
@@ -510,47 +1326,101 @@ static void execute(struct ast_pipeline* pipeline){
 				}
 			}
 			
+			if(log_fd != -1){
+				dup2(log_fd, STDERR_FILENO);
+			}
+			
 			//assign stderr to stdout
 			if(cmd->dup_stderr_to_stdout){
 				dup2(STDOUT_FILENO, STDERR_FILENO);
 			}
+			
+			//the redirections are in place, a group must not pass on the files they came from
+			if(input_fd > STDERR_FILENO){
+				close(input_fd);
+			}
+			if(output_fd > STDERR_FILENO){
+				close(output_fd);
+			}
+			
+			//pass on the coprocess pipes the command names
+			coproc_inherit(cur_job, cmd);
+				
+			//install the job's resource limits
+			if(!resource_limits_apply(&cur_job->limits)){
+				exit(EXIT_FAILURE);
+			}
+			
+			//install the scheduling policy and priority before the command runs its first timeslice
+			if(!job_sched_apply(&cur_job->sched)){
+				exit(EXIT_FAILURE);
+			}
+			
+			//pin the command to its cpus
+			if(cur_job->placement != NULL && !affinity_apply(&cur_job->placement[com_num])){
+				exit(EXIT_FAILURE);
+			}
+				
+			//a group or compound command runs in this copy of the shell
+			if(!is_simple(cmd)){
+				run_subshell(cmd);
+			}
 				
-			//execute
+			//execute, without searching PATH if a compiled loop already found the program
+			trace_record(TRACE_EXEC, cur_job->jid, getpid(), com_num, *cmd->argv);
+			if(!interactive){ //an interactive shell reports at its first prompt instead
+				startup_profile_report("first exec");
+			}
+			environ = envp;
+			if(cmd->path != NULL){
+				execv(cmd->path, cmd->argv);
+			}
 			execvp(*cmd->argv, cmd->argv);
 			
 			//if execute failed
+			if(errno == ENOMEM){ //program could not be loaded under the job's memory limit
+				exit(RESOURCE_LIMITS_ENOMEM_EXIT);
+			}
 			printf("no such file or directory\n");
-			exit(0);
+			exit(127); //as in other shells, so that && and || see the failure
 		}
 		
 		//assign job pid
 		if(cur_job->pid == 0){
 			cur_job->pid = pid;
 		}
-		//set child process pgid
-		setpgid(pid, cur_job->pid);
+		cur_job->stage_pids[com_num] = pid;
+		if(!interactive){
+			startup_profile_stop(); //the child reported its exec
+		}
+		trace_record(TRACE_SPAWN, cur_job->jid, pid, com_num, command_name(cmd));
+		CUSH_PROBE3(spawn_done, cur_job->jid, com_num, pid);
+		//set child process pgid; in a subshell, its commands stay in the subshell's job
+		if(job_control){
+			setpgid(pid, cur_job->pid);
+		}
 		cur_job->num_processes_alive++;
 		com_num++;
 	}
 		
-	//parent pipes
-	//leave following pipes open:
-	//pipe[0][1] for writing to first cmd
-	//pipe[size][0] for reading from last cmd
-	for(int i = 0; i < size; i++){
-		if(i == 0){
-			if(input_fd > 0){
-				close(pipes[i][0]);
-			}
-			else{
-				close(pipes[i][0]);
-				close(pipes[i][1]);
-			}
-		}
-		else{
-			close(pipes[i][0]);
-			close(pipes[i][1]);
+	//run the builtins of the pipeline, each writing into the pipe to the next command
+	com_num = 0;
+	for (struct list_elem * e = list_begin(&pipeline->commands); 
+	e != list_end(&pipeline->commands); 
+	e = list_next(e)) {
+		struct ast_command* cmd = list_entry(e, struct ast_command, elem);
+		const struct builtin* b = find_builtin(command_name(cmd));
+		if(b != NULL){
+			bool last = com_num == size - 1;
+			run_builtin_stage(b, cmd->argv, last ? output_fd : pipes[com_num + 1][1], last);
 		}
+		com_num++;
+	}
+	
+	//parent pipes, only the children use them
+	for(int i = 0; i < size; i++){
+		close(pipes[i][0]);
+		close(pipes[i][1]);
 	}
 		
 	/*//read from file to pipe
@@ -574,260 +1444,2097 @@ static void execute(struct ast_pipeline* pipeline){
 		close(output_fd);
 	}
 	if(input_fd > 0){
-		close(output_fd);
+		close(input_fd);
 	}
 		
-	//save good terminal state
-	termstate_save(&cur_job->saved_tty_state);
+	bool finished = false; //true once its status is in $?, when nothing refers to the job any more
 	
-	//if job is foreground
-	if(cur_job->status == FOREGROUND){
-		termstate_give_terminal_to(&cur_job->saved_tty_state, cur_job->pid);
+	//if job is foreground, and not only made of builtins
+	if(cur_job->status == FOREGROUND && cur_job->pid != 0){
+		give_terminal_to_job(cur_job);
 		wait_for_job(cur_job);
+		restore_background_jobs();
+		set_job_status(cur_job);
+		finished = cur_job->num_processes_alive == 0; //not stopped
+		
+		//give terminal back to shell
+		termstate_give_terminal_back_to_shell();
 	}
 	//if job is background
-	else if(cur_job->status == BACKGROUND){
-		printf("[%d] %d\n", cur_job->jid, cur_job->pid);
+	else if(cur_job->status == BACKGROUND && cur_job->pid != 0){
+		current_jid = cur_job->jid;
+		if(announce){
+			printf("[%d] %d\n", cur_job->jid, cur_job->pid);
+		}
+		set_status(0);
 	}
 	
-	//give terminal back to shell
-	termstate_give_terminal_back_to_shell();
+	//only builtins, so no process will be reaped for it
+	if(cur_job->pid == 0){
+		job_finished(cur_job, false);
+		set_job_status(cur_job);
+		finished = true;
+	}
+	
+	if(cur_job->coproc_name != NULL){ //hand the coprocess's pipes and pid to later commands
+		coproc_share(cur_job);
+	}
+	
+	if(finished){
+		forget_job(cur_job);
+	}
 	
 	signal_unblock(SIGCHLD);
 }
 
-static void run_pipeline(struct ast_pipeline* pipe){
-	
-	//parse pipeline for command arguments, determine validity of built-in commands, and retrieve job number for appropriate builtins;
-	//get frst command ni pipeline
-	struct ast_command* com = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
-	//determnie how many arguments command has
-	char** cmd_argv = com->argv;
-	int argc = 0;
-	while(*(cmd_argv + argc) != NULL){
-		argc++;
+/*creates the pipes of a coprocess and exposes the shell's ends as NAME_IN and NAME_OUT*/
+static bool coproc_open(struct job* j, const char* name){
+	int to_job[2], from_job[2];
+	//close-on-exec, so that the coprocess does not hold its own input open; its ends are dup2'ed in the child
+	if(pipe2(to_job, O_CLOEXEC) == -1){
+		return false;
 	}
+	if(pipe2(from_job, O_CLOEXEC) == -1){
+		close(to_job[0]);
+		close(to_job[1]);
+		return false;
+	}
+	j->coproc_name = strdup(name);
+	j->coproc_child_fds[0] = to_job[0];
+	j->coproc_child_fds[1] = from_job[1];
+	j->coproc_fds[0] = from_job[0];
+	j->coproc_fds[1] = to_job[1];
 	
-	if(strcmp(*cmd_argv, "exit") == 0){ //exit nuilt-in
-		exit(0);
+	char var[COPROC_VAR_SIZE], value[32];
+	snprintf(var, sizeof var, "%s_IN", name);
+	snprintf(value, sizeof value, "%d", j->coproc_fds[1]);
+	variables_set(var, value, false);
+	snprintf(var, sizeof var, "%s_OUT", name);
+	snprintf(value, sizeof value, "%d", j->coproc_fds[0]);
+	variables_set(var, value, false);
+	return true;
+}
+
+/*publishes the pid of a started coprocess as NAME_PID*/
+static void coproc_share(struct job* j){
+	char var[COPROC_VAR_SIZE], value[32];
+	snprintf(var, sizeof var, "%s_PID", j->coproc_name);
+	snprintf(value, sizeof value, "%d", j->pid);
+	variables_set(var, value, false);
+}
+
+/*returns true if word expands the variable name, as $name, ${name} or ${name[i]}*/
+static bool word_expands(const char* word, const char* name){
+	size_t len = strlen(name);
+	for(const char* s = strchr(word, '$'); s != NULL; s = strchr(s + 1, '$')){
+		bool braced = *(s + 1) == '{';
+		const char* at = s + 1 + braced;
+		if(strncmp(at, name, len) != 0){
+			continue;
+		}
+		char next = *(at + len);
+		if(braced ? (next == '}' || next == '[') : !(isalnum((unsigned char) next) || next == '_')){ //not the start of a longer name
+			return true;
+		}
 	}
-	else if(strcmp(*cmd_argv, "kill") == 0){ //kill built-in
-		if(argc == 2){ //test for correct number of arguments
-			int jid = atoi(*(cmd_argv + 1)); //convert jid from argv to int
-			struct job* j = get_job_from_jid(jid); //retrieve job from jid
-			if(j == NULL){ //error if job was not found
-				printf("jid: %d was not found among the current jobs\n", jid);
-			}
-			else{ //if job was found
-				int ret_status = killpg(j->pid, SIGTERM); //set signal
-				if(ret_status != 0){
-					list_remove(&j->elem);
-				}
-				if(ret_status < 0){ //signal failure
-					printf("Kill on job: %d was unsuccessful\n", jid);
+	return false;
+}
+
+/*before cmd's words are expanded, records in cmd->inherit_fds the shell's ends of the coprocesses whose NAME_IN or NAME_OUT they expand*/
+static void coproc_mark(struct ast_command* cmd){
+	free(cmd->inherit_fds);
+	cmd->inherit_fds = NULL;
+	int nfds = 0;
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j->coproc_name == NULL || j->status == QUEUED){
+			continue;
+		}
+		char var[2][COPROC_VAR_SIZE];
+		snprintf(*(var + 0), COPROC_VAR_SIZE, "%s_OUT", j->coproc_name); //the variable that holds coproc_fds[0]
+		snprintf(*(var + 1), COPROC_VAR_SIZE, "%s_IN", j->coproc_name);
+		for(int i = 0; i < 2; i++){
+			for(char** word = cmd->argv; *word != NULL; word++){
+				if(word_expands(*word, *(var + i))){
+					cmd->inherit_fds = realloc(cmd->inherit_fds, (nfds + 2) * sizeof *cmd->inherit_fds);
+					*(cmd->inherit_fds + nfds++) = j->coproc_fds[i];
+					*(cmd->inherit_fds + nfds) = -1;
+					break;
 				}
 			}
 		}
-		else{ //error if incorrect number of arguments
-			printf("Incorrect number of arguments for command 'kill'\n");
+	}
+}
+
+/*returns true if fd is one of the -1 terminated fds*/
+static bool fds_contain(const int* fds, int fd){
+	for(; fds != NULL && *fds != -1; fds++){
+		if(*fds == fd){
+			return true;
 		}
 	}
-	else if(strcmp(*cmd_argv, "stop") == 0){ //stop built-in
-		if(argc == 2){ //test for correct number of arguments
-			int jid = atoi(*(cmd_argv + 1)); //convert jid from argv to int
-			struct job* j = get_job_from_jid(jid); //retrieve job from jid
-			if(j == NULL){ //error if job was not found
-				printf("jid: %d was not found among the current jobs\n", jid);
-			}
-			else{ //if job was found
-				int ret_status = killpg(j->pid, SIGSTOP); //send signal
-				if(ret_status >= 0){ //signal success
-					j->status = STOPPED; //set status here?
-					termstate_save(&j->saved_tty_state);
-				}
-				else{ //signal failure
-					printf("Stop on job: %d was unsuccessful\n", jid);
-				}
+	return false;
+}
+
+/*in the child of cur_job about to run cmd, clears close-on-exec on the shell's ends of the coprocesses that cmd's words expanded
+(see coproc_mark), so that long-running jobs which do not use them cannot keep a coprocess from seeing EOF; a group, whose commands
+are not expanded yet, gets them all*/
+static void coproc_inherit(struct job* cur_job, struct ast_command* cmd){
+	for (struct list_elem * e = list_begin(&job_list); 
+	e != list_end(&job_list); 
+	e = list_next(e)) {
+		struct job* j = list_entry(e, struct job, elem);
+		if(j == cur_job || j->coproc_name == NULL || j->status == QUEUED){
+			continue;
+		}
+		for(int i = 0; i < 2; i++){
+			if(!is_simple(cmd) || fds_contain(cmd->inherit_fds, j->coproc_fds[i])){
+				fcntl(j->coproc_fds[i], F_SETFD, 0);
 			}
 		}
-		else{ //error if incorrect number of arguments
-			printf("Incorrect number of arguments for command 'stop'\n");
+	}
+}
+
+/*closes the shell's ends of a finished coprocess and removes its variables, unless a newer coprocess took the name*/
+static void coproc_close(struct job* j){
+	if(j->coproc_name == NULL){
+		return;
+	}
+	char var[COPROC_VAR_SIZE], value[32];
+	snprintf(var, sizeof var, "%s_IN", j->coproc_name);
+	snprintf(value, sizeof value, "%d", j->coproc_fds[1]);
+	if(variables_get(var) != NULL && strcmp(variables_get(var), value) == 0){
+		variables_unset(var);
+		snprintf(var, sizeof var, "%s_OUT", j->coproc_name);
+		variables_unset(var);
+		snprintf(var, sizeof var, "%s_PID", j->coproc_name);
+		variables_unset(var);
+	}
+	close(j->coproc_fds[0]);
+	close(j->coproc_fds[1]);
+	if(j->status == QUEUED){ //never launched, so its ends are still open
+		close(j->coproc_child_fds[0]);
+		close(j->coproc_child_fds[1]);
+	}
+	free(j->coproc_name);
+	j->coproc_name = NULL;
+}
+
+static void execute(struct ast_pipeline* pipeline, struct job_settings* settings){
+	
+	//make job from pipeline
+	struct job* cur_job = add_job(pipeline);
+	trace_record(TRACE_JOB, cur_job->jid, 0, cur_job->num_stages,
+		command_name(list_entry(list_begin(&pipeline->commands), struct ast_command, elem)));
+	cur_job->limits = settings->limits;
+	cur_job->sched = settings->sched;
+	
+	//connect a coprocess's input and output to the shell
+	if(settings->coproc_name != NULL && !coproc_open(cur_job, settings->coproc_name)){
+		utils_error("coproc: cannot create pipes: ");
+		list_remove(&cur_job->elem);
+		delete_job(cur_job);
+		return;
+	}
+	
+	//keep the output of a background job in memory instead of the terminal, with 'joblog on'
+	if(cur_job->status == BACKGROUND && joblog_size > 0 && pipeline->iored_output == NULL && cur_job->coproc_name == NULL){
+		cur_job->log_fd = job_log_start(cur_job->jid, joblog_size);
+		if(cur_job->log_fd == -1){
+			utils_error("joblog: cannot capture the output of job %d: ", cur_job->jid);
 		}
 	}
-	else if(strcmp(*cmd_argv, "jobs") == 0){ //jobs built-in
-		if(argc == 1){ //test for correct number of arguments
-			if(!list_empty(&job_list)){ //if job list is not empty
-				//loop through job list
-				for (struct list_elem * e = list_begin(&job_list); 
-				e != list_end(&job_list); 
-				e = list_next(e)) {
-					struct job* j = list_entry(e, struct job, elem);
-					print_job(j); //print jobs
-				}
+	
+	//decide which cpus each command runs on
+	if(settings->affinity.mode != AFFINITY_NONE){
+		cur_job->placement = malloc(cur_job->num_stages * sizeof *cur_job->placement);
+		affinity_place(&settings->affinity, cur_job->num_stages, cur_job->placement);
+	}
+	
+	//save good terminal state, now while the shell owns the terminal
+	termstate_save(&cur_job->saved_tty_state);
+	
+	//hold back new background work while the system is under pressure
+	if(cur_job->status == BACKGROUND && admission_must_queue()){
+		cur_job->status = QUEUED;
+		printf("[%d] queued\n", cur_job->jid);
+		set_status(0);
+		return;
+	}
+	
+	launch_job(cur_job, true);
+}
+
+/*true for a command made of words, rather than a group or a compound command*/
+static bool is_simple(struct ast_command* cmd){
+	return cmd->group == NULL && cmd->compound == NULL;
+}
+
+/*removes the first n words of a command, used for builtin prefixes such as 'limit'*/
+static void strip_words(struct ast_command* cmd, int n){
+	for(int i = 0; i < n; i++){
+		free(cmd->argv[i]);
+	}
+	int i = 0;
+	do{ //shift remaining words, including the NULL terminator
+		cmd->argv[i] = cmd->argv[i + n];
+	}while(cmd->argv[i++] != NULL);
+}
+
+/*replaces *word by its copy with variables expanded*/
+static void expand_variables(char** word){
+	char* expanded = variables_expand(*word);
+	free(*word);
+	*word = expanded;
+}
+
+/*tells the parts of the shell that cache a variable that it changed*/
+static void variable_changed(const char* name){
+	if(*name != 'P' && *name != '?'){ //as for the variables of a loop, none of those below
+		return;
+	}
+	if(strcmp(name, "PIPESTATUS") == 0 || strcmp(name, "?") == 0){ //no longer what set_status left
+		status_set = false;
+	}
+	if(strcmp(name, "PATH") != 0){
+		return;
+	}
+	path_changes++;
+	if(commands_indexed){ //rescan the commands offered by tab completion
+		completion_set_path(variables_get("PATH") ? variables_get("PATH") : "");
+	}
+}
+
+/*sets variables from a 'NAME=value' word, returns false if word is not an assignment*/
+static bool assign_variable(char* word, bool export){
+	char* eq = strchr(word, '=');
+	if(eq == NULL || !variables_valid_name(word, eq - word)){
+		return false;
+	}
+	*eq = '\0';
+	variables_set(word, eq + 1, export);
+	variable_changed(word);
+	*eq = '=';
+	return true;
+}
+
+/*makes the words of argv the positional parameters $1, $2, ..., with $# their number and $@ all of them;
+outside of function calls, argv is NULL and they are unset*/
+static void set_params(char** argv){
+	const char* old = variables_get("#");
+	int old_count = old != NULL ? atoi(old) : 0;
+	int count = 0;
+	size_t len = 1;
+	char name[16];
+	for(; argv != NULL && *(argv + count) != NULL; count++){
+		snprintf(name, sizeof name, "%d", count + 1);
+		variables_set(name, *(argv + count), false);
+		len += strlen(*(argv + count)) + 1;
+	}
+	for(int i = count; i < old_count; i++){ //those of an outer call that had more
+		snprintf(name, sizeof name, "%d", i + 1);
+		variables_unset(name);
+	}
+	if(argv == NULL){
+		variables_unset("@");
+		variables_unset("#");
+		return;
+	}
+	
+	char* all = malloc(len);
+	all[0] = '\0';
+	for(int i = 0; i < count; i++){
+		if(i > 0){
+			strcat(all, " ");
+		}
+		strcat(all, *(argv + i));
+	}
+	variables_set("@", all, false);
+	free(all);
+	snprintf(name, sizeof name, "%d", count);
+	variables_set("#", name, false);
+}
+
+/*returns a copy of the positional parameters, which set_params puts back after a function call; NULL outside of one*/
+static char** save_params(void){
+	const char* n = variables_get("#");
+	if(n == NULL){
+		return NULL;
+	}
+	int count = atoi(n);
+	char** saved = malloc((count + 1) * sizeof *saved);
+	char name[16];
+	for(int i = 0; i < count; i++){
+		snprintf(name, sizeof name, "%d", i + 1);
+		const char* value = variables_get(name);
+		*(saved + i) = strdup(value != NULL ? value : "");
+	}
+	*(saved + count) = NULL;
+	return saved;
+}
+
+/*returns argv with the words of more appended, which it takes over*/
+static char** append_words(char** argv, char** more){
+	int n = 0, m = 0;
+	while(*(argv + n) != NULL){
+		n++;
+	}
+	while(*(more + m) != NULL){
+		m++;
+	}
+	argv = realloc(argv, (n + m + 1) * sizeof *argv);
+	memcpy(argv + n, more, (m + 1) * sizeof *argv);
+	return argv;
+}
+
+/*replaces the alias cmd starts with by a copy of its parsed definition, followed by the rest of cmd's words as if the definition had been typed;
+returns true if the result starts with a word that may be another alias*/
+static bool expand_alias(struct ast_command* cmd){
+	struct ast_command_line* body = definitions_get(DEFINITION_ALIAS, *cmd->argv);
+	if(body == NULL){
+		const char* text = definitions_text(DEFINITION_ALIAS, *cmd->argv);
+		if(text != NULL){ //its syntax error was printed
+			printf("alias: cannot expand %s as '%s'\n", *cmd->argv, text);
+		}
+		return false;
+	}
+	struct ast_command_line* copy = ast_command_line_copy(body);
+	struct ast_pipeline* last_pipe = list_entry(list_back(&copy->pipes), struct ast_pipeline, elem);
+	struct ast_command* last = list_entry(list_back(&last_pipe->commands), struct ast_command, elem);
+	char** rest = cmd->argv + 1;
+	if(last->group == NULL){ //the words after the alias go to its last command: with alias l="ls | less", 'l -S' is 'ls | less -S'
+		last->argv = append_words(last->argv, rest);
+	}
+	else{
+		for(char** word = rest; *word != NULL; word++){
+			free(*word);
+		}
+	}
+	*rest = NULL;
+	
+	if(list_size(&copy->pipes) == 1 && list_size(&last_pipe->commands) == 1 && last->group == NULL && !last->dup_stderr_to_stdout
+	   && last_pipe->iored_input == NULL && last_pipe->iored_output == NULL && !last_pipe->bg_job){ //a plain command, which is what most aliases are, gives cmd its words
+		bool again = strcmp(*last->argv, *cmd->argv) != 0; //alias ls="ls -F" is not expanded again
+		free(*cmd->argv);
+		free(cmd->argv);
+		cmd->argv = last->argv;
+		last->argv = calloc(1, sizeof *last->argv);
+		ast_command_line_free(copy);
+		return again;
+	}
+	free(*cmd->argv); //anything else runs as a { } group
+	*cmd->argv = NULL;
+	cmd->group = copy;
+	cmd->subshell = false;
+	return false;
+}
+
+/*stores 'name() group', with the redirections written after the group, which apply whenever it is called;
+the group and redirections move from pipe into the definition, so a script with many functions does not copy them*/
+static void define_function(struct ast_pipeline* pipe){
+	if(list_size(&pipe->commands) > 1){
+		struct ast_command* cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+		printf("%s: a function cannot be defined in a pipeline\n", cmd->function_name);
+		set_status(2);
+		return;
+	}
+	struct ast_pipeline* body = ast_pipeline_create(pipe->iored_input, pipe->iored_output, pipe->append_to_output);
+	pipe->iored_input = pipe->iored_output = NULL;
+	struct ast_command* group = list_entry(list_pop_front(&pipe->commands), struct ast_command, elem);
+	ast_pipeline_add_command(body, group);
+	char* name = group->function_name;
+	group->function_name = NULL;
+	
+	struct ast_command_line* cline = ast_command_line_create_empty();
+	list_push_back(&cline->pipes, &body->elem);
+	definitions_set(DEFINITION_FUNCTION, name, cline, NULL);
+	free(name);
+	set_status(0);
+}
+
+/*exit built-in*/
+static void builtin_exit(int argc, char** argv, FILE* out){
+	startup_profile_report("exit");
+	exit(argc > 1 ? atoi(*(argv + 1)) : EXIT_SUCCESS); //'exit n' exits with status n
+}
+
+/*export built-in*/
+static void builtin_export(int argc, char** argv, FILE* out){
+	if(argc == 1){ //list the environment
+		variables_print_exported(out);
+	}
+	for(int i = 1; i < argc; i++){ //'NAME=value' sets and exports, 'NAME' exports
+		char* word = *(argv + i);
+		if(assign_variable(word, true)){
+			continue;
+		}
+		if(!variables_valid_name(word, strlen(word))){
+			fprintf(out, "export: '%s' is not a valid identifier\n", word);
+			continue;
+		}
+		variables_export(word);
+		variable_changed(word);
+	}
+}
+
+/*unset built-in*/
+static void builtin_unset(int argc, char** argv, FILE* out){
+	bool functions = argc > 1 && strcmp(*(argv + 1), "-f") == 0; //'unset -f NAME' removes a function
+	for(int i = functions ? 2 : 1; i < argc; i++){
+		if(functions){
+			definitions_remove(DEFINITION_FUNCTION, *(argv + i));
+			continue;
+		}
+		variables_unset(*(argv + i));
+		variable_changed(*(argv + i));
+	}
+}
+
+/*alias built-in*/
+static void builtin_alias(int argc, char** argv, FILE* out){
+	if(argc == 1){ //list the aliases
+		definitions_print(DEFINITION_ALIAS, "alias ", out);
+		return;
+	}
+	char* eq = strchr(*(argv + 1), '=');
+	if(eq == NULL){ //'alias NAME...' shows them
+		for(int i = 1; i < argc; i++){
+			const char* text = definitions_text(DEFINITION_ALIAS, *(argv + i));
+			if(text == NULL){
+				fprintf(out, "alias: %s: not found\n", *(argv + i));
 			}
-			else{ //error if job list is empty
-				printf("There are currently no jobs\n");
+			else{
+				fprintf(out, "alias %s='%s'\n", *(argv + i), text);
 			}
 		}
-		else{ //error if incorrect number of arguments
-			printf("Incorrect number of arguments for command 'jobs'\n");
+		return;
+	}
+	
+	//'alias NAME=text...' defines NAME as the rest of the words, parsed once, when first used; as quotes only quote whole words, "NAME=text" works too
+	*eq = '\0';
+	const char* name = *(argv + 1);
+	size_t len = strlen(eq + 1) + 1;
+	for(int i = 2; i < argc; i++){
+		len += strlen(*(argv + i)) + 1;
+	}
+	char* text = malloc(len);
+	strcpy(text, eq + 1);
+	for(int i = 2; i < argc; i++){
+		strcat(text, " ");
+		strcat(text, *(argv + i));
+	}
+	
+	if(!variables_valid_name(name, strlen(name))){
+		fprintf(out, "alias: '%s' is not a valid alias name\n", name);
+	}
+	else if(text[strspn(text, " \t")] == '\0'){ //nothing to expand to
+		fprintf(out, "alias: cannot define %s as '%s'\n", name, text);
+	}
+	else{
+		definitions_set(DEFINITION_ALIAS, name, NULL, text); //parsed when first used
+	}
+	free(text);
+	*eq = '=';
+}
+
+/*unalias built-in*/
+static void builtin_unalias(int argc, char** argv, FILE* out){
+	if(argc == 2 && strcmp(*(argv + 1), "-a") == 0){ //remove them all
+		definitions_clear(DEFINITION_ALIAS);
+		return;
+	}
+	for(int i = 1; i < argc; i++){
+		if(!definitions_remove(DEFINITION_ALIAS, *(argv + i))){
+			fprintf(out, "unalias: %s: not found\n", *(argv + i));
 		}
 	}
-	else if(strcmp(*cmd_argv, "fg") == 0){ //fg built-in
-		
-		//job variables
-		struct job* j = NULL;
-		int jid = 0;
-		
-		if(argc == 1){ //if 1 argument 'fg'
-			//get job from last stopped job
-			if(num_stop_job > 0){ //if there is atleat 1 stopped job, retrieve it
-				j = get_job_from_jid(stopped_jobs[num_stop_job-1]);
-				jid = j->jid;
-			}
-			else{ //no stopped jobs
-				printf("There are currently no stopped jobs\n");
-				return;
-			}
+}
+
+/*kill built-in*/
+static void builtin_kill(int argc, char** argv, FILE* out){
+	if(argc == 2){ //test for correct number of arguments
+		int jid = atoi(*(argv + 1)); //convert jid from argv to int
+		struct job* j = get_job_from_jid(jid); //retrieve job from jid
+		if(j == NULL){ //error if job was not found
+			fprintf(out, "jid: %d was not found among the current jobs\n", jid);
 		}
-		else if(argc == 2){ //if 2 arguments 'fg [jid]'
-			jid = atoi(*(cmd_argv + 1)); //retrieve jid
-			j = get_job_from_jid(jid); //get job from jid
-			if(j == NULL){ //if job wasn't found
-				printf("No job matching jid\n");
-				return;
+		else if(j->status == QUEUED){ //never started, just forget it
+			list_remove(&j->elem);
+			delete_job(j);
+		}
+		else{ //if job was found
+			int ret_status = killpg(j->pid, SIGTERM); //set signal
+			if(ret_status == 0 && j->held != 0){ //a job stopped by 'throttle' or 'admit' must run to act on SIGTERM
+				j->held = 0;
+				killpg(j->pid, SIGCONT);
 			}
-			if(j->status == FOREGROUND){ //if already foreground, print message
-				printf("Job: %d is already running\n", jid);
-				return;
+			if(ret_status < 0){ //signal failure
+				fprintf(out, "Kill on job: %d was unsuccessful\n", jid);
 			}
 		}
-		else{ //error for incorrect number of arguments
-			printf("Incorrect number of arguments for command 'fg'\n");
-			return;
+	}
+	else{ //error if incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'kill'\n");
+	}
+}
+
+/*stop built-in*/
+static void builtin_stop(int argc, char** argv, FILE* out){
+	if(argc == 2){ //test for correct number of arguments
+		int jid = atoi(*(argv + 1)); //convert jid from argv to int
+		struct job* j = get_job_from_jid(jid); //retrieve job from jid
+		if(j == NULL){ //error if job was not found
+			fprintf(out, "jid: %d was not found among the current jobs\n", jid);
 		}
-		
-		if(j == NULL){ //error if no job found
-			printf("There was no stopped job found\n");
-			return;
+		else if(j->status == QUEUED){ //no processes to stop yet
+			fprintf(out, "Job: %d has not been started yet\n", jid);
 		}
-		else{ //if job found
-			signal_block(SIGCHLD); //block signal
-			int ret_status = killpg(j->pid, SIGCONT); //send continue signal
+		else{ //if job was found
+			int ret_status = killpg(j->pid, SIGSTOP); //send signal
 			if(ret_status >= 0){ //signal success
-				start_stopped_job(j->jid); //remove jid from stopped_jobs array
-				termstate_give_terminal_to(&j->saved_tty_state, j->pid); //give terminal to job
-				j->status = FOREGROUND; //set job status to foreground
-				print_job(j); //print job
-				wait_for_job(j); //wait for job completion
+				j->status = STOPPED; //set status here?
+				j->held = 0; //now stopped by the user
+				termstate_save(&j->saved_tty_state);
 			}
 			else{ //signal failure
-				printf("fg on job: %d was unsuccessful\n", jid);
+				fprintf(out, "Stop on job: %d was unsuccessful\n", jid);
 			}
-			signal_unblock(SIGCHLD); //unblock signal
-			termstate_give_terminal_back_to_shell(); //return terminal to shell
 		}
-		
 	}
-	else if(strcmp(*cmd_argv, "bg") == 0){ //bg built-in
-		
-		//job variables
-		struct job* j = NULL;
-		int jid = 0;
-		
-		if(argc == 1){ //if 1 argument 'bg'
-			//get job from last stopped job
-			if(num_stop_job > 0){ //if there is atleat 1 stopped job, retrieve it
-				j = get_job_from_jid(stopped_jobs[num_stop_job-1]);
-				jid = j->jid;
-			}
-			else{ //no stopped jobs
-				printf("There are currently no stopped jobs\n");
-				return;
+	else{ //error if incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'stop'\n");
+	}
+}
+
+/*jobs built-in*/
+static void builtin_jobs(int argc, char** argv, FILE* out){
+	bool long_format = argc == 2 && strcmp(*(argv + 1), "-l") == 0; //'jobs -l' also lists pids and cpu placement
+	if(argc == 1 || long_format){ //test for correct number of arguments
+		if(!list_empty(&job_list)){ //if job list is not empty
+			//loop through job list
+			for (struct list_elem * e = list_begin(&job_list); 
+			e != list_end(&job_list); 
+			e = list_next(e)) {
+				struct job* j = list_entry(e, struct job, elem);
+				print_job(j, out); //print jobs
+				if(long_format){
+					print_job_stages(j, out);
+				}
 			}
 		}
-		else if(argc == 2){ //if 2 arguments 'bg [jid]'
-			jid = atoi(*(cmd_argv + 1)); //retrieve jid
-			j = get_job_from_jid(jid); //get job from jid
-			if(j == NULL){ //if job wasn't found
-				printf("No job matching jid\n");
-				return;
-			}
-			else if(j->status != STOPPED){ //if job is already running
-				printf("Job: %d is already running\n", jid);
-				return;
-			}
+		else{ //error if job list is empty
+			fprintf(out, "There are currently no jobs\n");
+		}
+	}
+	else{ //error if incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'jobs'\n");
+	}
+}
+
+/*fg built-in*/
+static void builtin_fg(int argc, char** argv, FILE* out){
+	
+	//job variables
+	struct job* j = NULL;
+	int jid = 0;
+	
+	if(argc == 1){ //if 1 argument 'fg'
+		//get job from last stopped job
+		if(num_stop_job > 0){ //if there is atleat 1 stopped job, retrieve it
+			j = get_job_from_jid(stopped_jobs[num_stop_job-1]);
+			jid = j->jid;
 		}
-		else{ //error for incorrect number of arguments
-			printf("Incorrect number of arguments for command 'bg'\n");
+		else{ //no stopped jobs
+			fprintf(out, "There are currently no stopped jobs\n");
 			return;
 		}
-			
-		if(j == NULL){ //if job was found
-			printf("There are currently no stopped jobs\n");
+	}
+	else if(argc == 2){ //if 2 arguments 'fg [jid]'
+		jid = atoi(*(argv + 1)); //retrieve jid
+		j = get_job_from_jid(jid); //get job from jid
+		if(j == NULL){ //if job wasn't found
+			fprintf(out, "No job matching jid\n");
 			return;
 		}
-		else{ //if job found
-			int ret_status = killpg(j->pid, SIGCONT); //send continue signal
-			if(ret_status >= 0){ //signal success
-				start_stopped_job(j->jid); //remove job from stopped jobs array
-				j->status = BACKGROUND; //set background status
-				print_job(j); //print job
-			}
-			else{ //signal failure
-				printf("bg on job: %d was unsuccessful\n", jid);
+		if(j->status == FOREGROUND){ //if already foreground, print message
+			fprintf(out, "Job: %d is already running\n", jid);
+			return;
+		}
+	}
+	else{ //error for incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'fg'\n");
+		return;
+	}
+	
+	if(j == NULL){ //error if no job found
+		fprintf(out, "There was no stopped job found\n");
+		return;
+	}
+	else if(j->status == QUEUED){ //start a queued job right away, bypassing 'admit'
+		j->status = FOREGROUND;
+		print_job(j, out);
+		launch_job(j, false);
+	}
+	else{ //if job found
+		signal_block(SIGCHLD); //block signal
+		int ret_status = killpg(j->pid, SIGCONT); //send continue signal
+		if(ret_status >= 0){ //signal success
+			trace_record(TRACE_CONTINUE, j->jid, j->pid, SIGCONT, NULL);
+			start_stopped_job(j->jid); //remove jid from stopped_jobs array
+			j->held = 0; //throttling and admission control only apply in the background
+			j->status = FOREGROUND; //set job status to foreground first, so that fgboost does not lower the job itself
+			give_terminal_to_job(j); //give terminal to job
+			print_job(j, out); //print job
+			wait_for_job(j); //wait for job completion
+			restore_background_jobs(); //job finished or stopped, undo fgboost
+			set_job_status(j); //$? is the job's
+			if(j->num_processes_alive == 0){ //finished rather than stopped
+				forget_job(j);
 			}
-			termstate_give_terminal_back_to_shell(); //give terminal back to shell
+		}
+		else{ //signal failure
+			fprintf(out, "fg on job: %d was unsuccessful\n", jid);
+		}
+		signal_unblock(SIGCHLD); //unblock signal
+		termstate_give_terminal_back_to_shell(); //return terminal to shell
+	}
+	
+}
+
+/*bg built-in*/
+static void builtin_bg(int argc, char** argv, FILE* out){
+	
+	//job variables
+	struct job* j = NULL;
+	int jid = 0;
+	
+	if(argc == 1){ //if 1 argument 'bg'
+		//get job from last stopped job
+		if(num_stop_job > 0){ //if there is atleat 1 stopped job, retrieve it
+			j = get_job_from_jid(stopped_jobs[num_stop_job-1]);
+			jid = j->jid;
+		}
+		else{ //no stopped jobs
+			fprintf(out, "There are currently no stopped jobs\n");
+			return;
 		}
 	}
-	else if(strcmp(*cmd_argv, "prompt") == 0){ //custom prompt built-in
-		if(argc == 1){ //if 1 argument, print current prompt format
-			printf("The current prompt expression is: \'%s\'\n", custom_prompt);
+	else if(argc == 2){ //if 2 arguments 'bg [jid]'
+		jid = atoi(*(argv + 1)); //retrieve jid
+		j = get_job_from_jid(jid); //get job from jid
+		if(j == NULL){ //if job wasn't found
+			fprintf(out, "No job matching jid\n");
+			return;
 		}
-		else if(argc == 2){ //if 2 arguments, set prompt passed in format
-			custom_prompt = *(cmd_argv + 1);
-			printf("Set the prompt expression to: \'%s\'\n", custom_prompt);
+		else if(j->status == QUEUED){ //start a queued job right away, bypassing 'admit'
+			j->status = BACKGROUND;
+			launch_job(j, true);
+			return;
 		}
-		else{ //if incorrect arguments to prompt
-			printf("Incorrect number of arguments for command 'prompt'\n");
+		else if(j->status != STOPPED){ //if job is already running
+			fprintf(out, "Job: %d is already running\n", jid);
+			return;
 		}
 	}
-	else{ //execute other program
-		execute(pipe);
+	else{ //error for incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'bg'\n");
+		return;
+	}
+		
+	if(j == NULL){ //if job was found
+		fprintf(out, "There are currently no stopped jobs\n");
+		return;
+	}
+	else{ //if job found
+		int ret_status = killpg(j->pid, SIGCONT); //send continue signal
+		if(ret_status >= 0){ //signal success
+			trace_record(TRACE_CONTINUE, j->jid, j->pid, SIGCONT, NULL);
+			start_stopped_job(j->jid); //remove job from stopped jobs array
+			j->held = 0; //the next throttle or admit tick decides again
+			j->status = BACKGROUND; //set background status
+			print_job(j, out); //print job
+		}
+		else{ //signal failure
+			fprintf(out, "bg on job: %d was unsuccessful\n", jid);
+		}
+		termstate_give_terminal_back_to_shell(); //give terminal back to shell
 	}
 }
 
-int main(int ac, char *av[]){
-    int opt;
-
-    /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "h")) > 0) {
-        switch (opt) {
-        case 'h':
-            usage(av[0]);
-            break;
-        }
-    }
+/*cpu placement built-in, the prefix form is handled in run_pipeline*/
+static void builtin_pin(int argc, char** argv, FILE* out){
+	char policy[1024];
+	if(argc == 1){ //if 1 argument, print the default policy and the topology used by 'spread'
+		affinity_format_policy(&shell_affinity, policy, sizeof policy);
+		fprintf(out, "Default placement policy: %s\n", policy);
+		affinity_print_topology(out);
+	}
+	else if(argc == 3){ //'pin -p policy', set the default policy for later jobs
+		if(affinity_parse_policy(*(argv + 2), &shell_affinity)){
+			affinity_format_policy(&shell_affinity, policy, sizeof policy);
+			fprintf(out, "Set the default placement policy to: %s\n", policy);
+		}
+		else{
+			fprintf(out, "pin: invalid policy '%s'\n", *(argv + 2));
+		}
+	}
+	else{ //if incorrect arguments to pin
+		fprintf(out, "Usage: pin [-p none|spread|cpulist[:cpulist]...] | pin spread|cpulist[:cpulist]... command\n");
+	}
+}
 
-    list_init(&job_list);
+/*foreground priority boost built-in*/
+static void builtin_fgboost(int argc, char** argv, FILE* out){
+	if(argc == 1){ //if 1 argument, print current setting
+		if(fgboost_penalty == 0){
+			fprintf(out, "fgboost is off\n");
+		}
+		else{
+			fprintf(out, "fgboost is on, background jobs are lowered by %d while a job runs in the foreground\n", fgboost_penalty);
+		}
+	}
+	else if(strcmp(*(argv + 1), "off") == 0 && argc == 2){ //turn boost off
+		fgboost_penalty = 0;
+	}
+	else if(strcmp(*(argv + 1), "on") == 0 && argc <= 3){ //turn boost on, optionally with a nice increment
+		int penalty = argc == 3 ? atoi(*(argv + 2)) : 10;
+		if(penalty < 1 || penalty > 39){
+			fprintf(out, "fgboost: nice increment must be between 1 and 39\n");
+			return;
+		}
+		fgboost_penalty = penalty;
+		
+		//unprivileged users may only lower nice values down to 20 - RLIMIT_NICE
+		struct rlimit nice_limit;
+		int shell_nice = getpriority(PRIO_PROCESS, 0);
+		if(geteuid() != 0 && getrlimit(RLIMIT_NICE, &nice_limit) == 0
+		   && nice_limit.rlim_cur != RLIM_INFINITY && 20 - (int) nice_limit.rlim_cur > shell_nice){
+			fprintf(out, "fgboost: warning: restoring priorities requires CAP_SYS_NICE or RLIMIT_NICE >= %d\n", 20 - shell_nice);
+		}
+	}
+	else{ //if incorrect arguments to fgboost
+		fprintf(out, "Usage: fgboost [on [increment]|off]\n");
+	}
+}
+
+/*bytecode built-in, turns compiling compound commands and scripts on or off*/
+static void builtin_bytecode(int argc, char** argv, FILE* out){
+	if(argc == 1){ //if 1 argument, print current setting
+		fprintf(out, "bytecode is %s\n", bytecode_on ? "on" : "off");
+	}
+	else if(argc == 2 && strcmp(*(argv + 1), "on") == 0){ //compile control flow, and run assignments and simple commands straight from the compiled words
+		bytecode_on = true;
+	}
+	else if(argc == 2 && strcmp(*(argv + 1), "off") == 0){ //walk the syntax tree of compound commands, running each command from a copy of its tree
+		bytecode_on = false;
+	}
+	else{ //if incorrect arguments to bytecode
+		fprintf(out, "Usage: bytecode [on|off]\n");
+	}
+}
+
+/*source built-in, also called '.': runs a script in the shell itself, with any further words as its positional parameters*/
+static void builtin_source(int argc, char** argv, FILE* out){
+	if(argc < 2){
+		fprintf(out, "Usage: %s FILE [args]\n", *argv);
+		set_status(2);
+		return;
+	}
+	if(!run_script(*(argv + 1), argc > 2 ? argv + 2 : NULL)){
+		fprintf(out, "%s: %s: %s\n", *argv, *(argv + 1), strerror(errno));
+		set_status(1);
+	}
+}
+
+/*cpu throttling built-in*/
+static void builtin_throttle(int argc, char** argv, FILE* out){
+	if(argc == 1){ //if 1 argument, list throttled jobs
+		for (struct list_elem * e = list_begin(&job_list); 
+		e != list_end(&job_list); 
+		e = list_next(e)) {
+			struct job* j = list_entry(e, struct job, elem);
+			if(j->throttle_fd != -1){
+				fprintf(out, "[%d]\t%d%% of a CPU, period %lld ms\n", j->jid, j->throttle_percent, j->throttle_period_ns / 1000000);
+			}
+		}
+	}
+	else if(argc == 3 || argc == 4){ //'throttle jid percent [period_ms]' or 'throttle jid off'
+		int jid = atoi(*(argv + 1)); //convert jid from argv to int
+		struct job* j = get_job_from_jid(jid); //retrieve job from jid
+		int percent = strcmp(*(argv + 2), "off") == 0 ? 100 : atoi(*(argv + 2));
+		int period_ms = argc == 4 ? atoi(*(argv + 3)) : THROTTLE_PERIOD_MS;
+		if(j == NULL){ //error if job was not found
+			fprintf(out, "jid: %d was not found among the current jobs\n", jid);
+		}
+		else if(j->status == QUEUED){ //no processes to throttle yet
+			fprintf(out, "Job: %d has not been started yet\n", jid);
+		}
+		else if(percent < 1 || percent > 100){
+			fprintf(out, "throttle: percent must be between 1 and 100\n");
+		}
+		else if(period_ms < 1){
+			fprintf(out, "throttle: period must be at least 1 ms\n");
+		}
+		else if(percent == 100){ //no limit, remove the throttle
+			throttle_stop(j);
+		}
+		else{
+			throttle_start(j, percent, period_ms);
+		}
+	}
+	else{ //if incorrect arguments to throttle
+		fprintf(out, "Usage: throttle [jid percent [period_ms] | jid off]\n");
+	}
+}
+
+/*pressure-aware admission of background jobs built-in*/
+static void builtin_admit(int argc, char** argv, FILE* out){
+	struct pressure_policy policy;
+	if(argc == 1){ //if 1 argument, print the thresholds and the current pressure
+		pressure_print(&admission, out);
+	}
+	else if(argc == 2 && strcmp(*(argv + 1), "off") == 0){ //turn admission control off
+		admission_stop();
+	}
+	else if(pressure_parse_policy(&policy, argv + 1)){ //'admit [cpu=pct] [mem=pct] [load=n] [stop]'
+		admission_start(&policy);
+	}
+	else{ //if incorrect arguments to admit, message already printed
+		fprintf(out, "Usage: admit [off | [cpu=percent] [mem=percent] [load=n] [stop]]\n");
+	}
+}
+
+/*history built-in*/
+static void builtin_history(int argc, char** argv, FILE* out){
+	if(argc <= 2){ //'history [n]', print the last n entries, or all of them
+		int size = history_log_size();
+		int n = argc == 2 ? atoi(*(argv + 1)) : size;
+		for(int i = n < size ? size - n : 0; i < size; i++){
+			char* entry = history_log_entry(i);
+			fprintf(out, "%5d  %s\n", i + 1, entry);
+			free(entry);
+		}
+	}
+	else{ //error if incorrect number of arguments
+		fprintf(out, "Incorrect number of arguments for command 'history'\n");
+	}
+}
+
+/*trace built-in*/
+static void builtin_trace(int argc, char** argv, FILE* out){
+	if(argc == 1){ //'trace', how much has been recorded
+		unsigned long count = trace_count();
+		fprintf(out, "%lu events recorded, the last %lu are kept\n", count, count < TRACE_RING_SIZE ? count : TRACE_RING_SIZE);
+		fprintf(out, "%lu signal mask changes\n", signal_mask_changes());
+	}
+	else if(argc == 3 && strcmp(*(argv + 1), "dump") == 0){ //'trace dump file.json', in Chrome's trace-event format
+		if(!trace_dump(*(argv + 2))){
+			fprintf(out, "trace: cannot write %s: %s\n", *(argv + 2), strerror(errno));
+		}
+	}
+	else{ //error if incorrect arguments
+		fprintf(out, "Usage: trace [dump <file.json>]\n");
+	}
+}
+
+/*joblog built-in*/
+static void builtin_joblog(int argc, char** argv, FILE* out){
+	if(argc == 1){ //'joblog', the setting and the captured jobs
+		if(joblog_size > 0){
+			fprintf(out, "joblog on, last %zu KB of each background job\n", joblog_size / 1024);
+		}
+		else{
+			fprintf(out, "joblog off\n");
+		}
+		job_log_list(out);
+	}
+	else if(strcmp(*(argv + 1), "on") == 0 && argc <= 3){ //'joblog on [KB]'
+		long kb = argc == 3 ? atol(*(argv + 2)) : JOB_LOG_DEFAULT_SIZE / 1024;
+		if(kb <= 0 || kb > JOB_LOG_MAX_SIZE / 1024){
+			fprintf(out, "joblog: size must be between 1 and %d KB\n", JOB_LOG_MAX_SIZE / 1024);
+			return;
+		}
+		joblog_size = kb * 1024;
+	}
+	else if(strcmp(*(argv + 1), "off") == 0 && argc == 2){ //captured jobs keep their logs
+		joblog_size = 0;
+	}
+	else if(strcmp(*(argv + 1), "-d") == 0 && argc == 3){ //'joblog -d <jid>', discard a log
+		job_log_forget(atoi(*(argv + 2)));
+	}
+	else if(argc == 2){ //'joblog <jid>', the output captured so far
+		int jid = atoi(*(argv + 1));
+		if(!job_log_print(jid, out)){
+			fprintf(out, "joblog: no output captured for job %d\n", jid);
+		}
+	}
+	else{ //error if incorrect arguments
+		fprintf(out, "Usage: joblog [on [KB] | off | <jid> | -d <jid>]\n");
+	}
+}
+
+/*custom prompt built-in*/
+static void builtin_prompt(int argc, char** argv, FILE* out){
+	if(argc == 1){ //if 1 argument, print current prompt format
+		fprintf(out, "The current prompt expression is: \'%s\'\n", custom_prompt);
+	}
+	else if(argc == 2){ //if 2 arguments, set prompt passed in format
+		if(custom_prompt != default_prompt){ //replaced by an earlier 'prompt'
+			free(custom_prompt);
+		}
+		custom_prompt = strdup(*(argv + 1)); //argv is freed with the job when the builtin is part of a pipeline
+		fprintf(out, "Set the prompt expression to: \'%s\'\n", custom_prompt);
+	}
+	else{ //if incorrect arguments to prompt
+		fprintf(out, "Incorrect number of arguments for command 'prompt'\n");
+	}
+}
+
+/*a builtin command; 'out' is the terminal, a redirected file, or a pipe to the next command of a pipeline*/
+struct builtin {
+	const char* name;
+	void (*run)(int argc, char** argv, FILE* out);
+	bool in_pipeline; //false for builtins that take over the terminal or the shell, which only run on their own
+};
+
+static const struct builtin builtins[] = {
+	{ "exit", builtin_exit, false },
+	{ "export", builtin_export, true },
+	{ "unset", builtin_unset, true },
+	{ "alias", builtin_alias, true },
+	{ "unalias", builtin_unalias, true },
+	{ "kill", builtin_kill, true },
+	{ "stop", builtin_stop, true },
+	{ "jobs", builtin_jobs, true },
+	{ "fg", builtin_fg, false },
+	{ "bg", builtin_bg, false },
+	{ "pin", builtin_pin, true },
+	{ "fgboost", builtin_fgboost, true },
+	{ "bytecode", builtin_bytecode, true },
+	{ "source", builtin_source, false },
+	{ ".", builtin_source, false },
+	{ "throttle", builtin_throttle, true },
+	{ "admit", builtin_admit, true },
+	{ "history", builtin_history, true },
+	{ "trace", builtin_trace, true },
+	{ "joblog", builtin_joblog, true },
+	{ "prompt", builtin_prompt, true },
+	{ NULL, NULL, false }
+};
+
+/*returns the builtin called name, or NULL if there is none*/
+static const struct builtin* find_builtin(const char* name){
+	for(int i = 0; builtins[i].name != NULL; i++){
+		if(strcmp(builtins[i].name, name) == 0){
+			return &builtins[i];
+		}
+	}
+	return NULL;
+}
+
+/*runs builtin b with the words of argv, writing to out*/
+static void call_builtin(const struct builtin* b, char** argv, FILE* out){
+	int argc = 0;
+	while(*(argv + argc) != NULL){
+		argc++;
+	}
+	b->run(argc, argv, out);
+	if(__fpending(out) > 0){ //most builtins in a loop print nothing, and then there is nothing to flush
+		fflush(out);
+	}
+}
+
+/*runs a builtin that is a whole pipeline, writing to the pipeline's output redirection if there is one*/
+static void run_builtin(const struct builtin* b, char** argv, struct ast_pipeline* pipe){
+	if(pipe->iored_output == NULL){
+		call_builtin(b, argv, stdout);
+		return;
+	}
+	FILE* out = fopen(pipe->iored_output, pipe->append_to_output ? "ae" : "we");
+	if(out == NULL){
+		printf("%s: %s\n", pipe->iored_output, strerror(errno));
+		return;
+	}
+	call_builtin(b, argv, out);
+	fclose(out);
+}
+
+/*runs a builtin that is one stage of a pipeline, in the shell instead of a forked child; fd is where its output goes*/
+static void run_builtin_stage(const struct builtin* b, char** argv, int fd, bool last){
+	if(last && fd < 0){ //the last stage writes to the terminal, directly
+		call_builtin(b, argv, stdout);
+		return;
+	}
+	
+	//collect the output, then let a helper thread write it, so the shell never waits for the next stage to read
+	char* buf = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&buf, &len);
+	if(out == NULL){
+		utils_error("cannot run builtin '%s' in a pipeline: ", b->name);
+		return;
+	}
+	call_builtin(b, argv, out);
+	fclose(out);
+	pipe_writer_start(fcntl(fd, F_DUPFD_CLOEXEC, 0), buf, len); //close-on-exec, so no later child keeps the pipe open
+}
+
+/*runs a pipeline; returns true if it was started as a job, which then owns it*/
+static bool run_pipeline(struct ast_pipeline* pipe){
+	
+	if(list_entry(list_begin(&pipe->commands), struct ast_command, elem)->function_name != NULL){ //'name() group' only defines a function
+		define_function(pipe);
+		return false;
+	}
+	
+	//expand aliases, then variables and globs in every command and remove the quoting of glob characters
+	for (struct list_elem * e = list_begin(&pipe->commands); 
+	e != list_end(&pipe->commands); 
+	e = list_next(e)) {
+		struct ast_command* cmd = list_entry(e, struct ast_command, elem);
+		for(int depth = 0; depth < ALIAS_MAX_DEPTH && is_simple(cmd) && expand_alias(cmd); depth++){
+			; //the alias was defined as a command that starts with another one
+		}
+		if(is_simple(cmd)){
+			coproc_mark(cmd); //from the words as written: once expanded, a coprocess's fd is just a number
+		}
+		for(char** word = cmd->argv; *word != NULL; word++){
+			expand_variables(word);
+		}
+		cmd->argv = glob_expand_argv(cmd->argv);
+		
+		//a function call runs a copy of the function's parsed definition as a { } group; its words become the positional parameters
+		struct ast_command_line* function = is_simple(cmd) ? definitions_get(DEFINITION_FUNCTION, *cmd->argv) : NULL;
+		if(function != NULL){
+			cmd->group = ast_command_line_copy(function);
+			cmd->subshell = false;
+		}
+	}
+	if(pipe->iored_input != NULL){
+		expand_variables(&pipe->iored_input);
+		glob_unquote(pipe->iored_input);
+	}
+	if(pipe->iored_output != NULL){
+		expand_variables(&pipe->iored_output);
+		glob_unquote(pipe->iored_output);
+	}
+	
+	//parse pipeline for command arguments, determine validity of built-in commands, and retrieve job number for appropriate builtins;
+	//get frst command ni pipeline
+	struct ast_command* com = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+	//determnie how many arguments command has
+	char** cmd_argv = com->argv;
+	int argc = 0;
+	while(*(cmd_argv + argc) != NULL){
+		argc++;
+	}
+	
+	//builtin prefixes, which record settings for the job started by the rest of the command
+	char coproc_name[256]; //name of the coprocess, if the 'coproc' prefix is used
+	struct job_settings settings = { .limits = { .count = 0 }, .affinity = shell_affinity, .sched = { .set_policy = false, .set_nice = false }, .coproc_name = NULL };
+	set_status(2); //the status of a misused prefix, unless the pipeline gets to run below
+	
+	//a group or compound command on its own runs in the shell, unless it is a ( ) group that must not change the shell
+	if(!is_simple(com) && list_size(&pipe->commands) == 1 && !pipe->bg_job && !(com->subshell && changes_shell(com->group))){
+		run_group(com, pipe);
+		return false;
+	}
+	
+	while(is_simple(com)){ //a group takes no prefixes
+		if(strcmp(*cmd_argv, "limit") == 0){ //limit prefix, records rlimits
+			int used = resource_limits_parse(&settings.limits, cmd_argv + 1);
+			if(used < 0){ //invalid option, message already printed
+				return false;
+			}
+			if(used == argc - 1){ //no command following the options
+				resource_limits_usage();
+				return false;
+			}
+			strip_words(com, used + 1);
+			argc -= used + 1;
+		}
+		else if(strcmp(*cmd_argv, "pin") == 0 && argc >= 3 && strcmp(*(cmd_argv + 1), "-p") != 0){ //pin prefix, records cpu placement
+			if(!affinity_parse_policy(*(cmd_argv + 1), &settings.affinity)){
+				printf("pin: invalid cpu list '%s'\n", *(cmd_argv + 1));
+				return false;
+			}
+			strip_words(com, 2);
+			argc -= 2;
+		}
+		else if(strcmp(*cmd_argv, "sched") == 0 || strcmp(*cmd_argv, "nice") == 0){ //scheduling prefixes, record policy or nice value
+			int used = strcmp(*cmd_argv, "sched") == 0 ? job_sched_parse_policy(&settings.sched, cmd_argv + 1)
+			                                           : job_sched_parse_nice(&settings.sched, cmd_argv + 1);
+			if(used == JOB_SCHED_UNRECOGNIZED){ //options only nice(1) knows, so it runs as the program
+				break;
+			}
+			if(used < 0){ //invalid arguments, message already printed
+				return false;
+			}
+			if(used == argc - 1){ //no command following the arguments
+				printf("Usage: sched other|batch|idle|fifo|rr [priority] command\n"
+				       "       nice [-n adjustment | -adjustment] command\n");
+				return false;
+			}
+			strip_words(com, used + 1);
+			argc -= used + 1;
+		}
+		else if(strcmp(*cmd_argv, "coproc") == 0){ //coprocess prefix, runs the rest in the background connected to the shell
+			if(argc < 3 || !variables_valid_name(*(cmd_argv + 1), strlen(*(cmd_argv + 1)))){
+				printf("Usage: coproc NAME command\n");
+				return false;
+			}
+			if(pipe->iored_input != NULL || pipe->iored_output != NULL){
+				printf("coproc: a coprocess cannot redirect its input or output\n");
+				return false;
+			}
+			snprintf(coproc_name, sizeof coproc_name, "%s", *(cmd_argv + 1));
+			settings.coproc_name = coproc_name;
+			strip_words(com, 2);
+			argc -= 2;
+			pipe->bg_job = true;
+		}
+		else{ //no more prefixes
+			break;
+		}
+	}
+	
+	if(argc == 1 && list_size(&pipe->commands) == 1 && assign_variable(*cmd_argv, false)){
+		set_status(0);
+		return false; //'NAME=value' only sets a shell variable
+	}
+	
+	//a builtin on its own runs in the shell, writing to the output redirection if there is one
+	const struct builtin* b = find_builtin(command_name(com));
+	if(b != NULL && list_size(&pipe->commands) == 1){
+		set_status(0); //builtins succeed, except that fg takes the status of the job it waited for
+		run_builtin(b, cmd_argv, pipe);
+		return false;
+	}
+	
+	//builtins inside a pipeline are run by launch_job, except for those that take over the terminal or the shell
+	for (struct list_elem * e = list_begin(&pipe->commands); 
+	e != list_end(&pipe->commands); 
+	e = list_next(e)) {
+		struct ast_command* cmd = list_entry(e, struct ast_command, elem);
+		if(cmd->function_name != NULL){
+			printf("%s: a function cannot be defined in a pipeline\n", cmd->function_name);
+			return false;
+		}
+		b = find_builtin(command_name(cmd));
+		if(b != NULL && !b->in_pipeline){
+			printf("%s: cannot be used in a pipeline\n", b->name);
+			return false;
+		}
+	}
+	
+	execute(pipe, &settings);
+	return true;
+}
+
+/*runs the pipelines of a command line one after the other*/
+static void run_commands(struct ast_command_line* cline){
+	bool exec_last = exec_last_command;
+	signal_block(SIGCHLD); //once for all of them
+	for (struct list_elem * e = list_begin (&cline->pipes); 
+	e != list_end (&cline->pipes); 
+	e = list_next (e)) {
+		struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+		if((pipe->connector == AST_AND && last_status != 0) || (pipe->connector == AST_OR && last_status == 0)){
+			continue; //short-circuited: not even expanded, and $? stays that of the pipeline that decided it
+		}
+		exec_last_command = exec_last && list_next(e) == list_end(&cline->pipes);
+		struct list_elem* prev = list_prev(e);
+		list_remove(e); //taken out first: a job owns it from then on, and a foreground job may already have freed it when run_pipeline returns
+		if(run_pipeline(pipe)){ //send pipeline to get processed
+			e = prev;
+		}
+		else{
+			list_insert(list_next(prev), e);
+		}
+		clear_finished_jobs(); //free background jobs that finished meanwhile, rather than only at the prompt
+	}
+	exec_last_command = false;
+	signal_unblock(SIGCHLD);
+}
+
+/*returns true if running the commands of a group in the shell could change the shell: they run builtins, functions or aliases, start a coprocess or background jobs, or set variables*/
+static bool changes_shell(struct ast_command_line* cline){
+	for (struct list_elem * e = list_begin(&cline->pipes); 
+	e != list_end(&cline->pipes); 
+	e = list_next(e)) {
+		struct ast_pipeline* pipe = list_entry(e, struct ast_pipeline, elem);
+		if(pipe->bg_job){
+			return true;
+		}
+		for (struct list_elem * c = list_begin(&pipe->commands); 
+		c != list_end(&pipe->commands); 
+		c = list_next(c)) {
+			struct ast_command* cmd = list_entry(c, struct ast_command, elem);
+			if(cmd->function_name != NULL){
+				return true;
+			}
+			if(cmd->compound != NULL){ //loops usually set variables
+				return true;
+			}
+			if(cmd->group != NULL){ //a nested ( ) group protects the shell by itself
+				if(!cmd->subshell && changes_shell(cmd->group)){
+					return true;
+				}
+				continue;
+			}
+			if(find_builtin(*cmd->argv) != NULL || strcmp(*cmd->argv, "coproc") == 0 || strchr(*cmd->argv, '=') != NULL
+			   || definitions_get(DEFINITION_FUNCTION, *cmd->argv) != NULL || definitions_get(DEFINITION_ALIAS, *cmd->argv) != NULL){
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/*moves fd to target for the duration of a group, returning a copy of what target was, or -1 if fd could not be opened*/
+static int redirect_shell_fd(int fd, int target, const char* path){
+	if(fd == -1){
+		printf("%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	int saved = fcntl(target, F_DUPFD_CLOEXEC, 10);
+	dup2(fd, target);
+	close(fd);
+	return saved;
+}
+
+/*puts back an fd moved by redirect_shell_fd*/
+static void restore_shell_fd(int saved, int target){
+	if(saved != -1){
+		dup2(saved, target);
+		close(saved);
+	}
+}
+
+/*runs a group in the shell itself, with the group's redirections applied to the shell's own stdin and stdout while it runs;
+a group that has words is a function call, which runs with them as its positional parameters*/
+static void run_group(struct ast_command* cmd, struct ast_pipeline* pipe){
+	bool call = *cmd->argv != NULL;
+	if(call && function_depth == FUNCTION_MAX_DEPTH){
+		printf("%s: maximum function nesting level exceeded (%d)\n", *cmd->argv, FUNCTION_MAX_DEPTH);
+		return;
+	}
+	int saved_in = -1, saved_out = -1, saved_err = -1;
+	fflush(stdout);
+	if(pipe->iored_input != NULL){
+		saved_in = redirect_shell_fd(open(pipe->iored_input, O_RDONLY), STDIN_FILENO, pipe->iored_input);
+		if(saved_in == -1){
+			return;
+		}
+	}
+	if(pipe->iored_output != NULL){
+		int flags = O_WRONLY | O_CREAT | (pipe->append_to_output ? O_APPEND : O_TRUNC);
+		saved_out = redirect_shell_fd(open(pipe->iored_output, flags, 0666), STDOUT_FILENO, pipe->iored_output);
+		if(saved_out == -1){
+			restore_shell_fd(saved_in, STDIN_FILENO);
+			return;
+		}
+	}
+	if(cmd->dup_stderr_to_stdout){
+		saved_err = redirect_shell_fd(dup(STDOUT_FILENO), STDERR_FILENO, "stderr");
+	}
+	
+	char** saved_params = NULL;
+	if(call){
+		saved_params = save_params();
+		set_params(cmd->argv + 1);
+		function_depth++;
+	}
+	if(cmd->compound != NULL){
+		run_compound(cmd->compound);
+	}
+	else{
+		run_commands(cmd->group);
+	}
+	if(call){
+		function_depth--;
+		set_params(saved_params);
+		for(char** word = saved_params; word != NULL && *word != NULL; word++){
+			free(*word);
+		}
+		free(saved_params);
+	}
+	
+	fflush(stdout);
+	fflush(stderr);
+	restore_shell_fd(saved_err, STDERR_FILENO);
+	restore_shell_fd(saved_out, STDOUT_FILENO);
+	restore_shell_fd(saved_in, STDIN_FILENO);
+}
+
+/*runs a group in the process forked for it by launch_job, whose stdin and stdout are already set up, then exits; without job control, the commands it starts stay in its process group*/
+static void run_subshell(struct ast_command* cmd){
+	//the jobs and event sources that were copied from the shell belong to the shell
+	list_init(&job_list);
+	memset(jid2job, 0, sizeof jid2job);
+	num_stop_job = 0;
+	num_finished_jobs = 0;
+	current_jid = 0;
+	finished_fd = -1;
+	event_loop_forget_all();
+	termstate_detach();
+	job_control = false;
+	if(*cmd->argv != NULL){ //a function call in a pipeline or the background
+		set_params(cmd->argv + 1);
+	}
+	
+	exec_last_command = true;
+	if(cmd->compound != NULL){
+		run_compound(cmd->compound);
+	}
+	else{
+		run_commands(cmd->group);
+	}
+	fflush(stdout);
+	exit(last_status);
+}
+
+//builtin prefixes handled in run_pipeline, offered by tab completion along with the builtins
+static const char* prefix_names[] = {
+	"limit", "sched", "nice", "coproc", NULL
+};
+
+/*returns a malloc'd copy of the path of the program that execvp would run for name, or NULL if it is not found
+in the directories of PATH that come before the first relative one, which depends on the working directory*/
+static char* find_program(const char* name){
+	const char* path = variables_get("PATH");
+	if(path == NULL || strchr(name, '/') != NULL){
+		return NULL;
+	}
+	size_t name_len = strlen(name);
+	const char* dir = path;
+	while(*dir == '/'){
+		size_t len = strcspn(dir, ":");
+		char* program = malloc(len + name_len + 2);
+		memcpy(program, dir, len);
+		*(program + len) = '/';
+		memcpy(program + len + 1, name, name_len + 1);
+		if(access(program, X_OK) == 0){
+			return program;
+		}
+		free(program);
+		dir += len;
+		if(*dir == ':'){
+			dir++;
+		}
+	}
+	return NULL;
+}
+
+/*looks up what the command of a slot of prog is; only builtins and programs found in PATH have a fast path,
+commands that are aliases, functions or prefixes run through run_pipeline*/
+static void resolve_slot(struct bytecode_program* prog, size_t index){
+	struct bytecode_slot* slot = prog->slots + index;
+	const char* name = bytecode_constant(prog, *(prog->slot_names + index));
+	bool same_path = slot->path_changes == path_changes;
+	slot->generation = definitions_generation();
+	slot->path_changes = path_changes;
+	if(definitions_defined(name)){
+		free(slot->path);
+		slot->path = NULL;
+		slot->builtin = NULL;
+		return;
+	}
+	if(slot->builtin != NULL || (slot->path != NULL && same_path)){ //what changed was the definition of another name, as an rc file defining one after another does, or PATH, which builtins do not depend on
+		return;
+	}
+	free(slot->path);
+	slot->path = NULL;
+	if(strcmp(name, "pin") == 0){
+		return;
+	}
+	for(int i = 0; prefix_names[i] != NULL; i++){
+		if(strcmp(prefix_names[i], name) == 0){
+			return;
+		}
+	}
+	slot->builtin = find_builtin(name);
+	if(slot->builtin == NULL){
+		slot->path = find_program(name);
+	}
+}
+
+/*writes n in decimal into the bytes before end, NUL-terminated, and returns its first digit or sign; for a loop over {M..N}, snprintf would cost more than the rest of a turn*/
+static char* format_long(long n, char* end){
+	unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+	*--end = '\0';
+	do{
+		*--end = '0' + u % 10;
+		u /= 10;
+	}while(u != 0);
+	if(n < 0){
+		*--end = '-';
+	}
+	return end;
+}
+
+/*returns a malloc'd copy of word with its variables expanded*/
+static char* expand_copy(const char* word){
+	return strchr(word, '$') != NULL ? variables_expand(word) : strdup(word);
+}
+
+/*returns a malloc'd copy of constant index of prog with its variables expanded*/
+static char* expand_constant(struct bytecode_program* prog, uint32_t index){
+	return expand_copy(bytecode_constant(prog, index));
+}
+
+/*returns where prog remembers finding the variable named by constant index, NULL if it does not*/
+static struct variables_hint* hint_of(struct bytecode_program* prog, uint32_t index){
+	return prog->hints != NULL ? prog->hints + index : NULL;
+}
+
+/*runs the simple command of a BC_COMMAND instruction: a builtin straight from its words, anything else as a pipeline whose program is already found*/
+static void run_slot(struct bytecode_program* prog, const uint32_t* insn){
+	uint32_t index = BC_ARG(*insn);
+	uint32_t argc = BC_WORDS(*(insn + 1));
+	struct bytecode_slot* slot = prog->slots + index;
+	if(slot->generation != definitions_generation() || slot->path_changes != path_changes){
+		resolve_slot(prog, index);
+	}
+	
+	if(slot->builtin != NULL && (*(insn + 1) & BC_LITERAL)){ //the words are the constants as they are, copied to the stack rather than the heap, since builtins may change their words
+		const char* constants[argc];
+		size_t lengths[argc];
+		size_t size = 0;
+		for(uint32_t i = 0; i < argc; i++){
+			*(constants + i) = bytecode_constant(prog, *(insn + 2 + i));
+			*(lengths + i) = strlen(*(constants + i)) + 1;
+			size += *(lengths + i);
+		}
+		char* argv[argc + 1];
+		char words[size];
+		char* at = words;
+		for(uint32_t i = 0; i < argc; i++){
+			*(argv + i) = memcpy(at, *(constants + i), *(lengths + i));
+			at += *(lengths + i);
+		}
+		*(argv + argc) = NULL;
+		set_status(0);
+		call_builtin(slot->builtin, argv, stdout);
+		return;
+	}
+	
+	char** argv = malloc((argc + 1) * sizeof *argv);
+	if(slot->builtin != NULL){ //expand variables and globs
+		for(uint32_t i = 0; i < argc; i++){
+			*(argv + i) = expand_constant(prog, *(insn + 2 + i));
+		}
+		*(argv + argc) = NULL;
+		argv = glob_expand_argv(argv);
+		set_status(0);
+		call_builtin(slot->builtin, argv, stdout);
+		for(char** word = argv; *word != NULL; word++){
+			free(*word);
+		}
+		free(argv);
+		return;
+	}
+	
+	for(uint32_t i = 0; i < argc; i++){ //run_pipeline expands them
+		*(argv + i) = strdup(bytecode_constant(prog, *(insn + 2 + i)));
+	}
+	*(argv + argc) = NULL;
+	struct ast_command* cmd = ast_command_create(argv, false);
+	cmd->path = slot->path != NULL ? strdup(slot->path) : NULL;
+	struct ast_pipeline* pipe = ast_pipeline_create(NULL, NULL, false);
+	ast_pipeline_add_command(pipe, cmd);
+	if(!run_pipeline(pipe)){
+		ast_pipeline_free(pipe);
+	}
+}
+
+/*runs a compiled program in the shell, until its end or until ^C interrupted a job it started*/
+static void run_program(struct bytecode_program* prog){
+	struct frame{ //of a loop or case command that is running
+		int status; //of a loop: 0 until its body ran, then the status the body left
+		char** values; //of a for loop over words
+		size_t next; //index of the next of the values
+		bool counting; //true for a loop over {M..N}, which counts from next_number to last_number
+		bool counted; //true once it gave last_number, which may be LONG_MAX, so next_number does not go past it
+		long next_number, last_number, step;
+		char* subject; //of a case command
+	} frames[prog->max_depth + 1];
+	struct frame* frame = frames; //frames[0] is unused
+	const uint32_t* code = prog->code;
+	const uint32_t* pc = code;
+	bool done = false;
+	
+	exec_last_command = false; //the same command may run again, so it cannot take the place of a subshell
+	signal_block(SIGCHLD);
+	while(!done){
+		uint32_t a = BC_ARG(*pc);
+		switch(BC_OP(*pc)){
+		case BC_PIPELINE:{
+			struct ast_pipeline* pipe = bytecode_decode_pipeline(prog, pc + 1);
+			if(!run_pipeline(pipe)){
+				ast_pipeline_free(pipe);
+			}
+			clear_finished_jobs();
+			pc += 1 + a;
+			done = last_status == 128 + SIGINT;
+			break;
+		}
+		case BC_DEFINE: //decoded when it is first called, from the program or the mapped script it is part of
+			definitions_set_compiled(DEFINITION_FUNCTION, bytecode_constant(prog, *(pc + 1)), bytecode_share(prog), pc);
+			set_status(0);
+			pc += 1 + a;
+			break;
+		case BC_COMMAND:
+			run_slot(prog, pc);
+			clear_finished_jobs();
+			pc += 2 + BC_WORDS(*(pc + 1));
+			done = last_status == 128 + SIGINT;
+			break;
+		case BC_ASSIGN:{
+			const char* name = bytecode_constant(prog, a);
+			char* value = expand_constant(prog, *(pc + 1));
+			glob_unquote(value);
+			variables_set_hinted(name, value, hint_of(prog, a));
+			variable_changed(name);
+			free(value);
+			set_status(0);
+			pc += 2;
+			break;
+		}
+		case BC_COPY:{
+			const char* name = bytecode_constant(prog, a);
+			const char* value = variables_get_hinted(bytecode_constant(prog, *(pc + 1)), hint_of(prog, *(pc + 1)));
+			variables_set_hinted(name, value != NULL ? value : "", hint_of(prog, a));
+			variable_changed(name);
+			set_status(0);
+			pc += 2;
+			break;
+		}
+		case BC_JUMP:
+			pc = code + a;
+			break;
+		case BC_JUMP_FALSE:
+			pc = last_status != 0 ? code + a : pc + 1;
+			break;
+		case BC_JUMP_TRUE:
+			pc = last_status == 0 ? code + a : pc + 1;
+			break;
+		case BC_STATUS:
+			set_status(a);
+			pc++;
+			break;
+		case BC_LOOP:
+			frame++;
+			memset(frame, 0, sizeof *frame);
+			pc++;
+			break;
+		case BC_KEEP:
+			frame->status = last_status;
+			pc++;
+			break;
+		case BC_LOOP_END:
+			set_status(frame->status);
+			frame--;
+			pc++;
+			break;
+		case BC_FOR:
+			frame->values = malloc((a + 1) * sizeof *frame->values);
+			for(uint32_t i = 0; i < a; i++){
+				*(frame->values + i) = expand_constant(prog, *(pc + 1 + i));
+			}
+			*(frame->values + a) = NULL;
+			frame->values = glob_expand_argv(frame->values);
+			pc += 1 + a;
+			break;
+		case BC_RANGE:
+			frame->counting = true;
+			frame->next_number = atol(bytecode_constant(prog, a));
+			frame->last_number = atol(bytecode_constant(prog, *(pc + 1)));
+			frame->step = frame->next_number <= frame->last_number ? 1 : -1;
+			pc += 2;
+			break;
+		case BC_NEXT:{
+			char number[24];
+			const char* value = NULL;
+			if(frame->counting && !frame->counted){
+				value = format_long(frame->next_number, number + sizeof number);
+				frame->counted = frame->next_number == frame->last_number;
+				frame->next_number += frame->counted ? 0 : frame->step;
+			}
+			else if(!frame->counting && *(frame->values + frame->next) != NULL){
+				value = *(frame->values + frame->next++);
+			}
+			if(value == NULL){ //after the last value
+				for(char** word = frame->values; word != NULL && *word != NULL; word++){
+					free(*word);
+				}
+				free(frame->values);
+				frame->values = NULL;
+				pc = code + *(pc + 1);
+				break;
+			}
+			const char* name = bytecode_constant(prog, a);
+			variables_set_hinted(name, value, hint_of(prog, a));
+			variable_changed(name);
+			pc += 2;
+			break;
+		}
+		case BC_CASE:
+			frame++;
+			memset(frame, 0, sizeof *frame);
+			frame->subject = expand_constant(prog, a);
+			glob_unquote(frame->subject);
+			set_status(0); //unless the commands of a pattern that matches run
+			pc++;
+			break;
+		case BC_MATCH:{
+			char* pattern = expand_constant(prog, a);
+			bool matches = glob_match(pattern, frame->subject);
+			free(pattern);
+			pc = matches ? code + *(pc + 1) : pc + 2;
+			break;
+		}
+		case BC_ESAC:
+			free(frame->subject);
+			frame--;
+			pc++;
+			break;
+		case BC_RETURN:
+			done = true;
+			break;
+		}
+	}
+	
+	for(; frame > frames; frame--){ //those left by ^C
+		for(char** value = frame->values; value != NULL && *value != NULL; value++){
+			free(*value);
+		}
+		free(frame->values);
+		free(frame->subject);
+	}
+	signal_unblock(SIGCHLD);
+}
+
+/*runs a copy of a part of a compound command, since running a command line expands its words in place and frees what jobs took*/
+static void walk_list(struct ast_command_line* cline){
+	struct ast_command_line* copy = ast_command_line_copy(cline);
+	run_commands(copy);
+	ast_command_line_free(copy);
+}
+
+/*true if word is {M..N}, which a for loop counts through, and stores M and N*/
+static bool parse_range(const char* word, long* first, long* last){
+	char* end;
+	if(*word != '{' || !(isdigit((unsigned char)*(word + 1)) || *(word + 1) == '-')){
+		return false;
+	}
+	*first = strtol(word + 1, &end, 10);
+	if(strncmp(end, "..", 2) != 0 || !(isdigit((unsigned char)*(end + 2)) || *(end + 2) == '-')){
+		return false;
+	}
+	*last = strtol(end + 2, &end, 10);
+	return strcmp(end, "}") == 0;
+}
+
+/*runs a for loop from its syntax tree, for walk_compound*/
+static void walk_for(struct ast_compound* compound){
+	long first = 0, last = 0;
+	char** values = NULL;
+	bool counting = *compound->words != NULL && *(compound->words + 1) == NULL && parse_range(*compound->words, &first, &last);
+	if(!counting){
+		size_t n = 0;
+		while(*(compound->words + n) != NULL){
+			n++;
+		}
+		values = malloc((n + 1) * sizeof *values);
+		for(size_t i = 0; i < n; i++){
+			*(values + i) = expand_copy(*(compound->words + i));
+		}
+		*(values + n) = NULL;
+		values = glob_expand_argv(values);
+	}
+	
+	int status = 0; //unless the body runs
+	long next = first;
+	bool counted = false; //true once it gave last
+	for(size_t i = 0; ; i++){
+		char number[24];
+		const char* value;
+		if(counting){
+			if(counted){
+				break;
+			}
+			value = format_long(next, number + sizeof number);
+			counted = next == last;
+			next += counted ? 0 : first <= last ? 1 : -1;
+		}
+		else if((value = *(values + i)) == NULL){
+			break;
+		}
+		variables_set(compound->variable, value, false);
+		variable_changed(compound->variable);
+		walk_list(compound->body);
+		status = last_status;
+		if(status == 128 + SIGINT){
+			break;
+		}
+	}
+	
+	for(char** value = values; value != NULL && *value != NULL; value++){
+		free(*value);
+	}
+	free(values);
+	set_status(status);
+}
+
+/*runs an if, while, until, for or case command by walking its syntax tree, running each part from a fresh copy, as 'bytecode off' does for comparison with the compiled program*/
+static void walk_compound(struct ast_compound* compound){
+	switch(compound->kind){
+	case AST_IF:
+		walk_list(compound->condition);
+		if(last_status == 128 + SIGINT){
+			break;
+		}
+		if(last_status == 0){
+			walk_list(compound->body);
+		}
+		else if(compound->else_part != NULL){
+			walk_list(compound->else_part);
+		}
+		else{
+			set_status(0); //no branch ran
+		}
+		break;
+	case AST_WHILE:
+	case AST_UNTIL:{
+		int status = 0; //unless the body runs
+		for(;;){
+			walk_list(compound->condition);
+			if(last_status == 128 + SIGINT){
+				return;
+			}
+			if((last_status == 0) != (compound->kind == AST_WHILE)){
+				break;
+			}
+			walk_list(compound->body);
+			status = last_status;
+			if(status == 128 + SIGINT){
+				break;
+			}
+		}
+		set_status(status);
+		break;
+	}
+	case AST_FOR:
+		walk_for(compound);
+		break;
+	case AST_CASE:{
+		char* subject = expand_copy(compound->subject);
+		glob_unquote(subject);
+		set_status(0); //unless the commands of a pattern that matches run
+		bool matched = false;
+		for (struct list_elem * e = list_begin(&compound->items);
+		!matched && e != list_end(&compound->items);
+		e = list_next(e)) {
+			struct ast_case_item* item = list_entry(e, struct ast_case_item, elem);
+			for(char** pattern = item->patterns; !matched && *pattern != NULL; pattern++){
+				char* expanded = expand_copy(*pattern);
+				matched = glob_match(expanded, subject);
+				free(expanded);
+			}
+			if(matched){
+				walk_list(item->body);
+			}
+		}
+		free(subject);
+		break;
+	}
+	}
+}
+
+/*runs an if, while, until, for or case command in the shell, compiled for as long as it runs, or walked with 'bytecode off'*/
+static void run_compound(struct ast_compound* compound){
+	if(!bytecode_on){
+		walk_compound(compound);
+		return;
+	}
+	struct bytecode_program* prog = bytecode_compile_compound(compound, true);
+	run_program(prog);
+	bytecode_free(prog);
+}
+
+/*the directory compiled scripts are cached in: $CUSH_CACHE_DIR, where an empty value turns the cache off, else cush under $XDG_CACHE_HOME or ~/.cache*/
+static char* script_cache_dir(void){
+	const char* dir = variables_get("CUSH_CACHE_DIR");
+	char* path = NULL;
+	if(dir != NULL){
+		return *dir != '\0' ? strdup(dir) : NULL;
+	}
+	if((dir = variables_get("XDG_CACHE_HOME")) != NULL && *dir == '/'){
+		asprintf(&path, "%s/cush", dir);
+	}
+	else if((dir = variables_get("HOME")) != NULL && *dir == '/'){
+		asprintf(&path, "%s/.cache/cush", dir);
+	}
+	return path;
+}
+
+/*runs the script at path in the shell, from its compiled copy in the cache when that is current; with argv, the script gets its words as positional parameters.
+returns false with errno set if the script cannot be read*/
+static bool run_script(const char* path, char** argv){
+	if(function_depth == FUNCTION_MAX_DEPTH){
+		printf("%s: maximum function nesting level exceeded (%d)\n", path, FUNCTION_MAX_DEPTH);
+		set_status(1);
+		return true;
+	}
+	char* dir = script_cache_dir();
+	struct bytecode_program* prog = script_cache_load(path, dir, bytecode_on);
+	free(dir);
+	startup_profile_mark("load script");
+	if(prog == NULL){
+		if(errno != 0){
+			return false;
+		}
+		fprintf(stderr, "%s: syntax error\n", path);
+		set_status(2);
+		return true;
+	}
+	
+	char** saved_params = NULL;
+	if(argv != NULL){
+		saved_params = save_params();
+		set_params(argv);
+	}
+	function_depth++;
+	run_program(prog);
+	function_depth--;
+	if(argv != NULL){
+		set_params(saved_params);
+		for(char** word = saved_params; word != NULL && *word != NULL; word++){
+			free(*word);
+		}
+		free(saved_params);
+	}
+	bytecode_free(prog);
+	return true;
+}
+
+/*readline generator for the ids of the current jobs*/
+static char*
+job_id_generator(const char* text, int state)
+{
+	static struct list_elem* e; //next job to look at
+	if(state == 0){ //first call for this completion
+		e = list_begin(&job_list);
+	}
+	while(e != list_end(&job_list)){
+		struct job* j = list_entry(e, struct job, elem);
+		e = list_next(e);
+		char jid[16];
+		snprintf(jid, sizeof jid, "%d", j->jid);
+		if(strncmp(jid, text, strlen(text)) == 0){
+			return strdup(jid);
+		}
+	}
+	return NULL;
+}
+
+/*readline completion: commands in command position, job ids after job control builtins, file names elsewhere*/
+static char**
+complete_word(const char* text, int start, int end)
+{
+	//find where the command containing the word begins
+	int cmd_start = start;
+	while(cmd_start > 0 && strchr("|;&", rl_line_buffer[cmd_start - 1]) == NULL){
+		cmd_start--;
+	}
+	while(cmd_start < start && rl_line_buffer[cmd_start] == ' '){
+		cmd_start++;
+	}
+	
+	if(cmd_start == start){ //completing the command itself
+		if(strchr(text, '/') != NULL){ //a path, let readline complete file names
+			return NULL;
+		}
+		rl_attempted_completion_over = 1; //a command that is not found must not turn into a file name
+		if(!commands_indexed){ //reading every PATH directory would take most of the shell's startup, so it waits for the first Tab
+			completion_set_path(variables_get("PATH") ? variables_get("PATH") : "/usr/bin:/bin");
+			commands_indexed = true;
+		}
+		return completion_command_matches(text);
+	}
+	
+	//job ids for the builtins that take one
+	static const char* job_builtins[] = { "fg", "bg", "kill", "stop", "throttle", NULL };
+	int cmd_len = strcspn(rl_line_buffer + cmd_start, " ");
+	for(int i = 0; job_builtins[i] != NULL; i++){
+		if(cmd_len == strlen(job_builtins[i]) && strncmp(rl_line_buffer + cmd_start, job_builtins[i], cmd_len) == 0){
+			rl_attempted_completion_over = 1;
+			return rl_completion_matches(text, job_id_generator);
+		}
+	}
+	return NULL;
+}
+
+/*reads a command line for a shell that is not interactive, a byte at a time so that the commands it runs find stdin just after their line, returns NULL at the end of input*/
+static char* read_line(void){
+	size_t len = 0;
+	size_t capacity = 128;
+	char* line = malloc(capacity);
+	if(line == NULL){
+		utils_fatal_error("out of memory reading a line: ");
+	}
+	int c;
+	while((c = event_loop_getc(stdin)) != EOF && c != '\n'){
+		if(len + 1 == capacity){
+			capacity *= 2;
+			line = realloc(line, capacity);
+			if(line == NULL){
+				utils_fatal_error("out of memory reading a line: ");
+			}
+		}
+		*(line + len++) = c;
+	}
+	if(c == EOF && len == 0){
+		free(line);
+		return NULL;
+	}
+	*(line + len) = '\0';
+	return line;
+}
+
+int main(int ac, char *av[]){
+    int opt;
+    static struct option long_options[] = {
+        { "startup-profile", no_argument, NULL, 'P' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    startup_profile_begin();
+    /* Process command-line arguments. See getopt(3) */
+    while ((opt = getopt_long(ac, av, "+h", long_options, NULL)) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(av[0]);
+            break;
+        case 'P':
+            startup_profile_enable();
+            break;
+        }
+    }
+    interactive = optind == ac && isatty(0);
+    startup_profile_mark("arguments");
+
+    list_init(&job_list);
+    variables_init(environ); //the variable table owns the environment from here on
+    set_status(0);
+    startup_profile_mark("variables");
+    trace_init(); //before any job is started, so children inherit the ring
     signal_set_handler(SIGCHLD, sigchld_handler);
-    termstate_init();
+    startup_profile_mark("trace and signals");
+	
+	//only an interactive shell has job control, and thus needs the terminal
+	if(interactive){
+		termstate_init();
+		startup_profile_mark("terminal");
+	}
+	else{
+		termstate_detach();
+		job_control = false;
+	}
+	
+	//'cush script args' runs the script with its args as $1, $2, ... and exits with its status
+	if(optind < ac){
+		set_params(av + optind + 1);
+		if(!run_script(*(av + optind), NULL)){
+			fprintf(stderr, "%s: %s: %s\n", av[0], *(av + optind), strerror(errno));
+			return 127;
+		}
+		startup_profile_report("exit");
+		return last_status;
+	}
+	
+	//persistent history, only for interactive shells
+	if(interactive){
+		char history_path[4096];
+		if(getenv("HISTFILE") != NULL){
+			snprintf(history_path, sizeof history_path, "%s", getenv("HISTFILE"));
+		}
+		else{
+			snprintf(history_path, sizeof history_path, "%s/.cush_history", getenv("HOME") ? getenv("HOME") : ".");
+		}
+		history_log_open(history_path);
+		rl_bind_key(CTRL('r'), history_log_reverse_search); //search the indexed log instead of readline's list
+		startup_profile_mark("history");
+		
+		//tab completion from an in-memory index of PATH, kept current with inotify once the first Tab builds it
+		for(int i = 0; builtins[i].name != NULL; i++){
+			completion_add_builtin(builtins[i].name);
+		}
+		for(int i = 0; prefix_names[i] != NULL; i++){
+			completion_add_builtin(prefix_names[i]);
+		}
+		rl_attempted_completion_function = complete_word;
+		startup_profile_mark("completion");
+		
+		finished_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+	
+	//an interactive shell starts with the commands in $CUSHRC or ~/.cushrc
+	if(interactive){
+		char rc_path[4096];
+		if(getenv("CUSHRC") != NULL){
+			snprintf(rc_path, sizeof rc_path, "%s", getenv("CUSHRC"));
+		}
+		else{
+			snprintf(rc_path, sizeof rc_path, "%s/.cushrc", getenv("HOME") ? getenv("HOME") : ".");
+		}
+		if(!run_script(rc_path, NULL) && errno != ENOENT){
+			fprintf(stderr, "%s: %s\n", rc_path, strerror(errno));
+		}
+		startup_profile_mark("run rc file");
+		
+		rl_change_environment = 0; //so readline does not setenv LINES and COLUMNS behind its back
+		rl_getc_function = event_loop_getc; //service timers and other events while waiting for input
+		rl_initialize();
+		startup_profile_mark("readline");
+	}
 
-	int com_num = 0;
     /* Read/eval loop. */
     for (;;) {
+		
+		report_finished_jobs(); //Done and Exit notices of background jobs, then forget all finished jobs
 
         /* Do not output a prompt unless shell's stdin is a terminal */
-        char * prompt = isatty(0) ? build_prompt(&com_num) : NULL;
-        char * cmdline = readline(prompt);
+        char * prompt = NULL;
+		if(interactive){
+			prompt = build_prompt(&command_number);
+			startup_profile_report("prompt");
+		}
+		trace_record(TRACE_PROMPT, 0, 0, command_number, NULL);
+		if(finished_fd != -1){ //report jobs that finish while the user is typing right away
+			event_loop_add_fd(finished_fd, report_at_prompt, NULL);
+		}
+        char * cmdline = interactive ? readline(prompt) : read_line();
+		if(finished_fd != -1){
+			event_loop_remove_fd(finished_fd);
+		}
         free (prompt);
 
         if (cmdline == NULL)  /* User typed EOF */
             break;
+		
+		if(interactive){ //record the command
+			history_log_add(cmdline);
+		}
 
         struct ast_command_line * cline = ast_parse_command_line(cmdline);
+		CUSH_PROBE2(parse_done, cline, cline != NULL ? list_size(&cline->pipes) : -1);
         free (cmdline);
         if (cline == NULL){                  /* Error in command line */
+            set_status(2);
             continue;
 		}	
 
@@ -837,28 +3544,12 @@ int main(int ac, char *av[]){
         }
 		
 		//loop through pipelines in the command line
-		for (struct list_elem * e = list_begin (&cline->pipes); 
-		e != list_end (&cline->pipes); 
-		e = list_next (e)) {
-			struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
-			run_pipeline(pipe); //send pipeline to get processed
-		}
-		
-		if(list_empty(&job_list) == false){
-			struct list_elem* e = list_begin(&job_list);
-			for(int i = 0; i < list_size(&job_list); i++){
-				struct job* j = list_entry(e, struct job, elem);
-				if(j->num_processes_alive == 0){
-					list_remove(&j->elem);
-					delete_job(j);
-				}
-				e = list_next(e);
-			}
-		}
+		run_commands(cline);
 		
 		//ast_command_line_print(cline);
-        //ast_command_line_free(cline);
+        ast_command_line_free(cline); //the pipelines that became jobs are no longer in it
     }
-    return 0;
+	startup_profile_report("exit");
+    return interactive ? 0 : last_status;
 }
 
@@ -1,2 +1,25 @@
 = Tests for Custom Features
 1 gback_glob_test.py
+1 limit_test.py
+1 affinity_test.py
+1 sched_test.py
+1 throttle_test.py
+1 history_test.py
+1 completion_test.py
+1 recursive_glob_test.py
+1 variables_test.py
+1 coproc_test.py
+1 builtin_pipe_test.py
+1 notify_test.py
+1 trace_test.py
+1 joblog_test.py
+1 terminal_syscalls_test.py
+1 signal_mask_test.py
+1 group_test.py
+1 andor_test.py
+1 function_test.py
+1 control_test.py
+1 source_test.py
+1 startup_test.py
+1 fgboost_test.py
+1 admit_test.py
@@ -0,0 +1,261 @@
+/*
+ * Aliases and shell functions.
+ *
+ * A definition is kept as the command line its text parsed into, in
+ * a chained hash table per kind, so that using it costs a lookup and
+ * a copy of the tree rather than lexing and parsing its text again.
+ * The caller runs the copy, which, like any command line the shell
+ * runs, has its words expanded in place and is freed with its jobs.
+ * A definition given only as text, or as compiled code, is parsed or
+ * decoded when it is first looked up, so that an rc file defining many
+ * aliases and functions does not build those a session never uses.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "definitions.h"
+#include "utils.h"
+
+struct definition {
+    struct definition *next;    /* in the same bucket */
+    char *name;
+    uint32_t hash;
+    struct ast_command_line *body;  /* NULL until built from 'text' or 'prog' */
+    char *text;                 /* may be NULL */
+    bool invalid;               /* 'text' does not parse into a command */
+    struct bytecode_program *prog;  /* a reference, until decoded */
+    const uint32_t *at;         /* the BC_DEFINE in 'prog' */
+};
+
+struct table {
+    struct definition **buckets;
+    size_t size;                /* power of 2 */
+    size_t count;
+};
+
+static struct table tables[2];
+static unsigned long generation = 1;  /* bumped by every change */
+
+static uint32_t
+hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (; *name; name++)
+        h = (h ^ (unsigned char) *name) * 16777619u;
+    return h;
+}
+
+/* Return the link that points to the definition of 'name', or the
+ * NULL link at the end of its bucket */
+static struct definition **
+find_link(struct table *t, const char *name, uint32_t hash)
+{
+    struct definition **link = &t->buckets[hash & (t->size - 1)];
+    while (*link != NULL
+           && ((*link)->hash != hash || strcmp((*link)->name, name) != 0))
+        link = &(*link)->next;
+    return link;
+}
+
+static void
+grow_table(struct table *t)
+{
+    struct definition **old = t->buckets;
+    size_t old_size = t->size;
+
+    t->size = old_size ? 2 * old_size : DEFINITIONS_INITIAL_BUCKETS;
+    t->buckets = calloc(t->size, sizeof *t->buckets);
+    if (t->buckets == NULL)
+        utils_fatal_error("out of memory growing a definition table: ");
+
+    for (size_t i = 0; i < old_size; i++) {
+        struct definition *d = old[i], *next;
+        for (; d != NULL; d = next) {
+            next = d->next;
+            struct definition **link = &t->buckets[d->hash & (t->size - 1)];
+            d->next = *link;
+            *link = d;
+        }
+    }
+    free(old);
+}
+
+/* Free what 'name' is defined as */
+static void
+clear_definition(struct definition *d)
+{
+    if (d->body != NULL)
+        ast_command_line_free(d->body);
+    if (d->prog != NULL)
+        bytecode_free(d->prog);
+    free(d->text);
+    d->body = NULL;
+    d->text = NULL;
+    d->invalid = false;
+    d->prog = NULL;
+}
+
+static void
+free_definition(struct definition *d)
+{
+    clear_definition(d);
+    free(d->name);
+    free(d);
+}
+
+/* Return the definition of 'name', empty, adding it if there is none */
+static struct definition *
+new_definition(enum definition_kind kind, const char *name)
+{
+    struct table *t = &tables[kind];
+    if (t->count >= t->size)
+        grow_table(t);
+
+    uint32_t hash = hash_name(name);
+    struct definition **link = find_link(t, name, hash);
+    struct definition *d = *link;
+    if (d == NULL) {
+        d = calloc(1, sizeof *d);
+        if (d == NULL)
+            utils_fatal_error("out of memory adding a definition: ");
+        d->name = strdup(name);
+        d->hash = hash;
+        *link = d;
+        t->count++;
+    } else {
+        clear_definition(d);
+    }
+    generation++;
+    return d;
+}
+
+void
+definitions_set(enum definition_kind kind, const char *name,
+                struct ast_command_line *body, const char *text)
+{
+    struct definition *d = new_definition(kind, name);
+    d->body = body;
+    d->text = text ? strdup(text) : NULL;
+}
+
+void
+definitions_set_compiled(enum definition_kind kind, const char *name,
+                         struct bytecode_program *prog, const uint32_t *at)
+{
+    struct definition *d = new_definition(kind, name);
+    d->prog = prog;
+    d->at = at;
+}
+
+struct ast_command_line *
+definitions_get(enum definition_kind kind, const char *name)
+{
+    struct table *t = &tables[kind];
+    if (t->count == 0)
+        return NULL;
+    struct definition *d = *find_link(t, name, hash_name(name));
+    if (d == NULL)
+        return NULL;
+    if (d->body == NULL && d->prog != NULL) {
+        d->body = bytecode_decode_function(d->prog, d->at);
+        bytecode_free(d->prog);
+        d->prog = NULL;
+    } else if (d->body == NULL && !d->invalid) {
+        d->body = ast_parse_command_line(d->text);
+        if (d->body != NULL && list_empty(&d->body->pipes)) {
+            ast_command_line_free(d->body);
+            d->body = NULL;
+        }
+        d->invalid = d->body == NULL;
+    }
+    return d->body;
+}
+
+bool
+definitions_defined(const char *name)
+{
+    struct table *aliases = &tables[DEFINITION_ALIAS];
+    struct table *functions = &tables[DEFINITION_FUNCTION];
+    if (aliases->count == 0 && functions->count == 0)
+        return false;
+    uint32_t hash = hash_name(name);
+    return (aliases->count > 0 && *find_link(aliases, name, hash) != NULL)
+        || (functions->count > 0 && *find_link(functions, name, hash) != NULL);
+}
+
+const char *
+definitions_text(enum definition_kind kind, const char *name)
+{
+    struct table *t = &tables[kind];
+    if (t->count == 0)
+        return NULL;
+    struct definition *d = *find_link(t, name, hash_name(name));
+    return d != NULL ? d->text : NULL;
+}
+
+bool
+definitions_remove(enum definition_kind kind, const char *name)
+{
+    struct table *t = &tables[kind];
+    if (t->count == 0)
+        return false;
+    struct definition **link = find_link(t, name, hash_name(name));
+    struct definition *d = *link;
+    if (d == NULL)
+        return false;
+    *link = d->next;
+    t->count--;
+    free_definition(d);
+    generation++;
+    return true;
+}
+
+void
+definitions_clear(enum definition_kind kind)
+{
+    struct table *t = &tables[kind];
+    for (size_t i = 0; i < t->size; i++) {
+        struct definition *d = t->buckets[i], *next;
+        for (; d != NULL; d = next) {
+            next = d->next;
+            free_definition(d);
+        }
+        t->buckets[i] = NULL;
+    }
+    t->count = 0;
+    generation++;
+}
+
+unsigned long
+definitions_generation(void)
+{
+    return generation;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+    return strcmp((*(struct definition **) a)->name,
+                  (*(struct definition **) b)->name);
+}
+
+void
+definitions_print(enum definition_kind kind, const char *prefix, FILE *out)
+{
+    struct table *t = &tables[kind];
+    struct definition **sorted = malloc((t->count + 1) * sizeof *sorted);
+    if (sorted == NULL)
+        utils_fatal_error("out of memory listing definitions: ");
+
+    size_t n = 0;
+    for (size_t i = 0; i < t->size; i++)
+        for (struct definition *d = t->buckets[i]; d != NULL; d = d->next)
+            if (d->text != NULL)
+                sorted[n++] = d;
+    qsort(sorted, n, sizeof *sorted, compare_names);
+
+    for (size_t i = 0; i < n; i++)
+        fprintf(out, "%s%s='%s'\n", prefix, sorted[i]->name, sorted[i]->text);
+    free(sorted);
+}
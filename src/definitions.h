@@ -0,0 +1,59 @@
+#ifndef __DEFINITIONS_H
+#define __DEFINITIONS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "shell-ast.h"
+#include "bytecode.h"
+
+/* Initial number of buckets of each table, a power of 2 */
+#define DEFINITIONS_INITIAL_BUCKETS 32
+
+/* Aliases and functions have a name space each */
+enum definition_kind {
+    DEFINITION_ALIAS,
+    DEFINITION_FUNCTION,
+};
+
+/* Define 'name' as the already parsed 'body', which the table takes
+ * over, replacing and freeing an earlier definition.  'text' (copied,
+ * may be NULL) is what definitions_print shows for it.  If 'body' is
+ * NULL, it is parsed from 'text' when first looked up. */
+void definitions_set(enum definition_kind kind, const char *name,
+                     struct ast_command_line *body, const char *text);
+
+/* Define 'name' as the function that the BC_DEFINE instruction at 'at'
+ * in 'prog' defines, taking over the reference 'prog'; it is decoded
+ * when first looked up. */
+void definitions_set_compiled(enum definition_kind kind, const char *name,
+                              struct bytecode_program *prog, const uint32_t *at);
+
+/* Return the body 'name' is defined as, or NULL, also if its text
+ * does not parse into a command.  Running it expands and frees its
+ * words, so it is copied with ast_command_line_copy. */
+struct ast_command_line *definitions_get(enum definition_kind kind,
+                                         const char *name);
+
+/* Return whether 'name' is an alias or a function, without building
+ * what it is defined as */
+bool definitions_defined(const char *name);
+
+/* Return the text 'name' was defined with, or NULL */
+const char *definitions_text(enum definition_kind kind, const char *name);
+
+/* Remove the definition of 'name'; returns false if there is none */
+bool definitions_remove(enum definition_kind kind, const char *name);
+
+/* Remove all definitions of 'kind' */
+void definitions_clear(enum definition_kind kind);
+
+/* Return a number that changes whenever a definition does, so that
+ * what was looked up earlier can be known to be still valid */
+unsigned long definitions_generation(void);
+
+/* Print "'prefix'NAME='TEXT'" for each definition of 'kind' that has
+ * a text, sorted by name */
+void definitions_print(enum definition_kind kind, const char *prefix, FILE *out);
+
+#endif /* __DEFINITIONS_H */
@@ -0,0 +1,144 @@
+/*
+ * A minimal poll()-based event loop.
+ *
+ * The shell spends its time either in readline, waiting for input,
+ * or in wait_for_job, waiting for a foreground job.  Both places
+ * call into this module, so that timers and other file descriptors
+ * registered here are serviced no matter which one the shell is in.
+ */
+
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/signalfd.h>
+#include <readline/readline.h>
+
+#include "event_loop.h"
+#include "signal_support.h"
+#include "utils.h"
+
+struct event_source {
+    int fd;
+    event_callback_t callback;
+    void *ctx;
+};
+
+static struct event_source *sources;
+static int nsources;
+static int capacity;
+
+/* signalfd used by event_loop_wait_signal, created on first use */
+static int signal_fd = -1;
+static int signal_fd_sig;
+
+void
+event_loop_add_fd(int fd, event_callback_t callback, void *ctx)
+{
+    if (nsources == capacity) {
+        capacity = capacity ? 2 * capacity : 8;
+        sources = realloc(sources, capacity * sizeof *sources);
+        if (sources == NULL)
+            utils_fatal_error("out of memory growing event sources: ");
+    }
+    sources[nsources++] = (struct event_source) {
+        .fd = fd, .callback = callback, .ctx = ctx
+    };
+}
+
+void
+event_loop_remove_fd(int fd)
+{
+    for (int i = 0; i < nsources; i++) {
+        if (sources[i].fd == fd) {
+            sources[i] = sources[--nsources];
+            return;
+        }
+    }
+}
+
+void
+event_loop_forget_all(void)
+{
+    nsources = 0;
+}
+
+bool
+event_loop_active(void)
+{
+    return nsources > 0;
+}
+
+/* Poll all sources plus 'extra_fd'.  Dispatch ready sources and
+ * return true if 'extra_fd' is ready. */
+static bool
+poll_and_dispatch(int extra_fd)
+{
+    int n = nsources;
+    struct pollfd fds[n + 1];
+
+    for (int i = 0; i < n; i++)
+        fds[i] = (struct pollfd) { .fd = sources[i].fd, .events = POLLIN };
+    fds[n] = (struct pollfd) { .fd = extra_fd, .events = POLLIN };
+
+    int ready = poll(fds, n + 1, -1);
+    if (ready == -1) {
+        if (errno == EINTR)     /* e.g., SIGCHLD while at the prompt */
+            return false;
+        utils_fatal_error("poll failed: ");
+    }
+    if (ready == 1 && fds[n].revents != 0)  /* a keystroke, the usual case */
+        return true;
+
+    signal_block(SIGCHLD);
+    for (int i = 0; i < n; i++) {
+        if (fds[i].revents == 0)
+            continue;
+
+        /* An earlier callback may have removed this source. */
+        for (int j = 0; j < nsources; j++) {
+            if (sources[j].fd == fds[i].fd) {
+                sources[j].callback(sources[j].fd, sources[j].ctx);
+                break;
+            }
+        }
+    }
+    signal_unblock(SIGCHLD);
+
+    return fds[n].revents != 0;
+}
+
+int
+event_loop_getc(FILE *stream)
+{
+    while (nsources > 0) {
+        if (poll_and_dispatch(fileno(stream)))
+            break;
+    }
+    return rl_getc(stream);
+}
+
+void
+event_loop_wait_signal(int sig)
+{
+    assert(signal_is_blocked(sig));
+
+    if (signal_fd == -1) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, sig);
+        signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd == -1)
+            utils_fatal_error("signalfd failed: ");
+        signal_fd_sig = sig;
+    }
+    assert(signal_fd_sig == sig || !!!"only one signal is supported");
+
+    while (!poll_and_dispatch(signal_fd))
+        continue;
+
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof info) == sizeof info)
+        continue;
+}
@@ -0,0 +1,34 @@
+#ifndef __EVENT_LOOP_H
+#define __EVENT_LOOP_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Callback invoked when a registered file descriptor becomes readable
+ * (or is hung up).  Callbacks run with SIGCHLD blocked, so they may
+ * update the job list. */
+typedef void (*event_callback_t)(int fd, void *ctx);
+
+/* Watch 'fd' and call 'callback' with 'ctx' when it becomes readable */
+void event_loop_add_fd(int fd, event_callback_t callback, void *ctx);
+
+/* Stop watching 'fd'.  May be called from within a callback. */
+void event_loop_remove_fd(int fd);
+
+/* Stop watching every file descriptor, in a forked copy of the shell
+ * that must leave the shell's events to the shell */
+void event_loop_forget_all(void);
+
+/* Return true if any file descriptor is being watched */
+bool event_loop_active(void);
+
+/* Replacement for readline's rl_getc_function.  Dispatches events
+ * while the shell waits for the user to type. */
+int event_loop_getc(FILE *stream);
+
+/* Wait until signal 'sig', which the caller must have blocked, is
+ * pending, dispatching events in the meantime.  The pending signal
+ * is consumed.  Used by the shell while it waits for a foreground job. */
+void event_loop_wait_signal(int sig);
+
+#endif /* __EVENT_LOOP_H */
@@ -0,0 +1,65 @@
+#!/usr/bin/python
+#
+# Tests 'fgboost', which lowers the priority of background jobs while a
+# job runs in the foreground: 'fg' of a running background job must
+# not lower that job itself, and a job whose priority the shell may not
+# raise again stays lowered once, rather than by more each time.
+#
+import os
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+def nice_of(pid):
+    return int(open("/proc/%s/stat" % pid).read().split(') ')[1].split()[16])
+
+#################################################################
+# Step 1. A running background job brought to the foreground with
+# 'fg' keeps its priority; the command it starts then inherits it.
+#
+run_builtin('fgboost on 5')
+expect_prompt("Shell did not print expected prompt (2)")
+
+start_nice = os.nice(0)
+sendline('sh -c "sleep 1; cat /proc/self/stat" &')
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (3)")
+
+run_builtin('fg %s', jobid)
+assert console.expect(r'\d+ \(cat\) [^\r]*') == 0, "cat did not print its stat line"
+assert int(console.after.split()[18]) == start_nice, "fg lowered the priority of the job itself"
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 2. In a shell that may not raise priorities (no CAP_SYS_NICE,
+# RLIMIT_NICE 0), a background job is lowered by the penalty once,
+# however many foreground commands run after it.
+#
+unprivileged = 'prlimit --nice=0:0 %s' % os.path.abspath('cush')
+if os.getuid() == 0:
+    unprivileged = 'setpriv --bounding-set=-sys_nice --inh-caps=-sys_nice ' + unprivileged
+sendline(unprivileged)
+expect_prompt("The unprivileged shell did not print its prompt")
+
+sendline('fgboost on 5')
+expect_prompt("Shell did not print expected prompt (5)")
+
+sendline('sleep 30 &')
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (6)")
+
+for i in range(3):
+    sendline('/bin/true')
+    expect_prompt("Shell did not print expected prompt (%d)" % (7 + i))
+assert nice_of(pid) == min(start_nice + 5, 19), \
+    "background job is at nice %d after three foreground commands" % nice_of(pid)
+
+sendline('kill %s' % jobid)
+expect_prompt("Shell did not print expected prompt (10)")
+sendline('exit')
+expect_prompt("Shell did not print expected prompt (11)")
+
+test_success()
@@ -0,0 +1,95 @@
+#!/usr/bin/python
+#
+# Tests functions and aliases: calls run the stored definition with
+# the call's words as positional parameters, in the shell itself,
+# and aliases expand to their definition followed by the call's words.
+#
+import os, tempfile
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. A function sees its arguments as $1, $#, $@; they are
+# gone again after the call.
+#
+sendline('greet() { echo hello $1 of $# / $@; }')
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('greet world and all')
+expect_exact('hello world of 3 / world and all', "the function did not see its arguments")
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('echo after $# $1.')
+expect_exact('after $# $1.', "the arguments outlived the call")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 2. Calls run in the shell, so variables they set stay set,
+# and each call runs a fresh copy of the definition.
+#
+sendline('setter() { kept=$1; }')
+expect_prompt("Shell did not print expected prompt (5)")
+
+sendline('setter first; setter second; echo $kept')
+expect_exact('second', "the function did not run in the shell")
+expect_prompt("Shell did not print expected prompt (6)")
+
+#################################################################
+# Step 3. A function call can be a stage of a pipeline, and the
+# redirections of its definition apply to each call.
+#
+sendline('greet pipe | tr a-z A-Z')
+expect_exact('HELLO PIPE OF 1 / PIPE', "the function's output did not go through the pipe")
+expect_prompt("Shell did not print expected prompt (7)")
+
+out = tempfile.mktemp()
+sendline('logged() { echo into the file; } > %s' % out)
+expect_prompt("Shell did not print expected prompt (8)")
+
+sendline('logged; cat %s' % out)
+expect_exact('into the file', "the definition's redirection was not applied")
+expect_prompt("Shell did not print expected prompt (9)")
+
+#################################################################
+# Step 4. Aliases expand to their definition followed by the rest
+# of the words; one that refers to itself is expanded once.
+#
+sendline('alias say=echo said')
+expect_prompt("Shell did not print expected prompt (10)")
+
+sendline('say it')
+expect_exact('said it', "the alias was not expanded")
+expect_prompt("Shell did not print expected prompt (11)")
+
+sendline('alias "twice=echo one; echo"')
+expect_prompt("Shell did not print expected prompt (12)")
+
+sendline('twice two')
+expect_exact('one\r\ntwo', "the words did not go to the alias' last command")
+expect_prompt("Shell did not print expected prompt (13)")
+
+sendline('alias echo=echo -n')
+expect_prompt("Shell did not print expected prompt (14)")
+
+sendline('echo once; unalias echo; echo .')
+expect_exact('once.', "an alias that refers to itself was not expanded once")
+expect_prompt("Shell did not print expected prompt (15)")
+
+sendline('alias')
+expect_exact("alias say='echo said'\r\nalias twice='echo one; echo'", "the aliases were not listed")
+expect_prompt("Shell did not print expected prompt (16)")
+
+#################################################################
+# Step 5. Removed definitions are no longer found.
+#
+sendline('unset -f greet; unalias say; greet; say')
+expect_exact('no such file or directory\r\nno such file or directory', "removed definitions were still used")
+expect_prompt("Shell did not print expected prompt (17)")
+
+os.unlink(out)
+
+test_success()
@@ -0,0 +1,934 @@
+/*
+ * Glob expansion of command words.
+ *
+ * A word is split at '/' into components, and each component that
+ * contains '*', '?' or '[...]' is compiled into a short sequence of
+ * match operations.  Directories are read with getdents64 into a
+ * large buffer, and d_type tells which entries are directories, so
+ * that stat is only needed for symbolic links and file systems that
+ * do not report a type.
+ *
+ * Listings are cached and reused as long as the directory's mtime
+ * has not changed.  Since a file system may store timestamps with a
+ * coarse granularity, a listing taken within a second of the last
+ * modification of its directory is not reused.
+ *
+ * A '**' component matches any number of directories.  The tree
+ * below it is walked by a small pool of threads: each thread owns a
+ * deque of directories, pushes the subdirectories it finds onto one
+ * end and takes its next directory from there, and a thread that runs
+ * out of work steals from the other end of another thread's deque.
+ * Every thread collects matches in a list of its own, and the lists
+ * are merged and sorted after the walk, so that the result does not
+ * depend on how the work was scheduled.  The threads bypass the
+ * listing cache, which only the shell's thread uses.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "glob_expansion.h"
+#include "utils.h"
+
+/* The record format of getdents64 */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* ----------------------------------------------------------------
+ * Patterns
+ */
+enum glob_op_kind { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS };
+
+struct glob_op {
+    enum glob_op_kind kind;
+    unsigned char c;            /* OP_CHAR */
+    uint8_t set[32];            /* OP_CLASS, bitmap of matching bytes */
+};
+
+/* One '/'-separated component of a glob */
+struct glob_component {
+    struct glob_op *ops;
+    int nops;
+    bool has_meta;              /* false if the component is literal */
+    bool recursive;             /* the component is '**' */
+    char *literal;              /* unquoted text of a literal component */
+};
+
+static void
+add_op(struct glob_component *c, struct glob_op op)
+{
+    c->ops = realloc(c->ops, (c->nops + 1) * sizeof *c->ops);
+    if (c->ops == NULL)
+        utils_fatal_error("out of memory compiling a glob: ");
+    c->ops[c->nops++] = op;
+}
+
+/* Compile the bracket expression at 's', which points after the '['.
+ * Returns the end of the expression or NULL if there is no ']'. */
+static const char *
+compile_class(const char *s, const char *end, struct glob_op *op)
+{
+    bool negate = s < end && (*s == '!' || *s == '^');
+    if (negate)
+        s++;
+
+    *op = (struct glob_op) { .kind = OP_CLASS };
+    for (bool first = true; s < end && (*s != ']' || first); first = false) {
+        if (*s == GLOB_CTLESC && s + 1 < end)
+            s++;
+        unsigned char lo = *s++, hi = lo;
+        if (s + 1 < end && *s == '-' && s[1] != ']') {
+            s++;
+            if (*s == GLOB_CTLESC && s + 1 < end)
+                s++;
+            hi = *s++;
+        }
+        for (unsigned c = lo; c <= hi; c++)
+            op->set[c / 8] |= 1 << (c % 8);
+    }
+    if (s == end)
+        return NULL;
+
+    if (negate)
+        for (int i = 0; i < 32; i++)
+            op->set[i] = ~op->set[i];
+    return s + 1;
+}
+
+static void
+compile_component(const char *s, const char *end, struct glob_component *c)
+{
+    *c = (struct glob_component) { .ops = NULL };
+    c->recursive = end - s == 2 && s[0] == '*' && s[1] == '*';
+
+    while (s < end) {
+        struct glob_op op = { .kind = OP_CHAR };
+        const char *next;
+
+        if (*s == GLOB_CTLESC && s + 1 < end) {
+            op.c = s[1];
+            s += 2;
+        } else if (*s == '*') {
+            /* consecutive stars are the same as one */
+            s++;
+            if (c->nops > 0 && c->ops[c->nops - 1].kind == OP_STAR)
+                continue;
+            op.kind = OP_STAR;
+        } else if (*s == '?') {
+            op.kind = OP_ANY;
+            s++;
+        } else if (*s == '[' && (next = compile_class(s + 1, end, &op)) != NULL) {
+            s = next;
+        } else {
+            op.c = *s++;
+        }
+        c->has_meta |= op.kind != OP_CHAR;
+        add_op(c, op);
+    }
+
+    if (!c->has_meta) {
+        c->literal = malloc(c->nops + 1);
+        if (c->literal == NULL)
+            utils_fatal_error("out of memory compiling a glob: ");
+        for (int i = 0; i < c->nops; i++)
+            c->literal[i] = c->ops[i].c;
+        c->literal[c->nops] = '\0';
+    }
+}
+
+static bool
+op_matches(const struct glob_op *op, unsigned char ch)
+{
+    switch (op->kind) {
+    case OP_CHAR:
+        return op->c == ch;
+    case OP_CLASS:
+        return op->set[ch / 8] & (1 << (ch % 8));
+    default:
+        return true;
+    }
+}
+
+/* Match 'name' against a component, backtracking only to the last star */
+static bool
+component_matches(const struct glob_component *c, const char *name)
+{
+    /* Like sh, a leading '.' must be matched explicitly. */
+    if (name[0] == '.' && (c->nops == 0 || c->ops[0].kind != OP_CHAR))
+        return false;
+
+    int i = 0, star_i = -1;
+    const char *star_s = NULL;
+    while (*name) {
+        if (i < c->nops && c->ops[i].kind == OP_STAR) {
+            star_i = ++i;
+            star_s = name;
+        } else if (i < c->nops && op_matches(&c->ops[i], *name)) {
+            i++;
+            name++;
+        } else if (star_i != -1) {
+            i = star_i;
+            name = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while (i < c->nops && c->ops[i].kind == OP_STAR)
+        i++;
+    return i == c->nops;
+}
+
+/* ----------------------------------------------------------------
+ * Directory listings
+ */
+struct listing_entry {
+    uint32_t name;              /* offset into names */
+    unsigned char type;         /* d_type */
+};
+
+struct listing {
+    char *dir;                  /* the directory as named in the glob */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec listed_at;
+    char *names;
+    size_t names_size;
+    struct listing_entry *entries;
+    size_t nentries;
+    unsigned long last_used;
+    int pins;                   /* walks currently using this listing */
+    bool temporary;             /* not in the cache, freed when unpinned */
+};
+
+static struct listing cache[GLOB_CACHE_SIZE];
+static unsigned long use_counter;
+
+static void
+listing_free(struct listing *l)
+{
+    free(l->dir);
+    free(l->names);
+    free(l->entries);
+    *l = (struct listing) { .dir = NULL };
+}
+
+/* Read directory 'dir' into 'l', using 'buf', which holds
+ * GLOB_GETDENTS_BUFSIZE bytes.  Return false if it cannot be read. */
+static bool
+listing_read(struct listing *l, const char *dir, char *buf)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1)
+        return false;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+
+    *l = (struct listing) { .dev = st.st_dev, .ino = st.st_ino, .mtime = st.st_mtim };
+    clock_gettime(CLOCK_REALTIME, &l->listed_at);
+    size_t names_capacity = 0, entries_capacity = 0;
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, GLOB_GETDENTS_BUFSIZE)) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (buf + off);
+            off += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+                continue;
+
+            size_t len = strlen(d->d_name) + 1;
+            if (l->names_size + len > names_capacity) {
+                names_capacity = 2 * (names_capacity + len);
+                l->names = realloc(l->names, names_capacity);
+            }
+            if (l->nentries == entries_capacity) {
+                entries_capacity = entries_capacity ? 2 * entries_capacity : 64;
+                l->entries = realloc(l->entries, entries_capacity * sizeof *l->entries);
+            }
+            if (l->names == NULL || l->entries == NULL)
+                utils_fatal_error("out of memory reading directory %s: ", dir);
+
+            memcpy(l->names + l->names_size, d->d_name, len);
+            l->entries[l->nentries++] = (struct listing_entry) {
+                .name = l->names_size, .type = d->d_type
+            };
+            l->names_size += len;
+        }
+    }
+    close(fd);
+    l->dir = strdup(dir);
+    return true;
+}
+
+/* True if the listing may be reused for a directory with status 'st' */
+static bool
+listing_valid(struct listing *l, struct stat *st)
+{
+    return l->dev == st->st_dev && l->ino == st->st_ino
+        && l->mtime.tv_sec == st->st_mtim.tv_sec
+        && l->mtime.tv_nsec == st->st_mtim.tv_nsec
+        && l->listed_at.tv_sec > l->mtime.tv_sec + 1;
+}
+
+/* Return the listing of 'dir', from the cache if it is still valid.
+ * The listing stays valid until it is passed to listing_put. */
+static struct listing *
+listing_get(const char *dir)
+{
+    static char *buf;
+    struct stat st;
+    if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode))
+        return NULL;
+    if (buf == NULL && (buf = malloc(GLOB_GETDENTS_BUFSIZE)) == NULL)
+        return NULL;
+
+    /* Reuse the cached listing, else replace the least recently used
+     * one that no walk further up is looking at. */
+    struct listing *slot = NULL;
+    for (int i = 0; i < GLOB_CACHE_SIZE; i++) {
+        struct listing *l = &cache[i];
+        if (l->dir != NULL && strcmp(l->dir, dir) == 0 && listing_valid(l, &st)) {
+            l->last_used = ++use_counter;
+            l->pins++;
+            return l;
+        }
+        if (l->pins == 0 && (slot == NULL || l->last_used < slot->last_used))
+            slot = l;
+    }
+
+    bool temporary = slot == NULL;
+    if (temporary && (slot = malloc(sizeof *slot)) == NULL)
+        return NULL;
+    if (!temporary)
+        listing_free(slot);
+
+    if (!listing_read(slot, dir, buf)) {
+        if (temporary)
+            free(slot);
+        return NULL;
+    }
+    slot->last_used = ++use_counter;
+    slot->pins = 1;
+    slot->temporary = temporary;
+    return slot;
+}
+
+static void
+listing_put(struct listing *l)
+{
+    if (--l->pins == 0 && l->temporary) {
+        listing_free(l);
+        free(l);
+    }
+}
+
+/* ----------------------------------------------------------------
+ * Expansion
+ */
+struct glob_results {
+    char **paths;
+    size_t n, capacity;
+};
+
+/* Append 'path', which may be NULL, and take ownership of it */
+static void
+push_result(struct glob_results *r, char *path)
+{
+    if (r->n == r->capacity) {
+        r->capacity = r->capacity ? 2 * r->capacity : 16;
+        r->paths = realloc(r->paths, r->capacity * sizeof *r->paths);
+        if (r->paths == NULL)
+            utils_fatal_error("out of memory expanding a glob: ");
+    }
+    r->paths[r->n++] = path;
+}
+
+static void
+add_result(struct glob_results *r, const char *path, size_t len)
+{
+    push_result(r, strndup(path, len));
+}
+
+/* Append 'name' to path[0..len), return the new length or 0 if too long */
+static size_t
+path_append(char *path, size_t len, const char *name)
+{
+    size_t nlen = strlen(name);
+    bool slash = len > 0 && path[len - 1] != '/';
+    if (len + slash + nlen >= PATH_MAX)
+        return 0;
+    if (slash)
+        path[len++] = '/';
+    memcpy(path + len, name, nlen + 1);
+    return len + nlen;
+}
+
+static bool
+is_directory(const char *path, unsigned char d_type)
+{
+    struct stat st;
+    if (d_type == DT_DIR)
+        return true;
+    if (d_type != DT_LNK && d_type != DT_UNKNOWN)
+        return false;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void glob_walk(char *path, size_t len, struct glob_component *comps,
+                      int n, bool want_dir, struct glob_results *out, char *buf);
+
+/* Match comps[0], which has glob characters, against the entries of
+ * 'l', the listing of path[0..len), and expand the rest below them */
+static void
+walk_entries(struct listing *l, char *path, size_t len,
+             struct glob_component *comps, int n, bool want_dir,
+             struct glob_results *out, char *buf)
+{
+    struct glob_component *c = &comps[0];
+    bool last = n == 1;
+
+    for (size_t i = 0; i < l->nentries; i++) {
+        struct listing_entry *entry = &l->entries[i];
+        const char *name = l->names + entry->name;
+        if (!component_matches(c, name))
+            continue;
+
+        size_t newlen = path_append(path, len, name);
+        if (newlen == 0)
+            continue;
+        if ((!last || want_dir) && !is_directory(path, entry->type)) {
+            path[len] = '\0';
+            continue;
+        }
+        if (last)
+            add_result(out, path, newlen);
+        else
+            glob_walk(path, newlen, comps + 1, n - 1, want_dir, out, buf);
+        path[len] = '\0';
+    }
+}
+
+/* ----------------------------------------------------------------
+ * Recursive globs
+ */
+struct task_deque {
+    pthread_mutex_t lock;
+    char **dirs;                /* malloc'd paths, dirs[head..tail) are queued */
+    size_t head, tail, capacity;
+};
+
+struct worker {
+    struct task_deque deque;
+    struct glob_results results;
+    char *buf;                  /* getdents64 buffer */
+};
+
+/* The shell's thread is worker 0 and takes part in every walk. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* a walk started, work was queued, or a walk ended */
+    pthread_cond_t finished;    /* a thread is done with the current walk */
+    struct worker workers[GLOB_POOL_THREADS];
+    int nworkers;               /* 0 until the pool is started */
+    unsigned long walk_seq;     /* incremented for each walk */
+    unsigned long work_seq;     /* incremented when directories are queued */
+    int nfinished;              /* threads done with the current walk */
+    atomic_size_t pending;      /* directories queued or being visited */
+
+    /* the current walk: what follows the '**' */
+    struct glob_component *rest;
+    int nrest;
+    bool want_dir;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+deque_push(struct task_deque *d, char *dir)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->capacity && d->head > 0) {
+        memmove(d->dirs, d->dirs + d->head, (d->tail - d->head) * sizeof *d->dirs);
+        d->tail -= d->head;
+        d->head = 0;
+    }
+    if (d->tail == d->capacity) {
+        d->capacity = d->capacity ? 2 * d->capacity : 64;
+        d->dirs = realloc(d->dirs, d->capacity * sizeof *d->dirs);
+        if (d->dirs == NULL)
+            utils_fatal_error("out of memory walking a directory tree: ");
+    }
+    d->dirs[d->tail++] = dir;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/* Take the most recently queued directory, which is likely still cached */
+static char *
+deque_pop(struct task_deque *d)
+{
+    char *dir = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head)
+        dir = d->dirs[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+    return dir;
+}
+
+/* Take the oldest queued directory, which likely has the largest subtree */
+static char *
+deque_steal(struct task_deque *d)
+{
+    char *dir = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head)
+        dir = d->dirs[d->head++];
+    pthread_mutex_unlock(&d->lock);
+    return dir;
+}
+
+static void
+wake_workers(void)
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.work_seq++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/* Visit the directory path[0..len) of a '**' walk: expand the rest of
+ * the glob, comps[0..n), in it and continue with its subdirectories,
+ * which are queued for the pool if 'w' is set and visited directly
+ * otherwise.  Like the other components, '**' skips hidden names and
+ * does not follow symbolic links. */
+static void
+visit_tree(char *path, size_t len, struct glob_component *comps, int n,
+           bool want_dir, struct glob_results *out, char *buf, struct worker *w)
+{
+    struct listing l;
+    path[len] = '\0';
+    if (!listing_read(&l, len == 0 ? "." : path, buf))
+        return;
+
+    if (n > 0 && comps[0].has_meta)
+        walk_entries(&l, path, len, comps, n, want_dir, out, buf);
+    else if (n > 0)
+        glob_walk(path, len, comps, n, want_dir, out, buf);
+
+    bool queued = false;
+    for (size_t i = 0; i < l.nentries; i++) {
+        const char *name = l.names + l.entries[i].name;
+        if (name[0] == '.')
+            continue;
+
+        size_t newlen = path_append(path, len, name);
+        if (newlen == 0)
+            continue;
+
+        struct stat st;
+        unsigned char type = l.entries[i].type;
+        bool dir = type == DT_DIR
+                || (type == DT_UNKNOWN && lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+
+        /* a trailing '**' matches every name below */
+        if (n == 0 && (!want_dir || dir || is_directory(path, type)))
+            add_result(out, path, newlen);
+
+        if (dir && w != NULL) {
+            char *copy = strndup(path, newlen);
+            if (copy == NULL)
+                utils_fatal_error("out of memory walking a directory tree: ");
+            atomic_fetch_add(&pool.pending, 1);
+            deque_push(&w->deque, copy);
+            queued = true;
+        } else if (dir) {
+            visit_tree(path, newlen, comps, n, want_dir, out, buf, NULL);
+        }
+        path[len] = '\0';
+    }
+    listing_free(&l);
+
+    if (queued)
+        wake_workers();
+}
+
+/* Return the next directory for worker 'w', or NULL once the walk is done */
+static char *
+next_task(struct worker *w)
+{
+    int self = w - pool.workers;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        unsigned long seq = pool.work_seq;
+        pthread_mutex_unlock(&pool.lock);
+
+        char *dir = deque_pop(&w->deque);
+        for (int i = 1; dir == NULL && i < pool.nworkers; i++)
+            dir = deque_steal(&pool.workers[(self + i) % pool.nworkers].deque);
+        if (dir != NULL)
+            return dir;
+
+        /* Nothing to steal: wait for more work or the end of the walk. */
+        pthread_mutex_lock(&pool.lock);
+        while (pool.work_seq == seq && atomic_load(&pool.pending) > 0)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        bool done = atomic_load(&pool.pending) == 0;
+        pthread_mutex_unlock(&pool.lock);
+        if (done)
+            return NULL;
+    }
+}
+
+static void
+work(struct worker *w)
+{
+    char *dir;
+    while ((dir = next_task(w)) != NULL) {
+        char path[PATH_MAX];
+        size_t len = strlen(dir);
+        memcpy(path, dir, len + 1);
+        free(dir);
+
+        visit_tree(path, len, pool.rest, pool.nrest, pool.want_dir,
+                   &w->results, w->buf, w);
+        if (atomic_fetch_sub(&pool.pending, 1) == 1)
+            wake_workers();
+    }
+}
+
+static void *
+worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.walk_seq == seen)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        seen = pool.walk_seq;
+        pthread_mutex_unlock(&pool.lock);
+
+        work(w);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.nfinished++;
+        pthread_cond_signal(&pool.finished);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+/* Start the pool.  Its size is GLOB_POOL_THREADS, or $CUSH_GLOB_THREADS
+ * if that is smaller, which is meant for benchmarking. */
+static bool
+pool_start(void)
+{
+    int size = GLOB_POOL_THREADS;
+    char *env = getenv("CUSH_GLOB_THREADS");
+    if (env != NULL && atoi(env) > 0 && atoi(env) < size)
+        size = atoi(env);
+
+    if ((pool.workers[0].buf = malloc(GLOB_GETDENTS_BUFSIZE)) == NULL)
+        return false;
+    pthread_mutex_init(&pool.workers[0].deque.lock, NULL);
+    pool.nworkers = 1;
+
+    /* Block all signals in the threads, so that the SIGCHLD handler
+     * keeps running in the main thread. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    while (pool.nworkers < size) {
+        struct worker *w = &pool.workers[pool.nworkers];
+        pthread_t thread;
+        if ((w->buf = malloc(GLOB_GETDENTS_BUFSIZE)) == NULL)
+            break;
+        pthread_mutex_init(&w->deque.lock, NULL);
+        if (pthread_create(&thread, NULL, worker_thread, w) != 0) {
+            free(w->buf);
+            break;
+        }
+        pthread_detach(thread);
+        pool.nworkers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return true;
+}
+
+/* Expand a '**' at path[0..len), followed by comps[0..n), on the pool */
+static void
+walk_parallel(char *path, size_t len, struct glob_component *comps, int n,
+              bool want_dir, struct glob_results *out)
+{
+    if (pool.nworkers == 0 && !pool_start()) {
+        utils_error("cannot expand '**': ");
+        return;
+    }
+
+    char *root = strndup(path, len);
+    if (root == NULL)
+        utils_fatal_error("out of memory walking a directory tree: ");
+    pool.rest = comps;
+    pool.nrest = n;
+    pool.want_dir = want_dir;
+    atomic_store(&pool.pending, 1);
+    deque_push(&pool.workers[0].deque, root);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.nfinished = 0;
+    pool.walk_seq++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    work(&pool.workers[0]);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.nfinished < pool.nworkers - 1)
+        pthread_cond_wait(&pool.finished, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+
+    /* The caller sorts the merged results. */
+    for (int i = 0; i < pool.nworkers; i++) {
+        struct glob_results *r = &pool.workers[i].results;
+        for (size_t j = 0; j < r->n; j++)
+            push_result(out, r->paths[j]);
+        r->n = 0;
+    }
+    path[len] = '\0';
+}
+
+/* Expand the components comps[0..n) below the directory path[0..len).
+ * If 'want_dir' is set, the last component must name a directory.
+ * On the shell's thread, 'buf' is NULL and listings come from the
+ * cache; the pool's threads pass their getdents64 buffer instead. */
+static void
+glob_walk(char *path, size_t len, struct glob_component *comps, int n,
+          bool want_dir, struct glob_results *out, char *buf)
+{
+    struct glob_component *c = &comps[0];
+    bool last = n == 1;
+
+    if (c->recursive) {
+        if (buf == NULL)
+            walk_parallel(path, len, comps + 1, n - 1, want_dir, out);
+        else
+            visit_tree(path, len, comps + 1, n - 1, want_dir, out, buf, NULL);
+        return;
+    }
+
+    if (!c->has_meta) {
+        size_t newlen = path_append(path, len, c->literal);
+        if (newlen == 0)
+            return;
+        if (!last)
+            glob_walk(path, newlen, comps + 1, n - 1, want_dir, out, buf);
+        else if (want_dir ? is_directory(path, DT_UNKNOWN) : access(path, F_OK) == 0)
+            add_result(out, path, newlen);
+        path[len] = '\0';
+        return;
+    }
+
+    path[len] = '\0';
+    const char *dir = len == 0 ? "." : path;
+    if (buf != NULL) {
+        struct listing l;
+        if (listing_read(&l, dir, buf)) {
+            walk_entries(&l, path, len, comps, n, want_dir, out, buf);
+            listing_free(&l);
+        }
+        return;
+    }
+
+    struct listing *l = listing_get(dir);
+    if (l == NULL)
+        return;
+    walk_entries(l, path, len, comps, n, want_dir, out, NULL);
+    listing_put(l);
+}
+
+static int
+compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Expand 'word' and add the matches, sorted, to 'out'.  A word too
+ * long to be a path matches nothing and is left as it is. */
+static void
+expand_word(const char *word, struct glob_results *out)
+{
+    if (strlen(word) >= PATH_MAX)
+        return;
+
+    /* at most one component per '/', plus the last */
+    int ncomps = 1;
+    for (const char *s = word; *s != '\0'; s++)
+        if (*s == '/')
+            ncomps++;
+    struct glob_component *comps = malloc(ncomps * sizeof *comps);
+    if (comps == NULL)
+        utils_fatal_error("out of memory compiling a glob: ");
+
+    int n = 0;
+    char path[PATH_MAX];
+    size_t len = 0;
+
+    if (*word == '/')
+        path[len++] = '/';
+    path[len] = '\0';
+
+    const char *s = word;
+    while (*s != '\0') {
+        const char *end = s;
+        while (*end != '\0' && *end != '/')
+            end++;
+        if (end > s)
+            compile_component(s, end, &comps[n++]);
+        /* '**' followed by '**' is the same as one */
+        if (n > 1 && comps[n - 1].recursive && comps[n - 2].recursive) {
+            n--;
+            free(comps[n].ops);
+        }
+        s = *end == '/' ? end + 1 : end;
+    }
+    bool want_dir = s > word && s[-1] == '/';
+
+    size_t first = out->n;
+    if (n > 0)
+        glob_walk(path, len, comps, n, want_dir, out, NULL);
+    if (out->n > first)
+        qsort(out->paths + first, out->n - first, sizeof *out->paths, compare_paths);
+
+    /* "dir*" + "/" as typed */
+    if (want_dir) {
+        for (size_t i = first; i < out->n; i++) {
+            size_t plen = strlen(out->paths[i]);
+            out->paths[i] = realloc(out->paths[i], plen + 2);
+            strcpy(out->paths[i] + plen, "/");
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        free(comps[i].ops);
+        free(comps[i].literal);
+    }
+    free(comps);
+}
+
+bool
+glob_has_chars(const char *word)
+{
+    for (const char *s = word; *s; s++) {
+        if (*s == GLOB_CTLESC && s[1] != '\0')
+            s++;
+        else if (*s == '*' || *s == '?' || *s == '[')
+            return true;
+    }
+    return false;
+}
+
+size_t
+glob_quote_into(char *word, const char *s, size_t len)
+{
+    char *w = word;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == GLOB_CTLESC)
+            *w++ = GLOB_CTLESC;
+        *w++ = s[i];
+    }
+    *w = '\0';
+    return w - word;
+}
+
+char *
+glob_quote(const char *s, size_t len)
+{
+    char *word = malloc(2 * len + 1);
+    if (word == NULL)
+        utils_fatal_error("out of memory quoting a word: ");
+    glob_quote_into(word, s, len);
+    return word;
+}
+
+void
+glob_unquote(char *word)
+{
+    char *w = word;
+    for (char *s = word; *s; s++) {
+        if (*s == GLOB_CTLESC && s[1] != '\0')
+            s++;
+        *w++ = *s;
+    }
+    *w = '\0';
+}
+
+bool
+glob_match(const char *pattern, const char *string)
+{
+    /* fnmatch quotes with backslashes */
+    size_t len = strlen(pattern);
+    char *escaped = malloc(2 * len + 1), *e = escaped;
+    if (escaped == NULL)
+        utils_fatal_error("out of memory matching a pattern: ");
+    for (const char *s = pattern; *s; s++) {
+        bool quoted = *s == GLOB_CTLESC && s[1] != '\0';
+        if (quoted)
+            s++;
+        if (quoted || *s == '\\')
+            *e++ = '\\';
+        *e++ = *s;
+    }
+    *e = '\0';
+
+    bool match = fnmatch(escaped, string, 0) == 0;
+    free(escaped);
+    return match;
+}
+
+char **
+glob_expand_argv(char **argv)
+{
+    struct glob_results out = { .paths = NULL };
+
+    for (char **p = argv; *p != NULL; p++) {
+        size_t before = out.n;
+        if (glob_has_chars(*p))
+            expand_word(*p, &out);
+
+        if (out.n == before) {          /* no glob, or no match */
+            glob_unquote(*p);
+            push_result(&out, *p);
+        } else {
+            free(*p);
+        }
+    }
+
+    push_result(&out, NULL);
+    free(argv);
+    return out.paths;
+}
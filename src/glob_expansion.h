@@ -0,0 +1,44 @@
+#ifndef __GLOB_EXPANSION_H
+#define __GLOB_EXPANSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Marks the next character of a word as quoted, so that a quoted
+ * '*', '?' or '[' is not treated as a glob character. */
+#define GLOB_CTLESC '\001'
+
+/* Size of the buffer passed to getdents64 */
+#define GLOB_GETDENTS_BUFSIZE (1 << 20)
+
+/* Number of directory listings kept for repeated globs */
+#define GLOB_CACHE_SIZE 16
+
+/* Number of threads, including the shell's, that walk the directory
+ * tree below a '**' */
+#define GLOB_POOL_THREADS 8
+
+/* Return a malloc'd copy of the first 'len' bytes of 's' in which the
+ * glob characters are quoted.  Used by the lexer for quoted words. */
+char *glob_quote(const char *s, size_t len);
+
+/* The same, into 'word', which has room for 2 * len + 1 bytes;
+ * returns the length of the quoted word */
+size_t glob_quote_into(char *word, const char *s, size_t len);
+
+/* Remove the quoting added by glob_quote from 'word', in place */
+void glob_unquote(char *word);
+
+/* True if 'word' contains a glob character that is not quoted */
+bool glob_has_chars(const char *word);
+
+/* True if 'string' matches the glob 'pattern', as in a case command */
+bool glob_match(const char *pattern, const char *string);
+
+/* Replace each word of the NULL-terminated, malloc'd 'argv' that
+ * contains glob characters by the sorted list of matching paths, or,
+ * if nothing matches, by the word itself.  Quoting is removed.
+ * Returns the new argv; the old array is freed. */
+char **glob_expand_argv(char **argv);
+
+#endif /* __GLOB_EXPANSION_H */
@@ -0,0 +1,74 @@
+#!/usr/bin/python
+#
+# Tests ( ) and { } groups: their redirections and pipes apply to the
+# whole group, { } runs in the shell, ( ) keeps its variables to itself,
+# and the last command of a subshell takes the subshell's place.
+#
+import os, tempfile
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+out = tempfile.mktemp()
+
+#################################################################
+# Step 1. A group's output redirection collects all of its output.
+#
+sendline('{ echo first; echo second; } > %s' % out)
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('cat %s' % out)
+expect_exact('first\r\nsecond', "the group's output did not go to the file")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. A group in a pipeline writes into the pipe as a whole.
+#
+sendline('( echo one; echo two; echo three ) | wc -l')
+expect_exact('3', "the group's output did not go through the pipe")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 3. Variables set in { } stay set, those set in ( ) do not.
+#
+sendline('kept=outer')
+expect_prompt("Shell did not print expected prompt (5)")
+
+sendline('( kept=inner; echo in $kept )')
+expect_exact('in inner', "the subshell did not see its own variable")
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline('{ braced=set; }')
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline('echo $kept $braced')
+expect_exact('outer set', "a group changed the wrong variables")
+expect_prompt("Shell did not print expected prompt (8)")
+
+#################################################################
+# Step 4. The subshell forked for ( kept=1; ps ) execs ps in its own
+# place, so ps is a child of the shell and leads the job's group.
+#
+sendline('( kept=1; ps -o pid,ppid,pgid,comm )')
+pid, ppid, pgid = expect_regex(r'(\d+) +(\d+) +(\d+) ps\r\n')
+assert int(ppid) == console.pid, "ps did not replace the subshell"
+assert pid == pgid, "ps is not in the job's process group"
+expect_prompt("Shell did not print expected prompt (9)")
+
+#################################################################
+# Step 5. A background group is one job, listed with its commands.
+#
+sendline('{ sleep 1; echo done; } &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (10)")
+
+sendline('jobs')
+expect_exact('[1]\tRunning\t\t({ sleep 1; echo done; })', "the group is not listed as one job")
+expect_prompt("Shell did not print expected prompt (11)")
+
+os.unlink(out)
+
+test_success()
@@ -0,0 +1,379 @@
+/*
+ * Persistent command history.
+ *
+ * The history is an append-only log with one command per line.
+ * Each command is added with a single write() to a file opened with
+ * O_APPEND, so several cush instances can share the log without
+ * locking; a reader only ever looks at complete lines.
+ *
+ * The log is read through mmap().  At startup only its tail is
+ * touched, to give readline the most recent entries.  A helper
+ * thread then builds an index that maps each trigram (3-byte
+ * sequence) to the ascending list of entries containing it, so a
+ * reverse search only looks at entries that contain the rarest
+ * trigram of the query.  The first search waits for the thread;
+ * entries appended later, by this or another instance, are indexed
+ * incrementally by the main thread.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <readline/readline.h>
+#include <readline/history.h>
+
+#include "history_log.h"
+#include "utils.h"
+
+static int log_fd = -1;
+static char *map;               /* the log, mapped read-only */
+static size_t map_size;
+
+/* Start offset of each entry, up to the last complete line */
+static size_t *entry_start;
+static int nentries;
+static int entries_capacity;
+static size_t indexed_bytes;    /* end of the last indexed entry */
+
+/* Thread indexing the log as it was at startup */
+static pthread_t indexer;
+static bool indexer_running;
+
+/* Entries containing one trigram, in ascending order */
+struct posting_list {
+    uint32_t key;               /* trigram + 1, 0 if the slot is empty */
+    uint32_t n, capacity;
+    uint32_t *ids;
+};
+
+/* Open-addressing hash table of posting lists */
+static struct posting_list *trigrams;
+static size_t trigrams_size;    /* power of 2 */
+static size_t trigrams_used;
+
+static void *
+xrealloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+        utils_fatal_error("out of memory growing the history index: ");
+    return p;
+}
+
+static uint32_t
+trigram_key(const char *s)
+{
+    const unsigned char *u = (const unsigned char *) s;
+    return ((uint32_t) u[0] << 16 | u[1] << 8 | u[2]) + 1;
+}
+
+static size_t
+trigram_slot(uint32_t key)
+{
+    size_t i = (key * 2654435761u) & (trigrams_size - 1);
+    while (trigrams[i].key != 0 && trigrams[i].key != key)
+        i = (i + 1) & (trigrams_size - 1);
+    return i;
+}
+
+/* Return the posting list for 'key', creating it if 'create' is set */
+static struct posting_list *
+trigram_lookup(uint32_t key, bool create)
+{
+    if (trigrams_size == 0) {
+        if (!create)
+            return NULL;
+        trigrams_size = 1024;
+        trigrams = calloc(trigrams_size, sizeof *trigrams);
+        if (trigrams == NULL)
+            utils_fatal_error("out of memory allocating the history index: ");
+    }
+
+    struct posting_list *p = &trigrams[trigram_slot(key)];
+    if (p->key != 0 || !create)
+        return p->key != 0 ? p : NULL;
+
+    /* Keep the load factor below 1/2. */
+    if (2 * (trigrams_used + 1) > trigrams_size) {
+        struct posting_list *old = trigrams;
+        size_t old_size = trigrams_size;
+        trigrams_size *= 2;
+        trigrams = calloc(trigrams_size, sizeof *trigrams);
+        if (trigrams == NULL)
+            utils_fatal_error("out of memory growing the history index: ");
+        for (size_t i = 0; i < old_size; i++)
+            if (old[i].key != 0)
+                trigrams[trigram_slot(old[i].key)] = old[i];
+        free(old);
+        p = &trigrams[trigram_slot(key)];
+    }
+    trigrams_used++;
+    p->key = key;
+    return p;
+}
+
+/* Return entry 'i' and store its length, without the newline, in 'len' */
+static const char *
+entry_text(int i, size_t *len)
+{
+    size_t end = i + 1 < nentries ? entry_start[i + 1] : indexed_bytes;
+    *len = end - entry_start[i] - 1;
+    return map + entry_start[i];
+}
+
+static void
+index_entry(const char *text, size_t len)
+{
+    if (nentries == entries_capacity) {
+        entries_capacity = entries_capacity ? 2 * entries_capacity : 1024;
+        entry_start = xrealloc(entry_start, entries_capacity * sizeof *entry_start);
+    }
+    uint32_t id = nentries;
+    entry_start[nentries++] = text - map;
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct posting_list *p = trigram_lookup(trigram_key(text + i), true);
+        if (p->n > 0 && p->ids[p->n - 1] == id)     /* repeated trigram */
+            continue;
+        if (p->n == p->capacity) {
+            p->capacity = p->capacity ? 2 * p->capacity : 4;
+            p->ids = xrealloc(p->ids, p->capacity * sizeof *p->ids);
+        }
+        p->ids[p->n++] = id;
+    }
+}
+
+/* Map everything that has been appended to the log so far */
+static void
+map_log(void)
+{
+    struct stat st;
+    if (log_fd == -1 || fstat(log_fd, &st) == -1 || st.st_size <= map_size)
+        return;
+
+    void *m = map == NULL
+            ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, log_fd, 0)
+            : mremap(map, map_size, st.st_size, MREMAP_MAYMOVE);
+    if (m == MAP_FAILED) {
+        utils_error("cannot map the history log: ");
+        return;
+    }
+    map = m;
+    map_size = st.st_size;
+}
+
+/* Index the complete lines mapped since the last call */
+static void
+index_mapped_entries(void)
+{
+    while (indexed_bytes < map_size) {
+        char *start = map + indexed_bytes;
+        char *nl = memchr(start, '\n', map_size - indexed_bytes);
+        if (nl == NULL)         /* another instance is still writing it */
+            break;
+        indexed_bytes = nl + 1 - map;
+        index_entry(start, nl - start);
+    }
+}
+
+static void *
+index_thread(void *arg)
+{
+    index_mapped_entries();
+    return NULL;
+}
+
+void
+history_log_open(const char *path)
+{
+    log_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (log_fd == -1) {
+        utils_error("cannot open history log %s: ", path);
+        return;
+    }
+
+    /* Hand the tail of the log to readline, newest entry last. */
+    map_log();
+    size_t end = map_size;
+    while (end > 0 && map[end - 1] != '\n')
+        end--;
+
+    size_t start = end;
+    for (int n = 0; start > 0; start--)
+        if (map[start - 1] == '\n' && ++n > HISTORY_LOG_PRELOAD)
+            break;
+
+    while (start < end) {
+        char *nl = memchr(map + start, '\n', end - start);
+        char *line = strndup(map + start, nl - (map + start));
+        add_history(line);
+        free(line);
+        start = nl + 1 - map;
+    }
+
+    /* Index the rest in the background, with all signals blocked so
+     * that the SIGCHLD handler keeps running in the main thread. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    indexer_running = pthread_create(&indexer, NULL, index_thread, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void
+history_log_add(const char *line)
+{
+    if (*line == '\0')
+        return;
+
+    add_history(line);
+    if (log_fd == -1)
+        return;
+
+    /* One write per entry keeps concurrent appends from interleaving. */
+    size_t len = strlen(line);
+    char *record = malloc(len + 1);
+    if (record == NULL)
+        return;
+    memcpy(record, line, len);
+    record[len] = '\n';
+    if (write(log_fd, record, len + 1) != len + 1)
+        utils_error("cannot append to the history log: ");
+    free(record);
+}
+
+int
+history_log_size(void)
+{
+    if (indexer_running) {
+        pthread_join(indexer, NULL);
+        indexer_running = false;
+    }
+    map_log();
+    index_mapped_entries();
+    return nentries;
+}
+
+int
+history_log_search(const char *query, int before)
+{
+    size_t qlen = strlen(query);
+    size_t len;
+
+    if (before > nentries)
+        before = nentries;
+
+    /* Too short for the index, scan. */
+    if (qlen < 3) {
+        for (int i = before - 1; i >= 0; i--) {
+            const char *text = entry_text(i, &len);
+            if (memmem(text, len, query, qlen) != NULL)
+                return i;
+        }
+        return -1;
+    }
+
+    /* Only entries containing the query's rarest trigram can match. */
+    struct posting_list *rarest = NULL;
+    for (size_t i = 0; i + 3 <= qlen; i++) {
+        struct posting_list *p = trigram_lookup(trigram_key(query + i), false);
+        if (p == NULL)
+            return -1;
+        if (rarest == NULL || p->n < rarest->n)
+            rarest = p;
+    }
+
+    /* Find the last id below 'before', then walk backwards. */
+    uint32_t lo = 0, hi = rarest->n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (rarest->ids[mid] < before)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while (lo-- > 0) {
+        const char *text = entry_text(rarest->ids[lo], &len);
+        if (memmem(text, len, query, qlen) != NULL)
+            return rarest->ids[lo];
+    }
+    return -1;
+}
+
+char *
+history_log_entry(int i)
+{
+    size_t len;
+    const char *text = entry_text(i, &len);
+    return strndup(text, len);
+}
+
+/* Show entry 'i' in the line buffer with the cursor on 'query' */
+static void
+show_match(int i, const char *query)
+{
+    char *line = history_log_entry(i);
+    rl_replace_line(line, 0);
+    rl_point = strstr(line, query) - line;
+    free(line);
+}
+
+int
+history_log_reverse_search(int count, int key)
+{
+    char query[256] = "";
+    size_t qlen = 0;
+    int size = history_log_size();
+    int match = -1;             /* entry shown in the line buffer */
+    bool failing = false;
+    char *original = strdup(rl_line_buffer);
+
+    for (;;) {
+        rl_message("(%sreverse-i-search)`%s': ", failing ? "failing " : "", query);
+
+        int c = rl_read_key();
+        int before;
+        if (c == CTRL('r')) {           /* next older match */
+            before = match == -1 ? size : match;
+        } else if (c == RUBOUT || c == CTRL('h')) {
+            if (qlen > 0)
+                query[--qlen] = '\0';
+            before = size;
+        } else if (c == CTRL('g')) {    /* abort, restore the line */
+            rl_replace_line(original, 0);
+            rl_point = rl_end;
+            break;
+        } else if (isprint(c) && qlen + 1 < sizeof query) {
+            query[qlen++] = c;
+            query[qlen] = '\0';
+            before = match == -1 ? size : match + 1;
+        } else {                        /* accept, and act on the key */
+            rl_execute_next(c);
+            break;
+        }
+
+        if (qlen == 0) {
+            failing = false;
+            continue;
+        }
+        int i = history_log_search(query, before);
+        failing = i == -1;
+        if (!failing) {
+            match = i;
+            show_match(match, query);
+        }
+    }
+
+    rl_clear_message();
+    free(original);
+    return 0;
+}
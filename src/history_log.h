@@ -0,0 +1,31 @@
+#ifndef __HISTORY_LOG_H
+#define __HISTORY_LOG_H
+
+/* Number of the most recent entries handed to readline at startup,
+ * so that up-arrow works without reading the whole log. */
+#define HISTORY_LOG_PRELOAD 1000
+
+/* Open (or create) the history log at 'path' and preload the most
+ * recent entries into readline's history list.  The rest of the log
+ * is only read, and indexed, when it is first searched. */
+void history_log_open(const char *path);
+
+/* Append 'line' to the log and to readline's history list */
+void history_log_add(const char *line);
+
+/* Return the number of entries in the log, including entries appended
+ * by other cush instances since the last call. */
+int history_log_size(void);
+
+/* Return the index of the newest entry before entry 'before' that
+ * contains 'query', or -1 if there is none. */
+int history_log_search(const char *query, int before);
+
+/* Return a malloc'd copy of entry 'i' */
+char *history_log_entry(int i);
+
+/* Readline command for an incremental reverse search (Ctrl-R)
+ * that uses the log's index instead of readline's history list. */
+int history_log_reverse_search(int count, int key);
+
+#endif /* __HISTORY_LOG_H */
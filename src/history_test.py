@@ -0,0 +1,49 @@
+#!/usr/bin/python
+#
+# Tests the persistent history log, its 'history' builtin and
+# the indexed reverse search bound to Ctrl-R.
+#
+import atexit, os, tempfile, time
+from testutils import *
+
+# start from a log written by an earlier session
+histfile = tempfile.NamedTemporaryFile(suffix='.cush_history', delete=False)
+for i in range(20000):
+    histfile.write('echo filler %d\n' % i)
+histfile.write('echo needle-from-last-session\n')
+histfile.close()
+atexit.register(os.unlink, histfile.name)
+os.environ['HISTFILE'] = histfile.name
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. Commands are appended to the log, after the entries
+# of earlier sessions.
+#
+sendline('echo this-session')
+expect_exact('this-session', "echo did not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('history 3')
+expect_exact('20001  echo needle-from-last-session', "old entries were not loaded")
+expect_exact('20002  echo this-session', "new entry was not listed")
+expect_prompt("Shell did not print expected prompt (3)")
+
+assert open(histfile.name).read().endswith('echo this-session\nhistory 3\n'), \
+    "commands were not appended to the log"
+
+#################################################################
+# Step 2. Ctrl-R finds an old entry, and Enter runs it.
+#
+sendcontrol('r')
+console.send('needle-from')
+time.sleep(0.2)
+sendline('')
+expect_exact('needle-from-last-session\r\n', "reverse search did not find the entry")
+expect_prompt("Shell did not print expected prompt (4)")
+
+test_success()
@@ -0,0 +1,153 @@
+/*
+ * Capture of background job output.
+ *
+ * A captured job writes its stdout and stderr into a pipe.  The read
+ * end is watched by the event loop, which copies what arrives into a
+ * ring buffer in a memfd mapping, so a chatty job costs a bounded
+ * amount of memory and no disk writes.  When the ring is full the
+ * oldest output is overwritten.  The log outlives the job, so that
+ * 'joblog <jid>' shows the end of its output after it has exited.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "job_log.h"
+#include "event_loop.h"
+#include "utils.h"
+
+struct job_log {
+    struct job_log *next;
+    int jid;
+    int read_fd;                /* -1 once all writers are gone */
+    char *ring;                 /* 'size' bytes mapped from a memfd */
+    size_t size;
+    uint64_t total;             /* bytes received; the newest end at total % size */
+};
+
+static struct job_log *logs;
+
+static struct job_log *
+find_log(int jid)
+{
+    for (struct job_log *l = logs; l != NULL; l = l->next)
+        if (l->jid == jid)
+            return l;
+    return NULL;
+}
+
+static void
+close_pipe(struct job_log *l)
+{
+    if (l->read_fd != -1) {
+        event_loop_remove_fd(l->read_fd);
+        close(l->read_fd);
+        l->read_fd = -1;
+    }
+}
+
+/* Event loop callback: move what the job wrote into the ring */
+static void
+drain(int fd, void *ctx)
+{
+    struct job_log *l = ctx;
+    /* at most one ring's worth, so a fast writer cannot starve the shell */
+    for (size_t copied = 0; copied < l->size; ) {
+        /* read straight into the ring, up to its end */
+        size_t pos = l->total % l->size;
+        ssize_t n = read(fd, l->ring + pos, l->size - pos);
+        if (n > 0) {
+            l->total += n;
+            copied += n;
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+            return;
+        close_pipe(l);          /* EOF: the job and its children are done */
+        return;
+    }
+}
+
+void
+job_log_forget(int jid)
+{
+    for (struct job_log **p = &logs; *p != NULL; p = &(*p)->next) {
+        struct job_log *l = *p;
+        if (l->jid == jid) {
+            *p = l->next;
+            close_pipe(l);
+            munmap(l->ring, l->size);
+            free(l);
+            return;
+        }
+    }
+}
+
+int
+job_log_start(int jid, size_t size)
+{
+    job_log_forget(jid);
+
+    int memfd = memfd_create("cush-joblog", MFD_CLOEXEC);
+    if (memfd == -1)
+        return -1;
+    char *ring = MAP_FAILED;
+    if (ftruncate(memfd, size) == 0)
+        ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);               /* the mapping keeps the memory */
+    if (ring == MAP_FAILED)
+        return -1;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        munmap(ring, size);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    struct job_log *l = malloc(sizeof *l);
+    if (l == NULL)
+        utils_fatal_error("out of memory starting a job log: ");
+    *l = (struct job_log) {
+        .next = logs, .jid = jid, .read_fd = fds[0], .ring = ring, .size = size
+    };
+    logs = l;
+    event_loop_add_fd(l->read_fd, drain, l);
+    return fds[1];
+}
+
+bool
+job_log_print(int jid, FILE *out)
+{
+    struct job_log *l = find_log(jid);
+    if (l == NULL)
+        return false;
+
+    if (l->read_fd != -1)       /* show what is in the pipe, too */
+        drain(l->read_fd, l);
+
+    size_t pos = l->total % l->size;
+    if (l->total > l->size) {
+        fprintf(out, "[joblog: %llu earlier bytes dropped]\n",
+                (unsigned long long) (l->total - l->size));
+        fwrite(l->ring + pos, 1, l->size - pos, out);
+        fwrite(l->ring, 1, pos, out);
+    } else {
+        fwrite(l->ring, 1, l->total, out);
+    }
+    return true;
+}
+
+void
+job_log_list(FILE *out)
+{
+    for (struct job_log *l = logs; l != NULL; l = l->next)
+        fprintf(out, "[%d]\t%llu bytes captured, %s\n", l->jid,
+                (unsigned long long) l->total,
+                l->read_fd != -1 ? "open" : "closed");
+}
@@ -0,0 +1,31 @@
+#ifndef __JOB_LOG_H
+#define __JOB_LOG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Default capacity of a job's log, the last bytes of output kept */
+#define JOB_LOG_DEFAULT_SIZE (64 * 1024)
+
+/* Upper bound for the capacity set with 'joblog on <KB>' */
+#define JOB_LOG_MAX_SIZE (64 * 1024 * 1024)
+
+/* Start capturing the output of job 'jid' into a ring of 'size' bytes,
+ * replacing any earlier log of that jid.  Returns the write end of a
+ * close-on-exec pipe that the job's processes should use as stdout
+ * and stderr, or -1 with errno set.  The shell's event loop copies
+ * what arrives into the ring until every writer has closed the pipe. */
+int job_log_start(int jid, size_t size);
+
+/* Discard the log of job 'jid', if any */
+void job_log_forget(int jid);
+
+/* Print the captured output of job 'jid'.  Returns false if there is
+ * no log for it. */
+bool job_log_print(int jid, FILE *out);
+
+/* List the jids that have a log, with the amount captured */
+void job_log_list(FILE *out);
+
+#endif /* __JOB_LOG_H */
@@ -0,0 +1,150 @@
+/*
+ * Support for the 'sched' and 'nice' builtin prefixes, which set the
+ * scheduling policy and priority of a job's processes.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/resource.h>
+
+#include "job_sched.h"
+#include "utils.h"
+
+static const struct {
+    const char *name;
+    int policy;
+} policies[] = {
+    { "other", SCHED_OTHER },
+    { "normal", SCHED_OTHER },
+    { "batch", SCHED_BATCH },
+    { "idle",  SCHED_IDLE },
+    { "fifo",  SCHED_FIFO },
+    { "rr",    SCHED_RR },
+};
+
+#define NPOLICIES (sizeof policies / sizeof policies[0])
+
+/* Parse a decimal integer that must make up all of 'word' */
+static bool
+parse_int(const char *word, int *out)
+{
+    char *end;
+    long v = strtol(word, &end, 10);
+    if (end == word || *end != '\0')
+        return false;
+    *out = v;
+    return true;
+}
+
+int
+job_sched_parse_policy(struct job_sched *js, char **argv)
+{
+    if (argv[0] == NULL) {
+        printf("Usage: sched other|batch|idle|fifo|rr [priority] command\n");
+        return -1;
+    }
+
+    int i;
+    for (i = 0; i < NPOLICIES; i++)
+        if (strcmp(argv[0], policies[i].name) == 0)
+            break;
+
+    if (i == NPOLICIES) {
+        printf("sched: unknown policy '%s'\n", argv[0]);
+        return -1;
+    }
+
+    int policy = policies[i].policy;
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    int used = 1;
+    int priority = min;
+
+    if (argv[1] != NULL && parse_int(argv[1], &priority))
+        used = 2;
+
+    if (priority < min || priority > max) {
+        printf("sched: priority for %s must be between %d and %d\n",
+               argv[0], min, max);
+        return -1;
+    }
+
+    js->set_policy = true;
+    js->policy = policy;
+    js->param.sched_priority = priority;
+    return used;
+}
+
+int
+job_sched_parse_nice(struct job_sched *js, char **argv)
+{
+    int adjustment = 10;
+    int used = 0;
+
+    /* The forms of nice(1): -n N, -nN, --adjustment=N and -N, where
+     * --N is a negative one.  Anything else is left to nice(1). */
+    if (argv[0] != NULL && argv[0][0] == '-') {
+        const char *number;
+        used = 1;
+        if (strcmp(argv[0], "-n") == 0) {
+            number = argv[1];
+            used = 2;
+        } else if (strncmp(argv[0], "-n", 2) == 0) {
+            number = argv[0] + 2;
+        } else if (strncmp(argv[0], "--adjustment=", 13) == 0) {
+            number = argv[0] + 13;
+        } else {
+            number = argv[0] + 1;
+        }
+        if (number == NULL || !(isdigit((unsigned char) number[0])
+                                || (number[0] == '-' && isdigit((unsigned char) number[1])))
+            || !parse_int(number, &adjustment))
+            return JOB_SCHED_UNRECOGNIZED;
+    }
+
+    /* getpriority can legitimately return -1, so check errno instead. */
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, 0);
+    if (current == -1 && errno != 0) {
+        utils_error("getpriority failed: ");
+        return -1;
+    }
+
+    int nice = current + adjustment;
+    if (nice < -20)
+        nice = -20;
+    if (nice > 19)
+        nice = 19;
+
+    js->set_nice = true;
+    js->nice = nice;
+    return used;
+}
+
+bool
+job_sched_apply(const struct job_sched *js)
+{
+    if (js->set_policy && sched_setscheduler(0, js->policy, &js->param) == -1) {
+        utils_error("sched_setscheduler %s failed: ",
+                    job_sched_policy_name(js->policy));
+        return false;
+    }
+
+    if (js->set_nice && setpriority(PRIO_PROCESS, 0, js->nice) == -1) {
+        utils_error("setpriority %d failed: ", js->nice);
+        return false;
+    }
+    return true;
+}
+
+const char *
+job_sched_policy_name(int policy)
+{
+    for (int i = 0; i < NPOLICIES; i++)
+        if (policies[i].policy == policy)
+            return policies[i].name;
+    return "unknown";
+}
@@ -0,0 +1,41 @@
+#ifndef __JOB_SCHED_H
+#define __JOB_SCHED_H
+
+#include <sched.h>
+#include <stdbool.h>
+
+/* Scheduling settings recorded by the 'sched' and 'nice' prefixes.
+ * They are installed in each child of the job before it calls exec,
+ * so the command never runs with the shell's policy or priority. */
+struct job_sched {
+    bool set_policy;            /* true if 'sched' was given */
+    int policy;                 /* SCHED_OTHER, SCHED_BATCH, ... */
+    struct sched_param param;   /* static priority, for SCHED_FIFO/RR */
+    bool set_nice;              /* true if 'nice' was given */
+    int nice;                   /* absolute nice value to install */
+};
+
+/* Parse the arguments of a 'sched' prefix, "POLICY [PRIORITY]".
+ * argv points to the first word after 'sched'.  Returns the number of
+ * words consumed, or -1 (after printing a message) on error. */
+int job_sched_parse_policy(struct job_sched *js, char **argv);
+
+/* Returned by job_sched_parse_nice for options it does not know */
+#define JOB_SCHED_UNRECOGNIZED  (-2)
+
+/* Parse the arguments of a 'nice' prefix, "[-n ADJUSTMENT]" or
+ * "[-ADJUSTMENT]".  The adjustment is relative to the shell's own nice
+ * value, as in nice(1), and defaults to 10.  Returns the number of
+ * words consumed, -1 (after printing a message) on error, or
+ * JOB_SCHED_UNRECOGNIZED if the words are meant for nice(1) itself. */
+int job_sched_parse_nice(struct job_sched *js, char **argv);
+
+/* Install the recorded settings in the calling process.
+ * Meant to be called in the child between fork() and exec.
+ * Returns false if they could not be installed. */
+bool job_sched_apply(const struct job_sched *js);
+
+/* Return the name of scheduling policy 'policy' as accepted by 'sched' */
+const char *job_sched_policy_name(int policy);
+
+#endif /* __JOB_SCHED_H */
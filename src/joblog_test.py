@@ -0,0 +1,70 @@
+#!/usr/bin/python
+#
+# Tests 'joblog': with 'joblog on', the stdout and stderr of background
+# jobs go into an in-memory ring instead of the terminal, and
+# 'joblog <jid>' shows the last part of it, also after the job exited.
+#
+import time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. Turn capturing on with a 1 KB ring per job.
+#
+sendline('joblog on 1')
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('joblog')
+expect_exact('joblog on, last 1 KB', "joblog did not report its setting")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. Output of a running job is captured, stdout and stderr.
+#
+sendline('sh -c "echo to-stdout; echo to-stderr >&2; sleep 1" &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (4)")
+
+# overflow the ring of a second job
+sendline('seq 1 3000 &')
+expect_regex(r'\[2\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (5)")
+
+time.sleep(0.3)
+sendline('joblog 1')
+expect_exact('to-stdout', "stdout of the job was not captured")
+expect_exact('to-stderr', "stderr of the job was not captured")
+expect_prompt("Shell did not print expected prompt (6)")
+
+#################################################################
+# Step 3. The end of the output is kept after the job exited.
+#
+sendline('sleep 1.2')
+expect_exact('Done', "job did not finish")
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline('joblog 2 | head -n 1')
+expect_exact('earlier bytes dropped', "full ring did not drop the oldest output")
+expect_prompt("Shell did not print expected prompt (8)")
+
+sendline('joblog 2 | tail -n 1')
+expect_exact('3000', "last line of the output was not kept")
+expect_prompt("Shell did not print expected prompt (9)")
+
+sendline('joblog 1 | tail -n 1')
+expect_exact('to-stderr', "log of an exited job was not kept")
+expect_prompt("Shell did not print expected prompt (10)")
+
+#################################################################
+# Step 4. With joblog off, background output goes to the terminal.
+#
+sendline('joblog off')
+expect_prompt("Shell did not print expected prompt (11)")
+sendline('echo uncaptured &')
+expect_exact('uncaptured', "output was captured after 'joblog off'")
+
+test_success()
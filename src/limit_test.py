@@ -0,0 +1,72 @@
+#!/usr/bin/python
+#
+# Tests the 'limit' builtin prefix, which applies rlimits
+# to the job started by the rest of the command line.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. A CPU-bound job that exceeds its CPU time limit must be
+# reported as a limit violation, not as a plain signal death.
+#
+sendline('limit -t 1 sh -c "while :; do :; done"')
+
+expect_exact("CPU time limit exceeded", "limit -t violation was not reported")
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 2. The limit applies to the job only, not to the shell.
+#
+sendline('sh -c "ulimit -t"')
+expect_exact("unlimited", "limit -t leaked into later jobs")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 3. Options with suffixes are accepted and applied.
+#
+sendline('limit -v 2G -n 64 sh -c "ulimit -n"')
+expect_exact("64", "limit -n was not applied in the child")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 4. Unknown options are rejected without running the command.
+#
+sendline("limit -x 3 echo notrun")
+expect_exact("limit: unknown option '-x'", "invalid limit option not rejected")
+expect_prompt("Shell did not print expected prompt (5)")
+
+#################################################################
+# Step 5. Values too large for an rlimit are rejected, rather than
+# wrapping around to a tiny limit.
+#
+sendline("limit -v 17179869184T echo notrun")
+expect_exact("limit: invalid value for -v", "a value that wraps around was accepted")
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline("limit -t 99999999999999999999 echo notrun")
+expect_exact("limit: invalid value for -t", "a value out of range was accepted")
+expect_prompt("Shell did not print expected prompt (7)")
+
+#################################################################
+# Step 6. Only a job that used up its CPU time is reported as killed
+# at the hard CPU limit (one second above the soft limit); kill -9
+# of a job with a CPU limit is a plain kill.
+#
+sendline('limit -t 5 sh -c "kill -9 $$"')
+expect_exact("killed", "the killed job was not reported")
+assert console.expect_exact(["hard CPU time limit", "\r\n"]) == 1, \
+    "kill -9 was reported as the hard CPU time limit"
+expect_prompt("Shell did not print expected prompt (8)")
+
+sendline('limit -t 1 sh -c "trap : XCPU; while :; do :; done"')
+console.timeout = 5
+expect_exact("killed at the hard CPU time limit", "the hard CPU limit was not reported")
+console.timeout = 2
+
+test_success()
@@ -0,0 +1,97 @@
+#!/usr/bin/python
+#
+# Tests the notices printed when background jobs finish: '[N]+  Done',
+# 'Exit N' or the name of the signal, shown before the next prompt or,
+# if the user is typing, right away above a redrawn prompt, and that
+# finished jobs are deleted between commands rather than only at the
+# prompt, so a script can run more commands than there are pids, and
+# that the prompt is built when USER and PWD are unset.
+#
+import atexit, os, shutil, tempfile
+from testutils import *
+
+workdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, workdir)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. A job that finishes while a command runs is reported
+# before the next prompt.
+#
+sendline('sh -c "exit 3" &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('sleep 0.5')
+expect_exact('[1]+  Exit 3', "Exit notice was not printed")
+expect_exact('sh -c exit 3', "Exit notice does not show the command")
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('jobs')
+expect_exact('There are currently no jobs', "finished job was not removed")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 2. A job that finishes while the user is typing is reported
+# immediately, and the partial command line is kept.
+#
+sendline('sleep 0.5 &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (5)")
+
+console.send('echo par')
+expect_exact('[1]+  Done', "Done notice was not printed at the prompt")
+expect_exact('sleep 0.5', "Done notice does not show the command")
+expect_prompt("Shell did not redraw the prompt")
+sendline('tial')
+expect_exact('partial', "typed text was lost when the prompt was redrawn")
+expect_prompt("Shell did not print expected prompt (6)")
+
+#################################################################
+# Step 3. A killed job is reported with the signal's name.
+#
+sendline('sleep 10 &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline('kill 1')
+expect_exact('Terminated', "signal was not named in the notice")
+expect_prompt("Shell did not print expected prompt (8)")
+
+#################################################################
+# Step 4. Jobs that finish during a command line are deleted before
+# the next command; only their notices wait for the prompt.
+#
+sendline('for i in 1 2; do sleep 0.1 & sleep 0.5; done; jobs')
+expect_exact('There are currently no jobs', "finished jobs were kept until the prompt")
+expect_exact('[1]+  Done', "the notice of the first job was lost")
+expect_exact('[1]+  Done', "the notice of the second job was lost")
+expect_prompt("Shell did not print expected prompt (9)")
+
+#################################################################
+# Step 5. A script runs more commands than pid_max (32768 by default),
+# so the kernel reuses the pids of commands that finished earlier.
+#
+script = os.path.join(workdir, 'script')
+open(script, 'w').write('for i in {1..40000}; do /bin/true; done\necho status $?\n')
+sendline('%s %s' % (os.path.abspath('cush'), script))
+console.timeout = 600
+expect_exact('status 0', "the script did not run all its commands")
+console.timeout = 2
+expect_prompt("Shell did not print expected prompt (10)")
+
+#################################################################
+# Step 6. A shell started without USER and PWD builds its prompt
+# from empty strings in their place.
+#
+sendline('env -u USER -u PWD %s' % os.path.abspath('cush'))
+sendline('echo pwd=[$PWD]')
+expect_exact('pwd=[]', "the shell without PWD did not run a command")
+sendline('exit')
+expect_prompt("Shell did not print expected prompt (11)")
+
+test_success()
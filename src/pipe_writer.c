@@ -0,0 +1,85 @@
+/*
+ * Background writers for builtin output.
+ *
+ * A builtin inside a pipeline prints into memory; a detached thread
+ * then writes the text into the pipe to the next command.  The thread
+ * blocks all signals, so a reader that exits early makes write()
+ * fail with EPIPE instead of raising SIGPIPE in the shell.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "pipe_writer.h"
+
+struct pipe_writer {
+    int fd;
+    char *buf;
+    size_t len;
+};
+
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void *
+writer_thread(void *arg)
+{
+    struct pipe_writer *w = arg;
+    write_all(w->fd, w->buf, w->len);
+    close(w->fd);
+    free(w->buf);
+    free(w);
+    return NULL;
+}
+
+void
+pipe_writer_start(int fd, char *buf, size_t len)
+{
+    struct pipe_writer *w = malloc(sizeof *w);
+    if (w != NULL) {
+        *w = (struct pipe_writer) { .fd = fd, .buf = buf, .len = len };
+
+        sigset_t all, old;
+        pthread_t thread;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        int err = pthread_create(&thread, NULL, writer_thread, w);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (err == 0) {
+            pthread_detach(thread);
+            return;
+        }
+        free(w);
+    }
+
+    /* No thread: write here, with SIGPIPE blocked for the same reason. */
+    sigset_t pipe_set, old;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+    write_all(fd, buf, len);
+    close(fd);
+    free(buf);
+
+    /* discard a SIGPIPE raised by the write before unblocking it */
+    struct timespec zero = { 0, 0 };
+    while (sigtimedwait(&pipe_set, NULL, &zero) > 0)
+        ;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
@@ -0,0 +1,12 @@
+#ifndef __PIPE_WRITER_H
+#define __PIPE_WRITER_H
+
+#include <stddef.h>
+
+/* Write buf[0..len) to 'fd' on a helper thread, then close 'fd' and
+ * free 'buf'.  Takes ownership of both.  Used for the output of a
+ * builtin that runs inside a pipeline, so that the shell does not
+ * block while the next command has not yet read a full pipe. */
+void pipe_writer_start(int fd, char *buf, size_t len);
+
+#endif /* __PIPE_WRITER_H */
@@ -0,0 +1,136 @@
+/*
+ * Load- and memory-pressure readings used by the 'admit' builtin
+ * to hold back background work while the system is overloaded.
+ *
+ * Pressure stall information (PSI) is read from /proc/pressure,
+ * available since Linux 4.20; the load average is used on kernels
+ * without it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pressure.h"
+
+/* Read the "some avg10" value of a /proc/pressure file */
+static bool
+read_psi(const char *path, double *avg10)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    bool found = fscanf(f, "some avg10=%lf", avg10) == 1;
+    fclose(f);
+    return found;
+}
+
+bool
+pressure_read(struct pressure_sample *sample)
+{
+    sample->psi_available = read_psi("/proc/pressure/cpu", &sample->cpu)
+                         && read_psi("/proc/pressure/memory", &sample->memory);
+    if (!sample->psi_available)
+        sample->cpu = sample->memory = 0;
+
+    FILE *f = fopen("/proc/loadavg", "r");
+    bool have_load = f != NULL && fscanf(f, "%lf", &sample->load) == 1;
+    if (f != NULL)
+        fclose(f);
+    if (!have_load)
+        sample->load = 0;
+
+    return sample->psi_available || have_load;
+}
+
+bool
+pressure_exceeded(const struct pressure_policy *policy,
+                  const struct pressure_sample *sample, double factor)
+{
+    if (!policy->enabled)
+        return false;
+
+    return (policy->cpu > 0 && sample->cpu > policy->cpu * factor)
+        || (policy->memory > 0 && sample->memory > policy->memory * factor)
+        || (policy->load > 0 && sample->load > policy->load * factor);
+}
+
+/* True if the 'length' bytes at 'word' are the setting 'name' */
+static bool
+is_setting(const char *word, size_t length, const char *name)
+{
+    return strlen(name) == length && strncmp(word, name, length) == 0;
+}
+
+bool
+pressure_parse_policy(struct pressure_policy *policy, char *const *argv)
+{
+    struct pressure_policy parsed = { .enabled = true };
+
+    for (; *argv != NULL; argv++) {
+        double *threshold = NULL;
+        const char *value = strchr(*argv, '=');
+        size_t length = value != NULL ? (size_t) (value - *argv) : strlen(*argv);
+
+        if (strcmp(*argv, "stop") == 0) {
+            parsed.stop_jobs = true;
+            continue;
+        }
+        if (value != NULL) {
+            value++;
+            if (is_setting(*argv, length, "cpu"))
+                threshold = &parsed.cpu;
+            else if (is_setting(*argv, length, "mem"))
+                threshold = &parsed.memory;
+            else if (is_setting(*argv, length, "load"))
+                threshold = &parsed.load;
+        }
+        if (threshold == NULL) {
+            printf("admit: unknown setting '%.*s'\n", (int) length, *argv);
+            return false;
+        }
+
+        char *end;
+        *threshold = strtod(value, &end);
+        if (end == value || *end != '\0' || *threshold < 0) {
+            printf("admit: invalid threshold '%s'\n", value);
+            return false;
+        }
+    }
+
+    if (parsed.cpu == 0 && parsed.memory == 0 && parsed.load == 0) {
+        printf("admit: no threshold given\n");
+        return false;
+    }
+    *policy = parsed;
+    return true;
+}
+
+void
+pressure_print(const struct pressure_policy *policy, FILE *out)
+{
+    struct pressure_sample sample;
+    pressure_read(&sample);
+
+    if (!policy->enabled) {
+        fprintf(out, "Admission control is off\n");
+    } else {
+        fprintf(out, "Background jobs wait while");
+        const char *sep = "";
+        if (policy->cpu > 0)
+            fprintf(out, "%s cpu > %g%%", sep, policy->cpu), sep = " or";
+        if (policy->memory > 0)
+            fprintf(out, "%s mem > %g%%", sep, policy->memory), sep = " or";
+        if (policy->load > 0)
+            fprintf(out, "%s load > %g", sep, policy->load);
+        fprintf(out, "%s\n", policy->stop_jobs ? "; running ones are stopped" : "");
+    }
+
+    if (sample.psi_available)
+        fprintf(out, "Current pressure: cpu %.2f%%, mem %.2f%%, load %.2f\n",
+               sample.cpu, sample.memory, sample.load);
+    else
+        fprintf(out, "Current load: %.2f (no /proc/pressure on this kernel)\n",
+               sample.load);
+}
@@ -0,0 +1,46 @@
+#ifndef __PRESSURE_H
+#define __PRESSURE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* One reading of the system's load and pressure stall information */
+struct pressure_sample {
+    bool psi_available;     /* false if /proc/pressure does not exist */
+    double cpu;             /* "some avg10" of /proc/pressure/cpu, in % */
+    double memory;          /* "some avg10" of /proc/pressure/memory, in % */
+    double load;            /* 1-minute load average of /proc/loadavg */
+};
+
+/* Thresholds above which the shell delays new background jobs.
+ * A threshold of 0 is not checked. */
+struct pressure_policy {
+    bool enabled;
+    double cpu;             /* max. CPU pressure, in % */
+    double memory;          /* max. memory pressure, in % */
+    double load;            /* max. 1-minute load average */
+    bool stop_jobs;         /* also SIGSTOP running background jobs */
+};
+
+/* Fraction of the thresholds below which held-back work resumes,
+ * so that jobs do not flap around a threshold. */
+#define PRESSURE_RESUME_FACTOR 0.8
+
+/* Read the current pressure.  Returns false if nothing could be read. */
+bool pressure_read(struct pressure_sample *sample);
+
+/* Return true if 'sample' exceeds any threshold of 'policy' scaled
+ * by 'factor' (1.0 when admitting, PRESSURE_RESUME_FACTOR when
+ * deciding whether to resume). */
+bool pressure_exceeded(const struct pressure_policy *policy,
+                       const struct pressure_sample *sample, double factor);
+
+/* Parse the arguments of the 'admit' builtin, e.g. "cpu=20 mem=5 load=8
+ * stop", into 'policy'.  The words are left as they are.  Returns false
+ * (after printing a message) if an argument is invalid. */
+bool pressure_parse_policy(struct pressure_policy *policy, char *const *argv);
+
+/* Print 'policy' and the current pressure to 'out' */
+void pressure_print(const struct pressure_policy *policy, FILE *out);
+
+#endif /* __PRESSURE_H */
@@ -0,0 +1,96 @@
+#ifndef __PROBES_H
+#define __PROBES_H
+
+/*
+ * USDT probes at the shell's hot points, for bpftrace and perf probe,
+ * e.g. bpftrace -e 'usdt:./cush:cush:child_reaped { printf("%d\n", arg1); }'
+ *
+ * A probe is a single nop plus an ELF note (.note.stapsdt) that tells
+ * the tracer where the nop is and where its arguments live, so it
+ * costs nothing until a tracer replaces the nop with a breakpoint.
+ * Arguments are passed as longs.
+ *
+ * The probes come from <sys/sdt.h> if it is installed.  Otherwise the
+ * note is emitted here in the same format (version 3, no semaphores)
+ * on x86-64; elsewhere, or with -DCUSH_NO_PROBES, probes compile to
+ * nothing.  'make check-probes' lists the notes in cush.
+ */
+
+#if defined(CUSH_NO_PROBES)
+#define CUSH_PROBE_NOTES 0
+#elif defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define CUSH_PROBE_NOTES 1
+# endif
+#endif
+
+#if defined(CUSH_PROBE_NOTES)
+/* decided above */
+#elif defined(__x86_64__)
+#define CUSH_PROBE_NOTES 2
+#else
+#define CUSH_PROBE_NOTES 0
+#endif
+
+#if CUSH_PROBE_NOTES == 1
+
+#define CUSH_PROBE1(name, a) \
+    DTRACE_PROBE1(cush, name, (long) (a))
+#define CUSH_PROBE2(name, a, b) \
+    DTRACE_PROBE2(cush, name, (long) (a), (long) (b))
+#define CUSH_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(cush, name, (long) (a), (long) (b), (long) (c))
+
+#elif CUSH_PROBE_NOTES == 2
+
+/* The note of one probe: its address, the base used to detect
+ * prelinking, no semaphore, then provider, name and argument
+ * descriptions, each a NUL-terminated string. */
+#define CUSH_PROBE_ASM(name, args)                                          \
+    "990: nop\n"                                                            \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+    ".balign 4\n"                                                           \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+    "991: .asciz \"stapsdt\"\n"                                             \
+    "992: .balign 4\n"                                                      \
+    "993: .8byte 990b\n"                                                    \
+    ".8byte _.stapsdt.base\n"                                               \
+    ".8byte 0\n"                                                            \
+    ".asciz \"cush\"\n"                                                     \
+    ".asciz \"" #name "\"\n"                                                \
+    ".asciz \"" args "\"\n"                                                 \
+    "994: .balign 4\n"                                                      \
+    ".popsection\n"                                                         \
+    ".ifndef _.stapsdt.base\n"                                              \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                                \
+    ".hidden _.stapsdt.base\n"                                              \
+    "_.stapsdt.base: .space 1\n"                                            \
+    ".size _.stapsdt.base, 1\n"                                             \
+    ".popsection\n"                                                         \
+    ".endif\n"
+
+/* "-8@%0" describes a signed 8-byte argument in operand 0, which the
+ * compiler prints in AT&T syntax as a register, memory reference or
+ * constant */
+#define CUSH_PROBE1(name, a)                                                \
+    __asm__ __volatile__ (CUSH_PROBE_ASM(name, "-8@%0")                     \
+                          :: "nor" ((long) (a)))
+#define CUSH_PROBE2(name, a, b)                                             \
+    __asm__ __volatile__ (CUSH_PROBE_ASM(name, "-8@%0 -8@%1")               \
+                          :: "nor" ((long) (a)), "nor" ((long) (b)))
+#define CUSH_PROBE3(name, a, b, c)                                          \
+    __asm__ __volatile__ (CUSH_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2")         \
+                          :: "nor" ((long) (a)), "nor" ((long) (b)),        \
+                             "nor" ((long) (c)))
+
+#else
+
+#define CUSH_PROBE1(name, a) ((void) 0)
+#define CUSH_PROBE2(name, a, b) ((void) 0)
+#define CUSH_PROBE3(name, a, b, c) ((void) 0)
+
+#endif
+
+#endif /* __PROBES_H */
@@ -0,0 +1,67 @@
+#!/usr/bin/python
+#
+# Tests recursive globs: '**' matches any number of directories,
+# skips hidden ones, and the matches come out sorted no matter
+# which of the walking threads found them.
+#
+import atexit, os, shutil, tempfile
+from testutils import *
+
+tmpdir = tempfile.mkdtemp("-cush-rglob-tests")
+atexit.register(shutil.rmtree, tmpdir)
+
+testfiles = ['top.c', 'a/one.c', 'a/one.h', 'a/b/two.c', 'a/b/c/three.c',
+             'z/four.c', 'm/n/five.c', '.hidden/six.c']
+for i in range(40):
+    testfiles.append('wide/d%02d/f.c' % i)
+for f in testfiles:
+    path = os.path.join(tmpdir, f)
+    if not os.path.isdir(os.path.dirname(path)):
+        os.makedirs(os.path.dirname(path))
+    open(path, "w").close()
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. '**/*.c' matches at every depth, including none.
+#
+expected = sorted(tmpdir + "/" + f for f in testfiles
+                  if f.endswith(".c") and not f.startswith("."))
+sendline("echo %s/**/*.c" % tmpdir)
+expect_exact(" ".join(expected), "**/*.c does not work correctly")
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 2. '**' in the middle of a glob.
+#
+sendline("echo %s/a/**/t*.c" % tmpdir)
+expect_exact("%s/a/b/c/three.c %s/a/b/two.c" % (tmpdir, tmpdir),
+             "a/**/t*.c does not work correctly")
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 3. A trailing '**/' matches the directories.
+#
+sendline("echo %s/a/**/" % tmpdir)
+expect_exact("%s/a/b/ %s/a/b/c/\r\n" % (tmpdir, tmpdir),
+             "a/**/ does not work correctly")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 4. Globs with thousands of components, one longer than any
+# path, match nothing and are left as they are.  They are read from
+# a script, as a terminal line cannot hold them.
+#
+script = os.path.join(tmpdir, "long_globs")
+f = open(script, "w")
+f.write("echo %s*\necho %s*\n" % ("a/" * 3000, "a/" * 2000))
+f.close()
+sendline("%s %s" % (os.path.abspath("cush"), script))
+expect_exact("a/a/*\r\n", "a glob longer than any path was not left as it is")
+expect_exact("a/a/*\r\n", "a glob of 2000 components was not left as it is")
+expect_prompt("Shell did not print expected prompt (5)")
+
+test_success()
@@ -0,0 +1,268 @@
+/*
+ * Support for the 'limit' builtin prefix, which records
+ * rlimits on a job and installs them in its child processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "resource_limits.h"
+#include "utils.h"
+
+/* How the value of an option is interpreted */
+enum limit_unit {
+    LIMIT_BYTES,        /* accepts K, M, G, T suffixes */
+    LIMIT_SECONDS,      /* accepts s, m, h suffixes */
+    LIMIT_COUNT,        /* plain number */
+};
+
+/* The options understood by 'limit'.  The letters follow ulimit(1). */
+static const struct limit_option {
+    char letter;
+    int resource;
+    enum limit_unit unit;
+    const char *name;
+} limit_options[] = {
+    { 'c', RLIMIT_CORE,   LIMIT_BYTES,   "core file size" },
+    { 'd', RLIMIT_DATA,   LIMIT_BYTES,   "data segment size" },
+    { 'f', RLIMIT_FSIZE,  LIMIT_BYTES,   "file size" },
+    { 'n', RLIMIT_NOFILE, LIMIT_COUNT,   "open files" },
+    { 's', RLIMIT_STACK,  LIMIT_BYTES,   "stack size" },
+    { 't', RLIMIT_CPU,    LIMIT_SECONDS, "CPU time" },
+    { 'u', RLIMIT_NPROC,  LIMIT_COUNT,   "processes" },
+    { 'v', RLIMIT_AS,     LIMIT_BYTES,   "virtual memory" },
+};
+
+#define NOPTIONS (sizeof limit_options / sizeof limit_options[0])
+
+static const struct limit_option *
+find_option(const char *word)
+{
+    if (word[0] != '-' || word[1] == '\0' || word[2] != '\0')
+        return NULL;
+
+    for (int i = 0; i < NOPTIONS; i++)
+        if (limit_options[i].letter == word[1])
+            return &limit_options[i];
+    return NULL;
+}
+
+/* Convert 'value' to an rlim_t according to the option's unit.
+ * Returns false if the value is malformed. */
+static bool
+parse_value(const struct limit_option *opt, const char *value, rlim_t *out)
+{
+    if (strcasecmp(value, "unlimited") == 0) {
+        *out = RLIM_INFINITY;
+        return true;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(value, &end, 10);
+    if (end == value || value[0] == '-' || errno == ERANGE)
+        return false;
+
+    unsigned long long scale = 1;
+    if (*end != '\0') {
+        if (end[1] != '\0')
+            return false;
+
+        switch (opt->unit) {
+        case LIMIT_BYTES:
+            switch (*end) {
+            case 'k': case 'K': scale = 1ULL << 10; break;
+            case 'm': case 'M': scale = 1ULL << 20; break;
+            case 'g': case 'G': scale = 1ULL << 30; break;
+            case 't': case 'T': scale = 1ULL << 40; break;
+            default: return false;
+            }
+            break;
+        case LIMIT_SECONDS:
+            switch (*end) {
+            case 's': scale = 1; break;
+            case 'm': scale = 60; break;
+            case 'h': scale = 3600; break;
+            default: return false;
+            }
+            break;
+        case LIMIT_COUNT:
+            return false;
+        }
+    }
+
+    /* a value that wraps around could install a tiny limit */
+    if (v > RLIM_INFINITY / scale)
+        return false;
+    *out = v * scale;
+    return true;
+}
+
+/* Record 'value' for 'opt', replacing an earlier setting of the same
+ * resource.  Returns false if the value exceeds the shell's own hard
+ * limit, which an unprivileged child could not install. */
+static bool
+record_limit(struct resource_limits *rl, const struct limit_option *opt,
+             rlim_t value)
+{
+    struct rlimit current;
+    if (getrlimit(opt->resource, &current) == -1) {
+        utils_error("getrlimit failed for %s: ", opt->name);
+        return false;
+    }
+
+    if (current.rlim_max != RLIM_INFINITY
+            && (value == RLIM_INFINITY || value > current.rlim_max)) {
+        printf("limit: %s exceeds the hard limit of %llu\n",
+               opt->name, (unsigned long long) current.rlim_max);
+        return false;
+    }
+
+    struct rlimit limit = { .rlim_cur = value, .rlim_max = value };
+
+    /* Leave one second of headroom between the soft and the hard CPU
+     * limit so the job sees SIGXCPU rather than an anonymous SIGKILL. */
+    if (opt->resource == RLIMIT_CPU && value != RLIM_INFINITY
+            && value < current.rlim_max)
+        limit.rlim_max = value + 1;
+
+    int i;
+    for (i = 0; i < rl->count; i++)
+        if (rl->entries[i].resource == opt->resource)
+            break;
+
+    if (i == RESOURCE_LIMITS_MAX)
+        return false;
+
+    rl->entries[i].resource = opt->resource;
+    rl->entries[i].limit = limit;
+    if (i == rl->count)
+        rl->count++;
+    return true;
+}
+
+int
+resource_limits_parse(struct resource_limits *rl, char **argv)
+{
+    int used = 0;
+
+    while (argv[used] != NULL && argv[used][0] == '-') {
+        const struct limit_option *opt = find_option(argv[used]);
+        if (opt == NULL) {
+            printf("limit: unknown option '%s'\n", argv[used]);
+            resource_limits_usage();
+            return -1;
+        }
+
+        char *value = argv[used + 1];
+        rlim_t limit;
+        if (value == NULL || !parse_value(opt, value, &limit)) {
+            printf("limit: invalid value for %s\n", argv[used]);
+            return -1;
+        }
+
+        if (!record_limit(rl, opt, limit))
+            return -1;
+        used += 2;
+    }
+    return used;
+}
+
+bool
+resource_limits_apply(const struct resource_limits *rl)
+{
+    for (int i = 0; i < rl->count; i++) {
+        if (setrlimit(rl->entries[i].resource, &rl->entries[i].limit) == -1) {
+            utils_error("setrlimit failed: ");
+            return false;
+        }
+    }
+    return true;
+}
+
+static const struct rlimit *
+find_limit(const struct resource_limits *rl, int resource)
+{
+    for (int i = 0; i < rl->count; i++)
+        if (rl->entries[i].resource == resource)
+            return &rl->entries[i].limit;
+    return NULL;
+}
+
+static bool
+has_limit(const struct resource_limits *rl, int resource)
+{
+    return find_limit(rl, resource) != NULL;
+}
+
+/* The CPU time in struct rusage is sampled and can come out short of
+ * the time at which the kernel enforced the limit */
+#define CPU_LIMIT_SLACK_US 100000
+
+/* True if a process that used 'usage' ran into its hard CPU limit,
+ * rather than being killed by kill -9 or the OOM killer */
+static bool
+reached_cpu_limit(const struct resource_limits *rl, const struct rusage *usage)
+{
+    const struct rlimit *cpu = find_limit(rl, RLIMIT_CPU);
+    if (cpu == NULL || cpu->rlim_max == RLIM_INFINITY || usage == NULL)
+        return false;
+
+    long long used_us = (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000000LL
+                        + usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+    return used_us + CPU_LIMIT_SLACK_US >= (long long) cpu->rlim_max * 1000000LL;
+}
+
+static bool
+has_memory_limit(const struct resource_limits *rl)
+{
+    return has_limit(rl, RLIMIT_AS)
+        || has_limit(rl, RLIMIT_DATA)
+        || has_limit(rl, RLIMIT_STACK);
+}
+
+const char *
+resource_limits_explain(const struct resource_limits *rl, int status,
+                        const struct rusage *usage)
+{
+    if (rl->count == 0)
+        return NULL;
+
+    if (WIFSIGNALED(status)) {
+        switch (WTERMSIG(status)) {
+        case SIGXCPU:
+            return "CPU time limit exceeded";
+        case SIGXFSZ:
+            return "file size limit exceeded";
+        case SIGKILL:
+            if (reached_cpu_limit(rl, usage))
+                return "killed at the hard CPU time limit";
+            break;
+        case SIGSEGV:
+            if (has_memory_limit(rl))
+                return "segmentation fault under a memory limit";
+            break;
+        }
+    }
+    else if (WIFEXITED(status)) {
+        if (WEXITSTATUS(status) == RESOURCE_LIMITS_ENOMEM_EXIT
+                && has_memory_limit(rl))
+            return "out of memory under a memory limit";
+    }
+    return NULL;
+}
+
+void
+resource_limits_usage(void)
+{
+    printf("Usage: limit [-option value]... command\n");
+    for (int i = 0; i < NOPTIONS; i++)
+        printf("  -%c  %s%s\n", limit_options[i].letter, limit_options[i].name,
+               limit_options[i].unit == LIMIT_BYTES ? " (bytes, K/M/G/T suffix)" :
+               limit_options[i].unit == LIMIT_SECONDS ? " (seconds, m/h suffix)" : "");
+}
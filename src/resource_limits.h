@@ -0,0 +1,47 @@
+#ifndef __RESOURCE_LIMITS_H
+#define __RESOURCE_LIMITS_H
+
+#include <stdbool.h>
+#include <sys/resource.h>
+
+/* Maximum number of distinct limits a single 'limit' prefix can set */
+#define RESOURCE_LIMITS_MAX 8
+
+/* Exit status used by a child whose execvp() failed with ENOMEM,
+ * which happens when the address space limit is too small to even
+ * load the program. */
+#define RESOURCE_LIMITS_ENOMEM_EXIT 125
+
+/* The rlimits recorded for one job.  They are applied in each child
+ * process of the job right before it calls exec. */
+struct resource_limits {
+    int count;                  /* Number of valid entries */
+    struct {
+        int resource;           /* RLIMIT_* constant */
+        struct rlimit limit;    /* Soft and hard limit to install */
+    } entries[RESOURCE_LIMITS_MAX];
+};
+
+/* Parse the options of a 'limit' prefix, e.g. "-v 2G -t 600".
+ * argv points to the first word after 'limit'.  Parsing stops at
+ * the first word that is not an option.  Returns the number of words
+ * consumed, or -1 (after printing a message) if an option is invalid. */
+int resource_limits_parse(struct resource_limits *rl, char **argv);
+
+/* Install the recorded limits in the calling process.
+ * Meant to be called in the child between fork() and exec.
+ * Returns false if a limit could not be set. */
+bool resource_limits_apply(const struct resource_limits *rl);
+
+/* If the wait status 'status' of a process that ran under the limits
+ * 'rl' indicates that one of them was violated, return a message
+ * describing the violation.  Otherwise, return NULL.  'usage' is the
+ * resource usage the process was reaped with, which tells a SIGKILL
+ * at the hard CPU limit from any other; it may be NULL. */
+const char *resource_limits_explain(const struct resource_limits *rl,
+                                    int status, const struct rusage *usage);
+
+/* Print usage information for the 'limit' prefix */
+void resource_limits_usage(void);
+
+#endif /* __RESOURCE_LIMITS_H */
@@ -0,0 +1,77 @@
+#!/usr/bin/python
+#
+# Tests the 'nice' and 'sched' prefixes, which install a priority and a
+# scheduling policy in each command of a job before it execs, and the
+# refusal of a real-time policy to a shell without the privilege for it.
+#
+import atexit, os, shutil, tempfile
+from testutils import *
+
+workdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, workdir)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# fields of /proc/<pid>/stat, counted from 1 as in proc(5)
+STAT_NICE = 19
+STAT_POLICY = 41
+
+# the fields of the stat line that 'cat /proc/self/stat' printed
+def stat_fields():
+    assert console.expect(r'\d+ \(cat\) [^\r]*') == 0, "cat did not print its stat line"
+    return console.after.split()
+
+#################################################################
+# Step 1. 'nice -n 5' runs the command 5 above the shell's nice value,
+# and 'sched batch' with the SCHED_BATCH policy.
+#
+sendline('nice -n 5 cat /proc/self/stat')
+fields = stat_fields()
+assert int(fields[STAT_NICE - 1]) == min(os.nice(0) + 5, 19), "nice -n 5 was not applied"
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('sched batch cat /proc/self/stat')
+fields = stat_fields()
+assert int(fields[STAT_POLICY - 1]) == 3, "sched batch was not applied"     # SCHED_BATCH
+expect_prompt("Shell did not print expected prompt (3)")
+
+#################################################################
+# Step 2. Without CAP_SYS_NICE and with RLIMIT_RTPRIO 0, a real-time
+# policy is refused and the command does not run.  A root test run
+# gives up the capability for a shell started for this step.
+#
+script = os.path.join(workdir, 'script')
+open(script, 'w').write('sched fifo 10 echo ran\necho status $?\n')
+unprivileged = 'prlimit --rtprio=0:0 %s' % os.path.abspath('cush')
+if os.getuid() == 0:
+    unprivileged = 'setpriv --bounding-set=-sys_nice --inh-caps=-sys_nice ' + unprivileged
+sendline('%s < %s' % (unprivileged, script))
+expect_exact('sched_setscheduler fifo failed: Operation not permitted',
+             "the real-time policy was not refused")
+expect_exact('status 1', "the refused command did not fail")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 3. Invalid policies and priorities are rejected.
+#
+sendline('sched fifo 0 echo notrun')
+expect_exact('sched: priority for fifo must be between', "an invalid priority was accepted")
+expect_prompt("Shell did not print expected prompt (5)")
+
+#################################################################
+# Step 4. 'nice' also takes nice(1)'s '-N' form, and leaves options it
+# does not know to the nice program.
+#
+sendline('nice -3 cat /proc/self/stat')
+fields = stat_fields()
+assert int(fields[STAT_NICE - 1]) == min(os.nice(0) + 3, 19), "nice -3 was not applied"
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline('nice --version')
+expect_exact('nice (GNU coreutils)', "nice --version did not run the nice program")
+expect_prompt("Shell did not print expected prompt (7)")
+
+test_success()
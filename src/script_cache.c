@@ -0,0 +1,241 @@
+/*
+ * Cache of compiled scripts.
+ *
+ * A script that is sourced at every start, such as an rc file, would
+ * otherwise be read, parsed and compiled each time.  Its program is
+ * instead stored in a cache directory, in a file named after a hash of
+ * the script's path, behind a header recording the device, inode, size
+ * and mtime the script had when it was compiled.  When these still
+ * match, the file is mapped and its image is run in place; nothing is
+ * decoded or copied.  A cache file is written under a temporary name
+ * and renamed, so a shell never maps one that is half written, and
+ * any error while caching only means the script is compiled again.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script_cache.h"
+#include "shell-ast.h"
+#include "utils.h"
+
+#define SCRIPT_CACHE_MAGIC "cushsc1"
+
+/* A cache file is this header, then the script's path padded with
+ * NULs to a multiple of 8 bytes, then the image of its program */
+struct cache_header {
+    char magic[8];
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t use_slots;
+    uint32_t path_space;        /* bytes taken by the padded path */
+};
+
+static void
+make_header(struct cache_header *header, const struct stat *st,
+            const char *path, bool use_slots)
+{
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, SCRIPT_CACHE_MAGIC, sizeof header->magic);
+    header->dev = st->st_dev;
+    header->ino = st->st_ino;
+    header->size = st->st_size;
+    header->mtime_sec = st->st_mtim.tv_sec;
+    header->mtime_nsec = st->st_mtim.tv_nsec;
+    header->use_slots = use_slots;
+    header->path_space = (strlen(path) + 1 + 7) & ~7u;
+}
+
+/* Return the name of the cache file for the script at 'path', which
+ * is absolute, in 'dir' */
+static char *
+cache_file_name(const char *dir, const char *path)
+{
+    uint64_t h = 14695981039346656037ull;   /* FNV-1a */
+    for (const char *p = path; *p; p++)
+        h = (h ^ (unsigned char) *p) * 1099511628211ull;
+
+    char *name;
+    if (asprintf(&name, "%s/%016llx", dir, (unsigned long long) h) == -1)
+        utils_fatal_error("out of memory naming a cache file: ");
+    return name;
+}
+
+/* Map the program cached in 'name' if it was compiled from the script
+ * described by 'expected' */
+static struct bytecode_program *
+map_cached(const char *name, const struct cache_header *expected,
+           const char *path)
+{
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    size_t offset = sizeof *expected + expected->path_space;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size > offset)
+        mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    struct bytecode_program *prog = NULL;
+    const char *cached_path = (const char *) mapping + sizeof *expected;
+    if (memcmp(mapping, expected, sizeof *expected) == 0
+        && strcmp(cached_path, path) == 0)  /* not another path with its hash */
+        prog = bytecode_load((const char *) mapping + offset, st.st_size - offset);
+
+    if (prog == NULL) {
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+    prog->mapping = mapping;
+    prog->mapping_size = st.st_size;
+    return prog;
+}
+
+/* Create 'dir' and its missing parents, private to the user */
+static void
+make_directory(const char *dir)
+{
+    char *p = strdup(dir);
+    if (p == NULL)
+        return;
+    for (char *slash = strchr(p + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(p, 0700);
+        *slash = '/';
+    }
+    mkdir(p, 0700);
+    free(p);
+}
+
+/* Store 'prog' in the cache file 'name', replacing what was there */
+static void
+store(const char *name, const struct cache_header *header, const char *path,
+      const struct bytecode_program *prog)
+{
+    char *temp;
+    if (asprintf(&temp, "%s.XXXXXX", name) == -1)
+        return;
+
+    int fd = mkostemp(temp, O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) {  /* the first time, create the cache */
+        char *slash = strrchr(temp, '/');
+        *slash = '\0';
+        make_directory(temp);
+        *slash = '/';
+        memcpy(temp + strlen(temp) - 6, "XXXXXX", 6);
+        fd = mkostemp(temp, O_CLOEXEC);
+    }
+    if (fd == -1) {
+        free(temp);
+        return;
+    }
+
+    char padded[header->path_space];
+    memset(padded, 0, sizeof padded);
+    strcpy(padded, path);
+    bool ok = write(fd, header, sizeof *header) == sizeof *header
+              && write(fd, padded, sizeof padded) == (ssize_t) sizeof padded
+              && bytecode_save(prog, fd);
+    if (close(fd) != 0 || !ok || rename(temp, name) != 0)
+        unlink(temp);
+    free(temp);
+}
+
+/* Read, parse and compile the script open as 'fd', of 'size' bytes */
+static struct bytecode_program *
+compile(int fd, size_t size, bool use_slots)
+{
+    char *text = malloc(size + 1);
+    if (text == NULL)
+        utils_fatal_error("out of memory reading a script: ");
+
+    size_t length = 0;
+    while (length < size) {
+        ssize_t n = read(fd, text + length, size - length);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) {
+            free(text);
+            return NULL;
+        }
+        if (n == 0)             /* it shrank while being read */
+            break;
+        length += n;
+    }
+    text[length] = '\0';
+
+    struct ast_command_line *cmdline = ast_parse_command_line(text);
+    free(text);
+    if (cmdline == NULL) {
+        errno = 0;
+        return NULL;
+    }
+    struct bytecode_program *prog = bytecode_compile(cmdline, use_slots);
+    ast_command_line_free(cmdline);
+    return prog;
+}
+
+struct bytecode_program *
+script_cache_load(const char *path, const char *dir, bool use_slots)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+        if (S_ISDIR(st.st_mode))
+            errno = EISDIR;
+        close(fd);
+        return NULL;
+    }
+
+    if (dir == NULL) {
+        struct bytecode_program *prog = compile(fd, st.st_size, use_slots);
+        close(fd);
+        return prog;
+    }
+
+    /* the cache is keyed by the absolute path */
+    char *absolute = NULL;
+    if (*path != '/') {
+        char *cwd = getcwd(NULL, 0);
+        if (cwd == NULL || asprintf(&absolute, "%s/%s", cwd, path) == -1)
+            utils_fatal_error("out of memory naming a script: ");
+        free(cwd);
+        path = absolute;
+    }
+
+    struct cache_header header;
+    make_header(&header, &st, path, use_slots);
+    char *name = cache_file_name(dir, path);
+
+    struct bytecode_program *prog = map_cached(name, &header, path);
+    if (prog == NULL) {
+        prog = compile(fd, st.st_size, use_slots);
+        if (prog != NULL && st.st_mtime < time(NULL) - SCRIPT_CACHE_MIN_AGE)
+            store(name, &header, path, prog);
+    }
+
+    int saved_errno = errno;
+    close(fd);
+    free(name);
+    free(absolute);
+    errno = saved_errno;
+    return prog;
+}
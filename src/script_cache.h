@@ -0,0 +1,22 @@
+#ifndef __SCRIPT_CACHE_H
+#define __SCRIPT_CACHE_H
+
+#include <stdbool.h>
+
+#include "bytecode.h"
+
+/* Scripts modified less than this many seconds ago are not cached,
+ * since a change within the resolution of the file system's clock
+ * would leave size and mtime as they were */
+#define SCRIPT_CACHE_MIN_AGE 2
+
+/* Return the program compiled from the script at 'path'.  If 'dir' is
+ * not NULL, the program is mapped from the copy cached there when that
+ * was compiled from the script as it is now, with the same 'use_slots',
+ * and else compiled and stored there for the next time.  Returns NULL
+ * with errno set if the script cannot be read, or with errno 0 if it
+ * has a syntax error, which the parser has printed. */
+struct bytecode_program *script_cache_load(const char *path, const char *dir,
+                                           bool use_slots);
+
+#endif /* __SCRIPT_CACHE_H */
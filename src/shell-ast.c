@@ -10,6 +10,7 @@
 #include <sys/types.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "shell-ast.h"
 
@@ -21,9 +22,62 @@ ast_command_create(char ** argv, bool dup_stderr_to_stdout)
 
     cmd->argv = argv;
     cmd->dup_stderr_to_stdout = dup_stderr_to_stdout;
+    cmd->group = NULL;
+    cmd->subshell = false;
+    cmd->function_name = NULL;
+    cmd->compound = NULL;
+    cmd->path = NULL;
+    cmd->inherit_fds = NULL;
     return cmd;
 }
 
+/* Create a group command.  Takes ownership of cmdline. */
+struct ast_command *
+ast_command_create_group(struct ast_command_line *cmdline, bool subshell,
+                         bool dup_stderr_to_stdout)
+{
+    char **argv = calloc(1, sizeof *argv);
+    struct ast_command *cmd = ast_command_create(argv, dup_stderr_to_stdout);
+
+    cmd->group = cmdline;
+    cmd->subshell = subshell;
+    return cmd;
+}
+
+/* Create a compound command.  Takes ownership of compound. */
+struct ast_command *
+ast_command_create_compound(struct ast_compound *compound,
+                            bool dup_stderr_to_stdout)
+{
+    char **argv = calloc(1, sizeof *argv);
+    struct ast_command *cmd = ast_command_create(argv, dup_stderr_to_stdout);
+
+    cmd->compound = compound;
+    return cmd;
+}
+
+struct ast_compound *
+ast_compound_create(enum ast_compound_kind kind)
+{
+    struct ast_compound *compound = calloc(1, sizeof *compound);
+
+    compound->kind = kind;
+    list_init(&compound->items);
+    return compound;
+}
+
+/* Takes ownership of patterns and body */
+void
+ast_compound_add_case(struct ast_compound *compound, char **patterns,
+                      struct ast_command_line *body)
+{
+    struct ast_case_item *item = malloc(sizeof *item);
+
+    item->patterns = patterns;
+    item->body = body;
+    list_push_back(&compound->items, &item->elem);
+}
+
 /* Create a new pipeline */
 struct ast_pipeline * ast_pipeline_create(char *iored_input, 
                                           char *iored_output, 
@@ -36,6 +90,7 @@ struct ast_pipeline * ast_pipeline_create(char *iored_input,
     pipe->iored_input = iored_input;
     pipe->append_to_output = append_to_output;
     pipe->bg_job = false;
+    pipe->connector = AST_SEQUENCE;
     return pipe;
 }
 
@@ -66,17 +121,177 @@ ast_command_line_create(struct ast_pipeline *pipe)
     return cmdline;
 }
 
+static char *
+copy_word(char *word)
+{
+    return word ? strdup(word) : NULL;
+}
+
+struct ast_command *
+ast_command_copy(struct ast_command *cmd)
+{
+    size_t n = 0;
+    while (cmd->argv[n])
+        n++;
+
+    char **argv = malloc((n + 1) * sizeof *argv);
+    for (size_t i = 0; i <= n; i++)
+        argv[i] = copy_word(cmd->argv[i]);
+
+    struct ast_command *copy = ast_command_create(argv, cmd->dup_stderr_to_stdout);
+    if (cmd->group)
+        copy->group = ast_command_line_copy(cmd->group);
+    if (cmd->compound)
+        copy->compound = ast_compound_copy(cmd->compound);
+    copy->subshell = cmd->subshell;
+    copy->function_name = copy_word(cmd->function_name);
+    copy->path = copy_word(cmd->path);
+    if (cmd->inherit_fds) {
+        size_t nfds = 1;
+        while (cmd->inherit_fds[nfds - 1] != -1)
+            nfds++;
+        copy->inherit_fds = malloc(nfds * sizeof *copy->inherit_fds);
+        memcpy(copy->inherit_fds, cmd->inherit_fds, nfds * sizeof *copy->inherit_fds);
+    }
+    return copy;
+}
+
+static char **
+copy_words(char **words)
+{
+    size_t n = 0;
+    while (words[n])
+        n++;
+
+    char **copy = malloc((n + 1) * sizeof *copy);
+    for (size_t i = 0; i <= n; i++)
+        copy[i] = copy_word(words[i]);
+    return copy;
+}
+
+static struct ast_command_line *
+copy_list(struct ast_command_line *cmdline)
+{
+    return cmdline ? ast_command_line_copy(cmdline) : NULL;
+}
+
+struct ast_compound *
+ast_compound_copy(struct ast_compound *compound)
+{
+    struct ast_compound *copy = ast_compound_create(compound->kind);
+
+    copy->condition = copy_list(compound->condition);
+    copy->body = copy_list(compound->body);
+    copy->else_part = copy_list(compound->else_part);
+    copy->variable = copy_word(compound->variable);
+    if (compound->words)
+        copy->words = copy_words(compound->words);
+    copy->subject = copy_word(compound->subject);
+    for (struct list_elem * e = list_begin(&compound->items); 
+         e != list_end(&compound->items); 
+         e = list_next(e)) {
+        struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+        ast_compound_add_case(copy, copy_words(item->patterns), copy_list(item->body));
+    }
+    return copy;
+}
+
+struct ast_pipeline *
+ast_pipeline_copy(struct ast_pipeline *pipe)
+{
+    struct ast_pipeline *copy = ast_pipeline_create(copy_word(pipe->iored_input),
+                                                    copy_word(pipe->iored_output),
+                                                    pipe->append_to_output);
+    copy->bg_job = pipe->bg_job;
+    copy->connector = pipe->connector;
+    for (struct list_elem * e = list_begin(&pipe->commands); 
+         e != list_end(&pipe->commands); 
+         e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        ast_pipeline_add_command(copy, ast_command_copy(cmd));
+    }
+    return copy;
+}
+
+struct ast_command_line *
+ast_command_line_copy(struct ast_command_line *cmdline)
+{
+    struct ast_command_line *copy = ast_command_line_create_empty();
+    for (struct list_elem * e = list_begin(&cmdline->pipes); 
+         e != list_end(&cmdline->pipes); 
+         e = list_next(e)) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        list_push_back(&copy->pipes, &ast_pipeline_copy(pipe)->elem);
+    }
+    return copy;
+}
+
+static void
+print_words(const char *label, char **words)
+{
+    printf("  %s:", label);
+    while (*words)
+        printf(" %s", *words++);
+    printf("\n");
+}
+
+/* Print ast_compound structure to stdout */
+static void
+ast_compound_print(struct ast_compound *compound)
+{
+    static const char *kinds[] = {
+        [AST_IF] = "if", [AST_WHILE] = "while", [AST_UNTIL] = "until",
+        [AST_FOR] = "for", [AST_CASE] = "case"
+    };
+    printf("  Compound %s\n", kinds[compound->kind]);
+    if (compound->condition) {
+        printf("  Condition:\n");
+        ast_command_line_print(compound->condition);
+    }
+    if (compound->variable) {
+        printf("  Variable: %s\n", compound->variable);
+        print_words("Words", compound->words);
+    }
+    if (compound->subject)
+        printf("  Subject: %s\n", compound->subject);
+    for (struct list_elem * e = list_begin(&compound->items); 
+         e != list_end(&compound->items); 
+         e = list_next(e)) {
+        struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+        print_words("Patterns", item->patterns);
+        ast_command_line_print(item->body);
+    }
+    if (compound->body) {
+        printf("  Body:\n");
+        ast_command_line_print(compound->body);
+    }
+    if (compound->else_part) {
+        printf("  Else:\n");
+        ast_command_line_print(compound->else_part);
+    }
+}
+
 /* Print ast_command structure to stdout */
 void
 ast_command_print(struct ast_command *cmd)
 {
     char **p = cmd->argv;
 
-    printf("  Command:");
-    while (*p)
-        printf(" %s", *p++);
+    if (cmd->function_name)
+        printf("  Defines function %s as:\n", cmd->function_name);
 
-    printf("\n");
+    if (cmd->group) {
+        printf("  Group %s\n", cmd->subshell ? "( )" : "{ }");
+        ast_command_line_print(cmd->group);
+    } else if (cmd->compound) {
+        ast_compound_print(cmd->compound);
+    } else {
+        printf("  Command:");
+        while (*p)
+            printf(" %s", *p++);
+
+        printf("\n");
+    }
 
     if (cmd->dup_stderr_to_stdout)
         printf("  stderr shall also be redirected\n");
@@ -106,6 +321,11 @@ ast_pipeline_print(struct ast_pipeline *pipe)
     if (pipe->iored_input)
         printf("  stdin of the first command reads from %s\n", pipe->iored_input);
 
+    if (pipe->connector == AST_AND)
+        printf("  - runs only if the previous pipeline succeeded\n");
+    else if (pipe->connector == AST_OR)
+        printf("  - runs only if the previous pipeline failed\n");
+
     if (pipe->bg_job)
         printf("  - is a background job\n");
     else
@@ -159,5 +379,43 @@ ast_command_free(struct ast_command * cmd)
         free(*p++);
     }
     free(cmd->argv);
+    if (cmd->group)
+        ast_command_line_free(cmd->group);
+    if (cmd->compound)
+        ast_compound_free(cmd->compound);
+    free(cmd->function_name);
+    free(cmd->path);
+    free(cmd->inherit_fds);
     free(cmd);
 }
+
+static void
+free_words(char **words)
+{
+    for (char **p = words; *p; p++)
+        free(*p);
+    free(words);
+}
+
+void
+ast_compound_free(struct ast_compound *compound)
+{
+    if (compound->condition)
+        ast_command_line_free(compound->condition);
+    if (compound->body)
+        ast_command_line_free(compound->body);
+    if (compound->else_part)
+        ast_command_line_free(compound->else_part);
+    free(compound->variable);
+    if (compound->words)
+        free_words(compound->words);
+    free(compound->subject);
+    for (struct list_elem * e = list_begin(&compound->items); e != list_end(&compound->items); ) {
+        struct ast_case_item *item = list_entry(e, struct ast_case_item, elem);
+        e = list_remove(e);
+        free_words(item->patterns);
+        ast_command_line_free(item->body);
+        free(item);
+    }
+    free(compound);
+}
@@ -7,12 +7,20 @@
 struct ast_command;
 struct ast_pipeline;
 struct ast_command_line;
+struct ast_compound;
 
 /* A command line may contain multiple pipelines. */
 struct ast_command_line {
     struct list/* <ast_pipeline> */ pipes;        /* List of pipelines */
 };
 
+/* How a pipeline is joined to the one before it in a command line */
+enum ast_connector {
+    AST_SEQUENCE,            /* ; or & (or none): the pipeline always runs */
+    AST_AND,                 /* &&: runs only if the exit status so far is 0 */
+    AST_OR,                  /* ||: runs only if the exit status so far is not 0 */
+};
+
 /* A pipeline is a list of one or more commands. 
  * For the purposes of job control, a pipeline forms one job.
  */
@@ -24,6 +32,7 @@ struct ast_pipeline {
                                 file 'iored_output' */
     bool append_to_output;   /* True if user typed >> to append */
     bool bg_job;             /* True if user entered & */
+    enum ast_connector connector; /* How it follows the previous pipeline */
     struct list_elem elem;   /* Link element. */
 };
 
@@ -32,13 +41,70 @@ struct ast_command {
     char **argv;             /* NULL terminated array of pointers to words
                                 making up this command. */
     bool dup_stderr_to_stdout; /* True if stderr should be redirected as well */
+    struct ast_command_line *group; /* If non-NULL, this command is the group
+                                ( list ) or { list; }, and argv is empty */
+    bool subshell;           /* True if the group was written ( list ) */
+    char *function_name;     /* If non-NULL, running this command defines
+                                the function so named as the group */
+    struct ast_compound *compound; /* If non-NULL, this command is an if,
+                                while, until, for or case command, and
+                                argv is empty */
+    char *path;              /* If non-NULL, the program to run, already
+                                looked up in PATH */
+    int *inherit_fds;        /* If non-NULL, fds of the shell, ending
+                                with -1, that the command inherits */
     struct list_elem elem;   /* Link element to link commands in pipeline. */
 };
 
+/* Kinds of compound commands */
+enum ast_compound_kind {
+    AST_IF,                  /* if condition; then body; else else_part; fi */
+    AST_WHILE,               /* while condition; do body; done */
+    AST_UNTIL,               /* until condition; do body; done */
+    AST_FOR,                 /* for variable in words; do body; done */
+    AST_CASE,                /* case subject in items esac */
+};
+
+/* One 'pattern | pattern) body ;;' of a case command */
+struct ast_case_item {
+    char **patterns;         /* NULL terminated */
+    struct ast_command_line *body;
+    struct list_elem elem;
+};
+
+/* A compound command; the fields its kind does not use are NULL */
+struct ast_compound {
+    enum ast_compound_kind kind;
+    struct ast_command_line *condition;  /* if, while, until */
+    struct ast_command_line *body;       /* if, while, until, for */
+    struct ast_command_line *else_part;  /* if: the else part, with an
+                                            elif as a nested if; may be NULL */
+    char *variable;          /* for */
+    char **words;            /* for: NULL terminated */
+    char *subject;           /* case */
+    struct list/* <ast_case_item> */ items;  /* case */
+};
+
 /* Create new command structure and initialize it */
 struct ast_command * ast_command_create(char ** argv,
                                         bool dup_stderr_to_stdout);
 
+/* Create a command that runs the group 'cmdline' */
+struct ast_command * ast_command_create_group(struct ast_command_line *cmdline,
+                                              bool subshell,
+                                              bool dup_stderr_to_stdout);
+
+/* Create a command that runs 'compound' */
+struct ast_command * ast_command_create_compound(struct ast_compound *compound,
+                                                 bool dup_stderr_to_stdout);
+
+/* Create a compound command without any parts */
+struct ast_compound * ast_compound_create(enum ast_compound_kind kind);
+
+/* Add an item to a case command */
+void ast_compound_add_case(struct ast_compound *compound, char **patterns,
+                           struct ast_command_line *body);
+
 /* Create a new pipeline containing only one command */
 struct ast_pipeline * ast_pipeline_create(char *iored_input, 
                                           char *iored_output, 
@@ -53,10 +119,18 @@ struct ast_command_line * ast_command_line_create_empty(void);
 /* Create a command line with a single pipeline */
 struct ast_command_line * ast_command_line_create(struct ast_pipeline *pipe);
 
+/* Deep copies, so that a stored command line can be run, which
+ * expands its words in place and frees it, any number of times */
+struct ast_command_line * ast_command_line_copy(struct ast_command_line *);
+struct ast_pipeline * ast_pipeline_copy(struct ast_pipeline *);
+struct ast_command * ast_command_copy(struct ast_command *);
+struct ast_compound * ast_compound_copy(struct ast_compound *);
+
 /* Deallocation functions */
 void ast_command_line_free(struct ast_command_line *);
 void ast_pipeline_free(struct ast_pipeline *);
 void ast_command_free(struct ast_command *);
+void ast_compound_free(struct ast_compound *);
 
 /* Print functions */
 void ast_command_print(struct ast_command *cmd);
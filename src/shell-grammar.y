@@ -14,6 +14,7 @@
 %{
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #define YYDEBUG	1
 int yydebug;
 void yyerror(const char *msg);
@@ -36,6 +37,10 @@ int yylex(void);
 
 struct cmd_helper {
     struct obstack words;   /* an obstack of char * to collect argv */
+    struct ast_command_line *group; /* commands of a ( ) or { } group */
+    bool subshell;
+    struct ast_compound *compound;  /* an if, while, until, for or case */
+    char *function_name;    /* set for 'name() group' */
     char *iored_input;
     char *iored_output;
     bool append_to_output;
@@ -66,6 +71,10 @@ init_cmd(char *firstcmd,
     if (firstcmd)
         obstack_ptr_grow(&cmd->words, firstcmd);
 
+    cmd->group = NULL;
+    cmd->subshell = false;
+    cmd->compound = NULL;
+    cmd->function_name = NULL;
     cmd->iored_output = iored_output;
     cmd->iored_input = iored_input;
     cmd->append_to_output = append_to_output;
@@ -76,12 +85,111 @@ init_cmd(char *firstcmd,
 /* print error message */
 static void p_error(char *msg);
 
+/* Initialize cmd_helper for a ( ) or { } group */
+static struct cmd_helper *
+init_group(struct ast_command_line *cmdline, bool subshell)
+{
+    /* Error: '( )' */
+    if (list_empty(&cmdline->pipes)) {
+        ast_command_line_free(cmdline);
+        p_error(INVNUL);
+        return NULL;
+    }
+
+    struct cmd_helper * cmd = init_cmd(NULL, NULL, NULL, false, false);
+    cmd->group = cmdline;
+    cmd->subshell = subshell;
+    return cmd;
+}
+
+/* Return the NULL-terminated array of the words collected in 'cmd',
+ * which is freed */
+static char **
+finish_words(struct cmd_helper *cmd)
+{
+    obstack_ptr_grow(&cmd->words, NULL);
+
+    int sz = obstack_object_size(&cmd->words);
+    char **words = malloc(sz);
+    memcpy(words, obstack_finish(&cmd->words), sz);
+    obstack_free(&cmd->words, NULL);
+    free(cmd);
+    return words;
+}
+
+/* Initialize cmd_helper for a compound command.  Its condition and
+ * body, where it has them, must not be empty. */
+static struct cmd_helper *
+init_compound(struct ast_compound *compound)
+{
+    /* Error: 'while ; do ; done' */
+    if ((compound->condition && list_empty(&compound->condition->pipes))
+        || (compound->body && list_empty(&compound->body->pipes))) {
+        ast_compound_free(compound);
+        p_error(INVNUL);
+        return NULL;
+    }
+
+    struct cmd_helper * cmd = init_cmd(NULL, NULL, NULL, false, false);
+    cmd->compound = compound;
+    return cmd;
+}
+
+/* Create a compound command with a condition and a body */
+static struct ast_compound *
+make_conditional(enum ast_compound_kind kind, struct ast_command_line *condition,
+                 struct ast_command_line *body)
+{
+    struct ast_compound *compound = ast_compound_create(kind);
+    compound->condition = condition;
+    compound->body = body;
+    return compound;
+}
+
+/* Check that the word after 'for NAME' or 'case WORD' is 'in' */
+static bool
+expect_in(char *word)
+{
+    bool in = strcmp(word, "in") == 0;
+    free(word);
+    return in;
+}
+
+/* Add the redirection parsed into 'redir' to 'cmd' */
+static bool
+add_redirection(struct cmd_helper *cmd, struct cmd_helper *redir)
+{
+    obstack_free(&redir->words, NULL);
+    if (redir->iored_input) {
+        /* Error: ambiguous redirect 'a <b <c' */
+        if (cmd->iored_input)   { p_error(AMBINP); return false; }
+        cmd->iored_input = redir->iored_input;
+    } else {
+        /* Error: ambiguous redirect 'a >b >c' */
+        if (cmd->iored_output) { p_error(AMBOUT); return false; }
+        cmd->iored_output = redir->iored_output;
+        cmd->append_to_output = redir->append_to_output;
+        cmd->redirect_stderr = redir->redirect_stderr;
+    }
+    free(redir);
+    return true;
+}
+
 /* Convert cmd_helper to ast_command.
  * Ensures NULL-terminated argv[] array
  */
 static struct ast_command * 
 make_ast_command(struct cmd_helper *cmd)
 {
+    if (cmd->group || cmd->compound) {
+        obstack_free(&cmd->words, NULL);
+        struct ast_command *group = cmd->group
+            ? ast_command_create_group(cmd->group, cmd->subshell, cmd->redirect_stderr)
+            : ast_command_create_compound(cmd->compound, cmd->redirect_stderr);
+        group->function_name = cmd->function_name;
+        return group;
+    }
+
     obstack_ptr_grow(&cmd->words, NULL);
 
     int sz = obstack_object_size(&cmd->words);
@@ -115,12 +223,35 @@ add_to_pipeline(struct pipe_helper *pipe,
     }
 
     int sz = obstack_object_size(&cmd->words);
-    if (sz == 0) { p_error(INVNUL); return false; }
+    if (sz == 0 && !cmd->group && !cmd->compound) { p_error(INVNUL); return false; }
 
     list_push_back(&pipe->commands, &cmd->elem);
     return true;
 }
 
+/* Append the pipelines of an and-or list to 'cmdline'.  An and-or
+ * list of several pipelines that is run in the background becomes a
+ * ( ) group, so that the & applies to all of it, as in 'make && ./t &'. */
+static void
+add_and_or(struct ast_command_line *cmdline, struct ast_command_line *and_or,
+           bool bg_job)
+{
+    if (bg_job && list_size(&and_or->pipes) > 1) {
+        struct ast_pipeline *pipe = ast_pipeline_create(NULL, NULL, false);
+        ast_pipeline_add_command(pipe, ast_command_create_group(and_or, true, false));
+        pipe->bg_job = true;
+        list_push_back(&cmdline->pipes, &pipe->elem);
+        return;
+    }
+
+    struct ast_pipeline * last;
+    last = list_entry(list_back(&and_or->pipes), struct ast_pipeline, elem);
+    last->bg_job = bg_job;
+    while (!list_empty(&and_or->pipes))
+        list_push_back(&cmdline->pipes, list_pop_front(&and_or->pipes));
+    free(and_or);
+}
+
 /* Called by parser when command line is complete */
 static void cmdline_complete(struct ast_command_line *);
 
@@ -135,46 +266,58 @@ static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
   struct pipe_helper *pipe;
   struct ast_pipeline *ast_pipe;
   struct ast_command_line *cmdline;
+  struct ast_compound *compound;
   char *word;
 }
 
 /* Nonterminals */
 %type <command> input output
-%type <command> command
+%type <command> command group stage word_list patterns
 %type <pipe> pipeline
 %type <ast_pipe> ast_pipeline
-%type <cmdline> cmd_list
+%type <cmdline> cmd_list terminated_list and_or else_part
+%type <compound> case_items
 
 /* Terminals */
 %token <word> WORD
-%token GREATER_GREATER GREATER_AMPERSAND PIPE_AMPERSAND
+%token GREATER_GREATER GREATER_AMPERSAND PIPE_AMPERSAND AND_AND OR_OR
+%token IF THEN ELIF ELSE FI WHILE UNTIL DO DONE FOR CASE ESAC DSEMI
 
 %%
 cmd_line: cmd_list { cmdline_complete($1); }
 
-cmd_list:	/* Null Command */ { $$ = ast_command_line_create_empty(); }
-|		ast_pipeline { 
-            $$ = ast_command_line_create($1);
-        } 
-|		cmd_list ';'
-|		cmd_list '&' {
+cmd_list:	terminated_list
+|		terminated_list and_or {
             $$ = $1;
-            struct ast_pipeline * last;
-            last = list_entry(list_back(&$1->pipes), 
-                              struct ast_pipeline, elem);
-            last->bg_job = true;
+            add_and_or($$, $2, false);
         }
-|		cmd_list ';' ast_pipeline	{ 
+
+/* and-or lists, each followed by ;, a newline or & */
+terminated_list:	/* Null Command */ { $$ = ast_command_line_create_empty(); }
+|		terminated_list separator
+|		terminated_list and_or separator {
             $$ = $1;
-            list_push_back(&$$->pipes, &$3->elem);
+            add_and_or($$, $2, false);
         }
-|		cmd_list '&' ast_pipeline	{ 
-            struct ast_pipeline * last;
-            last = list_entry(list_back(&$1->pipes), 
-                              struct ast_pipeline, elem);
-            last->bg_job = true;
+|		terminated_list and_or '&' {
+            $$ = $1;
+            add_and_or($$, $2, true);
+        }
+
+separator:	';'
+|		'\n'
 
+and_or:	ast_pipeline {
+            $$ = ast_command_line_create($1);
+        }
+|		and_or AND_AND ast_pipeline {
+            $$ = $1;
+            $3->connector = AST_AND;
+            list_push_back(&$$->pipes, &$3->elem);
+        }
+|		and_or OR_OR ast_pipeline {
             $$ = $1;
+            $3->connector = AST_OR;
             list_push_back(&$$->pipes, &$3->elem);
         }
 
@@ -201,17 +344,17 @@ ast_pipeline: pipeline {
             free(pipe);
         }
 
-pipeline: command {
+pipeline: stage {
             $$ = init_pipe();
             if (!add_to_pipeline($$, $1, false))
                 YYABORT;
 		}
-|		pipeline '|' command {
+|		pipeline '|' stage {
             if (!add_to_pipeline($1, $3, false))
                 YYABORT;
             $$ = $1;
 		}
-|		pipeline PIPE_AMPERSAND command {
+|		pipeline PIPE_AMPERSAND stage {
             if (!add_to_pipeline($1, $3, true))
                 YYABORT;
             $$ = $1;
@@ -219,6 +362,105 @@ pipeline: command {
 |		'|' error 	   { p_error(INVNUL); YYABORT; }
 |		pipeline '|' error { p_error(INVNUL); YYABORT; }
 
+stage:	command
+|		group
+|		WORD '(' ')' group {
+            $$ = $4;
+            $$->function_name = $1;
+		}
+
+group:	'(' cmd_list ')' {
+            $$ = init_group($2, true);
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		'{' cmd_list '}' {
+            $$ = init_group($2, false);
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		IF cmd_list THEN cmd_list else_part FI {
+            struct ast_compound *compound = make_conditional(AST_IF, $2, $4);
+            compound->else_part = $5;
+            $$ = init_compound(compound);
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		WHILE cmd_list DO cmd_list DONE {
+            $$ = init_compound(make_conditional(AST_WHILE, $2, $4));
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		UNTIL cmd_list DO cmd_list DONE {
+            $$ = init_compound(make_conditional(AST_UNTIL, $2, $4));
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		FOR WORD WORD word_list separator DO cmd_list DONE {
+            if (!expect_in($3))
+                YYABORT;
+            struct ast_compound *compound = make_conditional(AST_FOR, NULL, $7);
+            compound->variable = $2;
+            compound->words = finish_words($4);
+            $$ = init_compound(compound);
+            if ($$ == NULL)
+                YYABORT;
+		}
+|		CASE WORD WORD case_items ESAC {
+            if (!expect_in($3))
+                YYABORT;
+            $4->subject = $2;
+            $$ = init_compound($4);
+		}
+|		CASE WORD WORD case_items patterns ')' cmd_list ESAC {
+            if (!expect_in($3))
+                YYABORT;
+            $4->subject = $2;
+            ast_compound_add_case($4, finish_words($5), $7);
+            $$ = init_compound($4);
+		}
+|		group input {
+            if (!add_redirection($1, $2))
+                YYABORT;
+            $$ = $1;
+		}
+|		group output {
+            if (!add_redirection($1, $2))
+                YYABORT;
+            $$ = $1;
+		}
+
+/* elif is an if nested in the else part */
+else_part:	/* none */ { $$ = NULL; }
+|		ELSE cmd_list { $$ = $2; }
+|		ELIF cmd_list THEN cmd_list else_part {
+            struct ast_compound *compound = make_conditional(AST_IF, $2, $4);
+            compound->else_part = $5;
+            struct ast_pipeline *pipe = ast_pipeline_create(NULL, NULL, false);
+            ast_pipeline_add_command(pipe, ast_command_create_compound(compound, false));
+            $$ = ast_command_line_create(pipe);
+		}
+
+word_list:	/* none */ { $$ = init_cmd(NULL, NULL, NULL, false, false); }
+|		word_list WORD {
+            $$ = $1;
+            obstack_ptr_grow(&$$->words, $2);
+		}
+
+/* the items of a case, each ended by ;; except possibly the last */
+case_items:	/* none */ { $$ = ast_compound_create(AST_CASE); }
+|		case_items '\n'
+|		case_items patterns ')' cmd_list DSEMI {
+            $$ = $1;
+            ast_compound_add_case($$, finish_words($2), $4);
+		}
+
+patterns:	WORD { $$ = init_cmd($1, NULL, NULL, false, false); }
+|		patterns '|' WORD {
+            $$ = $1;
+            obstack_ptr_grow(&$$->words, $3);
+		}
+
 command:   WORD { 
             $$ = init_cmd($1, NULL, NULL, false, false);
         }
@@ -229,22 +471,14 @@ command:   WORD {
             obstack_ptr_grow(&$$->words, $2);
 		}
 |		command input {
-            obstack_free(&$2->words, NULL);
-            /* Error: ambiguous redirect 'a <b <c' */
-            if ($1->iored_input)   { p_error(AMBINP); YYABORT; }
-            $$ = $1; 
-            $$->iored_input = $2->iored_input;
-            free($2);
+            if (!add_redirection($1, $2))
+                YYABORT;
+            $$ = $1;
 		}
 |		command output {
-            obstack_free(&$2->words, NULL);
-            /* Error: ambiguous redirect 'a >b >c' */
-            if ($1->iored_output) { p_error(AMBOUT); YYABORT; }
-            $$ = $1; 
-            $$->iored_output = $2->iored_output;
-            $$->append_to_output = $2->append_to_output;
-            $$->redirect_stderr = $2->redirect_stderr;
-            free($2);
+            if (!add_redirection($1, $2))
+                YYABORT;
+            $$ = $1;
 		}
 
 input:	'<' WORD { 
@@ -302,6 +536,7 @@ ast_parse_command_line(char * line)
 {
     inputline = line;
     commandline = NULL;
+    command_position = true;
 
     int error = yyparse();
 
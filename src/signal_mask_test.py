@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# Tests the shadow signal mask: the shell keeps SIGCHLD blocked with
+# nested signal_block/signal_unblock pairs and checks the mask without
+# system calls, so a command line of 1000 background jobs changes the
+# signal mask only a handful of times ('trace' reports the count).
+#
+import re
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+njobs = 1000
+
+def mask_changes():
+    sendline('trace')
+    count = int(expect_regex(r'(\d+) signal mask changes')[0])
+    expect_prompt("Shell did not print expected prompt (trace)")
+    return count
+
+before = mask_changes()
+
+#################################################################
+# Step 1. Start and reap 1000 background jobs.
+#
+sendline(' '.join(['true &'] * njobs))
+console.timeout = 10    # the prompt follows the start and Done lines of all jobs
+expect_prompt("Shell did not print expected prompt (2)")
+console.timeout = 2
+# jobs that finished are deleted between pipelines, so job ids are reused
+started = re.findall(r'\[\d+\] \d+\r\n', console.before)
+assert len(started) == njobs, "%d of %d jobs were started" % (len(started), njobs)
+
+# a foreground job, which reaps whatever is left
+sendline('sleep 0.5')
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('jobs')
+expect_exact('There are currently no jobs', "not all jobs were reaped")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 2. The signal mask changed a few times per command line, not
+# per job.
+#
+changes = mask_changes() - before
+assert changes < 50, "%d signal mask changes for %d jobs" % (changes, njobs)
+
+test_success()
@@ -1,6 +1,16 @@
 /*
  * Signal-related utility functions
  *
+ * The signal mask is mirrored in a shadow copy, so that checking it
+ * makes no system call, and blocking nests: signal_block and
+ * signal_unblock calls come in pairs, and only the outermost pair
+ * changes the real mask.  Handlers installed with signal_set_handler
+ * run through a trampoline that makes the shadow reflect the mask the
+ * kernel installs for the handler, and puts it back afterwards, just
+ * as the kernel restores the real mask when the handler returns.
+ * Only the shell's main thread, on which its handlers run, uses these
+ * functions.
+ *
  * Refactored by Godmar Back for CS 3214 Summer 2020
  * Virginia Tech.
  */
@@ -9,45 +19,103 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <ucontext.h>
 
 #include "signal_support.h"
 #include "utils.h"
 
-/* Return true if this signal is blocked */
-bool 
-signal_is_blocked(int sig)
+static sigset_t shadow_mask;    /* the mask of the main thread */
+static bool shadow_valid;       /* false until first used */
+static int block_depth[NSIG];   /* unmatched signal_block calls */
+static unsigned long mask_changes;  /* sigprocmask calls made */
+
+static sa_sigaction_t handlers[NSIG];
+
+static void
+load_shadow(void)
 {
-    sigset_t mask;
-    if (sigprocmask(0, NULL, &mask) == -1)
+    if (shadow_valid)
+        return;
+    if (sigprocmask(0, NULL, &shadow_mask) == -1)
         utils_error("sigprocmask failed while retrieving current mask");
+    mask_changes++;
+    shadow_valid = true;
+}
 
-    return sigismember(&mask, sig);
+/* Return true if this signal is blocked */
+bool
+signal_is_blocked(int sig)
+{
+    load_shadow();
+    return sigismember(&shadow_mask, sig);
 }
 
 /* Helper for signal_block and signal_unblock */
-static bool
+static void
 __mask_signal(int sig, int how)
 {
-    sigset_t mask, omask;
+    sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, sig);
-    if (sigprocmask(how, &mask, &omask) != 0)
+    if (sigprocmask(how, &mask, NULL) != 0)
         utils_error("sigprocmask failed for %d/%d", sig, how);
-    return sigismember(&omask, sig);
+    mask_changes++;
+    if (how == SIG_BLOCK)
+        sigaddset(&shadow_mask, sig);
+    else
+        sigdelset(&shadow_mask, sig);
 }
 
 /* Block a signal. Returns true it was blocked before */
-bool 
+bool
 signal_block(int sig)
 {
-    return __mask_signal(sig, SIG_BLOCK);
+    load_shadow();
+    bool was_blocked = sigismember(&shadow_mask, sig);
+    block_depth[sig]++;
+    if (!was_blocked)
+        __mask_signal(sig, SIG_BLOCK);
+    return was_blocked;
 }
 
 /* Unblock a signal. Returns true it was blocked before */
-bool 
+bool
 signal_unblock(int sig)
 {
-    return __mask_signal(sig, SIG_UNBLOCK);
+    load_shadow();
+    bool was_blocked = sigismember(&shadow_mask, sig);
+    if (block_depth[sig] > 0)
+        block_depth[sig]--;
+    if (block_depth[sig] == 0 && was_blocked)
+        __mask_signal(sig, SIG_UNBLOCK);
+    return was_blocked;
+}
+
+unsigned long
+signal_mask_changes(void)
+{
+    return mask_changes;
+}
+
+/* Runs every handler installed with signal_set_handler.  While the
+ * handler runs, the kernel blocks the signal on top of the mask of the
+ * interrupted code, which may be in the middle of a signal_block. */
+static void
+trampoline(int sig, siginfo_t *info, void *ctx)
+{
+    sigset_t saved_mask = shadow_mask;
+    bool saved_valid = shadow_valid;
+
+    shadow_mask = ((ucontext_t *) ctx)->uc_sigmask;
+    sigaddset(&shadow_mask, sig);
+    shadow_valid = true;
+    block_depth[sig]++;
+
+    handlers[sig](sig, info, ctx);
+
+    block_depth[sig]--;
+    shadow_mask = saved_mask;
+    shadow_valid = saved_valid;
 }
 
 /* Install signal handler for signal 'sig' */
@@ -56,9 +124,12 @@ signal_set_handler(int sig, sa_sigaction_t handler)
 {
     sigset_t emptymask;
 
+    assert(sig > 0 && sig < NSIG);
+    handlers[sig] = handler;
+
     sigemptyset(&emptymask);
     struct sigaction sa = {
-        .sa_sigaction = handler,
+        .sa_sigaction = trampoline,
         /* do not block any additional signals (besides 'sig') when
          * signal handler is entered. */
         .sa_mask = emptymask,
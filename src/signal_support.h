@@ -10,12 +10,18 @@ typedef void (*sa_sigaction_t)(int, siginfo_t *, void *);
 /* Return true if this signal is blocked */
 bool signal_is_blocked(int sig);
 
-/* Block a signal. Returns true it was blocked before */
+/* Block a signal. Returns true it was blocked before.
+ * Calls nest: each must be matched by a signal_unblock, and only the
+ * outermost pair changes the signal mask. */
 bool signal_block(int sig);
 
-/* Unblock a signal. Returns true it was blocked before */
+/* Unblock a signal. Returns true it was blocked before.
+ * The signal stays blocked while an outer signal_block is unmatched. */
 bool signal_unblock(int sig);
 
+/* Number of sigprocmask calls made by these functions */
+unsigned long signal_mask_changes(void);
+
 /* Install signal handler for signal 'sig' */
 void signal_set_handler(int sig, sa_sigaction_t handler);
 
@@ -0,0 +1,98 @@
+#!/usr/bin/python
+#
+# Tests scripts: the rc file an interactive shell starts with, 'source'
+# and '.', 'cush script args', and the cache of compiled scripts, which
+# is used while a script is unchanged and compiled again after it changed.
+#
+import atexit, os, shutil, tempfile, time
+from testutils import *
+
+workdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, workdir)
+cachedir = os.path.join(workdir, 'cache')
+
+# the cache leaves alone scripts modified in the last seconds, so each
+# script gets the same mtime in the past
+past = time.time() - 60
+def write_script(name, text):
+    path = os.path.join(workdir, name)
+    f = open(path, 'r+' if os.path.exists(path) else 'w')
+    f.write(text)
+    f.truncate()
+    f.close()
+    os.utime(path, (past, past))
+    return path
+
+rc = write_script('rc', '# set up by the rc file\nrc_greet() { echo hello from rc $1; }\n')
+os.environ['CUSHRC'] = rc
+os.environ['CUSH_CACHE_DIR'] = cachedir
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. The shell ran the rc file at startup.
+#
+sendline('rc_greet you')
+expect_exact('hello from rc you', "the rc file was not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 2. source runs a script in the shell, with any further words
+# as its positional parameters; '.' is the same.
+#
+lib = write_script('lib', 'lib_var=set # a comment\necho args $# $2\n')
+sendline('source %s one two; echo var $lib_var' % lib)
+expect_exact('args 2 two\r\nvar set', "source did not run the script in the shell")
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('. %s three four' % lib)
+expect_exact('args 2 four', "'.' did not run the script")
+expect_prompt("Shell did not print expected prompt (4)")
+
+sendline('source %s/missing; echo status $?' % workdir)
+expect_exact('missing: No such file or directory', "a missing script was not reported")
+expect_exact('status 1', "a missing script did not fail")
+expect_prompt("Shell did not print expected prompt (5)")
+
+#################################################################
+# Step 3. The compiled script is cached, and used for as long as
+# the script's inode, size and mtime stay the same.
+#
+cached = write_script('cached', 'echo first version\n')
+sendline('source %s' % cached)
+expect_exact('first version', "the script did not run")
+expect_prompt("Shell did not print expected prompt (6)")
+assert len(os.listdir(cachedir)) == 3, "the scripts were not cached"
+
+# the same inode, size and mtime: the cached program runs
+write_script('cached', 'echo other version\n')
+sendline('source %s' % cached)
+expect_exact('first version', "the cached program was not used")
+expect_prompt("Shell did not print expected prompt (7)")
+
+# a new size: compiled again
+write_script('cached', 'echo third version!\n')
+sendline('source %s' % cached)
+expect_exact('third version!', "the changed script was not compiled again")
+expect_prompt("Shell did not print expected prompt (8)")
+
+#################################################################
+# Step 4. 'cush script args' runs the script and exits with its
+# status; a syntax error is reported.
+#
+script = write_script('script', 'echo script got $1 $#\nrc_greet x\nfalse\n')
+sendline('%s %s a b; echo status $?' % (os.path.abspath('cush'), script))
+expect_exact('script got a 2', "the script did not get its arguments")
+expect_exact('status 1', "the script did not exit with its status")
+expect_prompt("Shell did not print expected prompt (9)")
+
+broken = write_script('broken', 'echo (\n')
+sendline('source %s; echo status $?' % broken)
+expect_exact('syntax error', "the syntax error was not reported")
+expect_exact('status 2', "a script with a syntax error did not fail")
+expect_prompt("Shell did not print expected prompt (10)")
+
+test_success()
@@ -0,0 +1,93 @@
+/*
+ * Timings of the phases of the shell's startup, for --startup-profile.
+ *
+ * main marks the end of each phase: reading arguments, setting up the
+ * variables, the terminal, history and completion, and running the rc
+ * file or script.  The profile ends where the shell has done something
+ * useful: at the first prompt of an interactive shell, just before the
+ * first command is exec'd, or at exit if none was.  Times are taken
+ * from the monotonic clock and shown in milliseconds, each phase with
+ * its own time and the time since main was entered.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "startup_profile.h"
+#include "utils.h"
+
+struct phase {
+    const char *name;
+    struct timespec end;
+};
+
+static bool active;
+static int report_fd = -1;
+static struct timespec begin;
+static struct phase phases[STARTUP_PROFILE_MAX_PHASES];
+static int nphases;
+
+static double
+ms_between(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e3 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+void
+startup_profile_begin(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+}
+
+void
+startup_profile_enable(void)
+{
+    report_fd = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    active = report_fd != -1;
+}
+
+void
+startup_profile_mark(const char *name)
+{
+    if (!active || nphases == STARTUP_PROFILE_MAX_PHASES)
+        return;
+    phases[nphases].name = name;
+    clock_gettime(CLOCK_MONOTONIC, &phases[nphases].end);
+    nphases++;
+}
+
+void
+startup_profile_report(const char *name)
+{
+    if (!active)
+        return;
+    startup_profile_mark(name);
+
+    char text[128 * (STARTUP_PROFILE_MAX_PHASES + 1)];
+    int length = snprintf(text, sizeof text, "%-24s %10s %10s\n",
+                          "startup phase", "ms", "since main");
+    const struct timespec *start = &begin;
+    for (int i = 0; i < nphases; i++) {
+        length += snprintf(text + length, sizeof text - length, "%-24s %10.3f %10.3f\n",
+                           phases[i].name, ms_between(start, &phases[i].end),
+                           ms_between(&begin, &phases[i].end));
+        start = &phases[i].end;
+    }
+    if (write(report_fd, text, length) != length)
+        utils_error("cannot write the startup profile: ");
+    startup_profile_stop();
+}
+
+void
+startup_profile_stop(void)
+{
+    if (!active)
+        return;
+    active = false;
+    close(report_fd);
+    report_fd = -1;
+}
@@ -0,0 +1,28 @@
+#ifndef __STARTUP_PROFILE_H
+#define __STARTUP_PROFILE_H
+
+/* Phases recorded at most; later marks are ignored. */
+#define STARTUP_PROFILE_MAX_PHASES 16
+
+/* Note the time main was entered.  Called first thing in main. */
+void startup_profile_begin(void);
+
+/* Turn profiling on, for --startup-profile.  The report goes to a
+ * close-on-exec copy of the current stderr, so that it is not lost
+ * when stderr is redirected for a command. */
+void startup_profile_enable(void);
+
+/* End the current phase, which is named 'name'.  A no-op unless
+ * profiling is on. */
+void startup_profile_mark(const char *name);
+
+/* End the last phase, named 'name', print each phase with its time
+ * and the time since main, and turn profiling off.  The report is
+ * one write, so a forked child may make it just before it execs. */
+void startup_profile_report(const char *name);
+
+/* Turn profiling off without a report, in a shell whose child
+ * reports instead. */
+void startup_profile_stop(void);
+
+#endif /* __STARTUP_PROFILE_H */
@@ -0,0 +1,66 @@
+#!/usr/bin/python
+#
+# Tests --startup-profile, which reports the phases of startup up to the
+# first prompt or the first exec, and a shell that is not interactive:
+# one that reads its commands from a file without a prompt, readline or
+# job control, and exits with the status of the last command.
+#
+import atexit, os, shutil, tempfile
+from testutils import *
+
+workdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, workdir)
+os.environ['CUSH_CACHE_DIR'] = ''
+
+def write_script(name, text):
+    path = os.path.join(workdir, name)
+    f = open(path, 'w')
+    f.write(text)
+    f.close()
+    return path
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+cush = os.path.abspath('cush')
+
+#################################################################
+# Step 1. Commands read from a file run without a prompt, and the
+# shell exits with the status of the last one.
+#
+commands = write_script('commands', 'x=5\necho got $x\nfalse\n')
+sendline('%s < %s; echo status $?' % (cush, commands))
+expect_exact('got 5\r\nstatus 1', "the commands were not run without a prompt")
+expect_prompt("Shell did not print expected prompt (2)")
+
+#################################################################
+# Step 2. A script's profile ends at its first exec; the profile of
+# one that runs only builtins ends at its exit.
+#
+script = write_script('script', 'x=1\n/bin/true\n')
+sendline('%s --startup-profile %s' % (cush, script))
+expect_exact('startup phase', "no startup profile was printed")
+expect_exact('load script', "the script's phases were not reported")
+expect_exact('first exec', "the profile did not end at the first exec")
+expect_prompt("Shell did not print expected prompt (3)")
+
+builtins = write_script('builtins', 'x=2\nexit 3\n')
+sendline('%s --startup-profile < %s; echo status $?' % (cush, builtins))
+expect_exact('exit', "the profile did not end at exit")
+expect_exact('status 3', "exit did not set the status")
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 3. An interactive shell's profile ends at its first prompt.
+#
+sendline('%s --startup-profile' % cush)
+expect_exact('terminal', "the terminal phase was not reported")
+expect_exact('readline', "the readline phase was not reported")
+expect_exact('prompt', "the profile did not end at the prompt")
+expect_prompt("Shell did not print the nested shell's prompt")
+sendline('exit')
+expect_prompt("Shell did not print expected prompt (5)")
+
+test_success()
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+#
+# Tests that background jobs make the shell do no terminal system
+# calls: terminal ownership and settings are only changed when they
+# differ from what is in place, which the trace records.
+#
+import json, os, re, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+path = '/tmp/cush_tty_test_%d.json' % os.getpid()
+njobs = 1000
+
+def terminal_events(first_prompt):
+    """terminal events recorded after prompt number 'first_prompt'"""
+    sendline('trace dump %s' % path)
+    expect_prompt("Shell did not print expected prompt (dump)")
+    events = [e for e in json.load(open(path))['traceEvents'] if e.get('ph') == 'i']
+    os.unlink(path)
+    start = [i for i, e in enumerate(events)
+             if e['name'] == 'prompt' and e['args']['arg'] == first_prompt][0]
+    return [e for e in events[start:] if e['name'] == 'terminal']
+
+#################################################################
+# Step 1. A foreground job needs the terminal handed over and back.
+#
+sendline('sleep 0')
+expect_prompt("Shell did not print expected prompt (2)")
+assert terminal_events(1), "foreground job did not get the terminal"
+
+#################################################################
+# Step 2. Background jobs through their whole lifecycle.
+#
+sendline(' '.join(['true &'] * njobs))
+console.timeout = 10    # the prompt follows the start and Done lines of all jobs
+expect_prompt("Shell did not print expected prompt (3)")
+console.timeout = 2
+# jobs that finished are deleted between pipelines, so job ids are reused
+started = re.findall(r'\[\d+\] \d+\r\n', console.before)
+assert len(started) == njobs, "%d of %d jobs were started" % (len(started), njobs)
+
+sendline('sleep 30 &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (4)")
+sendline('stop 1')
+expect_prompt("Shell did not print expected prompt (5)")
+sendline('bg 1')
+expect_prompt("Shell did not print expected prompt (6)")
+sendline('kill 1')
+expect_exact('Terminated', "background job was not killed")
+expect_prompt("Shell did not print expected prompt (7)")
+
+events = terminal_events(3)
+assert events == [], "background jobs caused terminal system calls: %s" % events
+
+test_success()
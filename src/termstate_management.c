@@ -2,6 +2,13 @@
  * Utility functions to support managing the terminal 
  * state for a job control shell.
  *
+ * The process group that owns the terminal and the settings last
+ * applied are remembered, so that handing the terminal to its current
+ * owner, or saving settings the shell itself applied, makes no system
+ * call.  Background jobs thus never touch the terminal.  The settings
+ * are known only while the shell owns the terminal: a foreground job
+ * may change them.
+ *
  * Refactored for CS 3214 Summer 2020 Virginia Tech.
  */
 
@@ -11,17 +18,39 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "termstate_management.h"
 #include "utils.h"
 #include "signal_support.h"
+#include "trace.h"
+#include "probes.h"
 
 static int terminal_fd = -1;           /* The controlling terminal */
 static struct termios saved_tty_state; /* The state of the terminal when shell
                                            was started. */
 static int shell_pgrp;          /* The pgrp of the shell when it started */
 
+static pid_t terminal_owner = -1;       /* pgrp last given the terminal */
+static struct termios applied_tty_state; /* Settings the terminal has */
+static bool applied_valid;      /* applied_tty_state is current */
+static bool detached;           /* see termstate_detach */
+
+/* Compare two sets of terminal settings field by field, since the
+ * padding of struct termios is not initialized by tcgetattr */
+static bool
+same_tty_state(const struct termios *a, const struct termios *b)
+{
+    return a->c_iflag == b->c_iflag && a->c_oflag == b->c_oflag
+        && a->c_cflag == b->c_cflag && a->c_lflag == b->c_lflag
+        && a->c_line == b->c_line
+        && memcmp(a->c_cc, b->c_cc, sizeof a->c_cc) == 0
+        && cfgetispeed(a) == cfgetispeed(b)
+        && cfgetospeed(a) == cfgetospeed(b);
+}
+
 /* Initialize tty support. */
 void
 termstate_init(void)
@@ -37,6 +66,7 @@ termstate_init(void)
         utils_fatal_error("cannot mark terminal fd FD_CLOEXEC");
 
     shell_pgrp = getpgrp();
+    terminal_owner = tcgetpgrp(terminal_fd);
     termstate_sample();
 }
 
@@ -45,9 +75,23 @@ termstate_init(void)
 void 
 termstate_save(struct termios *saved_tty_state)
 {
+    if (detached)
+        return;
+
+    if (terminal_owner == shell_pgrp && applied_valid) {
+        *saved_tty_state = applied_tty_state;
+        return;
+    }
+
     int rc = tcgetattr(terminal_fd, saved_tty_state);
     if (rc == -1)
         utils_fatal_error("tcgetattr failed: ");
+    trace_record(TRACE_TERMINAL, 0, terminal_owner, TRACE_TTY_GETATTR, NULL);
+
+    if (terminal_owner == shell_pgrp) {
+        applied_tty_state = *saved_tty_state;
+        applied_valid = true;
+    }
 }
 
 /* Restore terminal to saved settings.
@@ -90,23 +134,50 @@ termstate_get_tty_fd(void)
 void
 termstate_give_terminal_to(struct termios *pg_tty_state, pid_t pgrp)
 {
+    if (detached)
+        return;
+
+    bool set_pgrp = pgrp != terminal_owner;
+    bool set_attr = pg_tty_state != NULL
+        && !(applied_valid && same_tty_state(pg_tty_state, &applied_tty_state));
+    if (!set_pgrp && !set_attr)
+        return;
+
     signal_block(SIGTTOU);
-    int rc = tcsetpgrp(termstate_get_tty_fd(), pgrp);
-    if (rc == -1)
-        utils_fatal_error("tcsetpgrp: ");
+    if (set_pgrp) {
+        int rc = tcsetpgrp(termstate_get_tty_fd(), pgrp);
+        if (rc == -1)
+            utils_fatal_error("tcsetpgrp: ");
+        terminal_owner = pgrp;
+        CUSH_PROBE2(terminal_handover, pgrp, pg_tty_state != NULL);
+    }
 
-    if (pg_tty_state)
+    if (set_attr) {
         termstate_restore(pg_tty_state);
+        applied_tty_state = *pg_tty_state;
+    }
+    applied_valid = pgrp == shell_pgrp && (set_attr || applied_valid);
     signal_unblock(SIGTTOU);
+
+    trace_record(TRACE_TERMINAL, 0, pgrp,
+                 (set_pgrp ? TRACE_TTY_SETPGRP : 0) | (set_attr ? TRACE_TTY_SETATTR : 0), NULL);
 }
 
 void 
 termstate_give_terminal_back_to_shell(void)
 {
+    if (detached)
+        return;
     assert (shell_pgrp > 0 || !!!"termstate_init was not called");
     termstate_give_terminal_to(&saved_tty_state, shell_pgrp);
 }
 
+void
+termstate_detach(void)
+{
+    detached = true;
+}
+
 void
 termstate_sample(void)
 {
@@ -17,6 +17,7 @@ void termstate_save(struct termios *saved_tty_state);
 /**
  * Assign ownership of the terminal to process group
  * pgrp, restoring its terminal state if provided.
+ * Only the system calls that change something are made.
  */
 void termstate_give_terminal_to(struct termios *pg_tty_state, pid_t pgrp);
 
@@ -36,6 +37,15 @@ void termstate_sample(void);
  */
 void termstate_give_terminal_back_to_shell(void);
 
+/*
+ * Stop handing the terminal to process groups, in a forked copy
+ * of the shell that runs a ( ) group.  The commands it starts stay
+ * in its process group, which owns the terminal or not as a whole.
+ * A shell that is not interactive calls it instead of termstate_init,
+ * and never touches the terminal.
+ */
+void termstate_detach(void);
+
 /* Get a file descriptor that refers to controlling terminal */
 int termstate_get_tty_fd(void);
 
@@ -0,0 +1,51 @@
+#!/usr/bin/python
+#
+# Tests the 'throttle' builtin, which limits a background job to a
+# share of a CPU by alternating SIGSTOP and SIGCONT.
+#
+import atexit, proc_check, time, os
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. Start a CPU-bound background job and throttle it to 25%
+#
+sendline('sh -c "while :; do :; done" &')
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (2)")
+
+run_builtin('throttle %s 25', jobid)
+expect_prompt("Shell did not print expected prompt (3)")
+
+def cpu_seconds(pid):
+    stat = open("/proc/%s/stat" % pid).read().split()
+    return (int(stat[13]) + int(stat[14])) / float(os.sysconf('SC_CLK_TCK'))
+
+time.sleep(0.5)
+start_cpu, start_time = cpu_seconds(pid), time.time()
+time.sleep(2)
+share = (cpu_seconds(pid) - start_cpu) / (time.time() - start_time)
+assert share < 0.5, "throttled job used %.2f of a CPU" % share
+
+#################################################################
+# Step 2. The throttle's stops are internal: the job must still be
+# listed as running and no 'Stopped' message may have been printed.
+#
+run_builtin('jobs')
+job = parse_job_line()
+assert job.status == 'running', "throttled job is reported as %s" % job.status
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 3. A throttled job can be killed, even while the throttle
+# has it stopped.
+#
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (5)")
+proc_check.count_children_timeout(console, 0, 1)
+
+test_success()
@@ -0,0 +1,207 @@
+/*
+ * Event trace for post-mortems of job control.
+ *
+ * Events go into a fixed-size ring in a shared anonymous mapping.
+ * A writer claims a slot with one atomic increment of the head
+ * index and publishes it by storing the slot's sequence number last,
+ * so the SIGCHLD handler, the shell and its forked children (which
+ * inherit the mapping) can all record without locks.  Recording costs
+ * a clock_gettime and a few stores; nothing is formatted until the
+ * trace is dumped.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+
+#define TRACE_NAME_SIZE 16
+#define TRACE_MAX_JID (1 << 16)    /* as many as the shell's job table */
+
+struct trace_entry {
+    atomic_ulong seq;           /* index + 1 once the entry is complete */
+    uint64_t ns;                /* CLOCK_MONOTONIC */
+    int32_t type;
+    int32_t jid;
+    int32_t pid;
+    int32_t arg;
+    char name[TRACE_NAME_SIZE];
+};
+
+struct trace_ring {
+    atomic_ulong head;          /* index of the next entry */
+    struct trace_entry entries[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *ring;
+
+static const char *event_names[] = {
+    [TRACE_JOB] = "job",
+    [TRACE_SPAWN] = "spawn",
+    [TRACE_EXEC] = "exec",
+    [TRACE_STOP] = "stop",
+    [TRACE_CONTINUE] = "continue",
+    [TRACE_REAP] = "reap",
+    [TRACE_TERMINAL] = "terminal",
+    [TRACE_PROMPT] = "prompt",
+};
+
+void
+trace_init(void)
+{
+    void *p = mmap(NULL, sizeof *ring, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        ring = p;
+}
+
+void
+trace_record(enum trace_event type, int jid, pid_t pid, int arg,
+             const char *name)
+{
+    if (ring == NULL)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    unsigned long i = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    struct trace_entry *e = &ring->entries[i & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    e->ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+    e->type = type;
+    e->jid = jid;
+    e->pid = pid;
+    e->arg = arg;
+    if (name != NULL) {
+        const char *base = strrchr(name, '/');
+        strncpy(e->name, base != NULL ? base + 1 : name, TRACE_NAME_SIZE - 1);
+        e->name[TRACE_NAME_SIZE - 1] = '\0';
+    } else {
+        e->name[0] = '\0';
+    }
+    atomic_store_explicit(&e->seq, i + 1, memory_order_release);
+}
+
+unsigned long
+trace_count(void)
+{
+    return ring != NULL ? atomic_load(&ring->head) : 0;
+}
+
+/* Copy the complete entries of the ring, oldest first, skipping those
+ * being written or already overwritten.  Returns their number. */
+static size_t
+snapshot(struct trace_entry *out)
+{
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    size_t n = 0;
+
+    for (unsigned long i = first; i < head; i++) {
+        struct trace_entry *e = &ring->entries[i & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&e->seq, memory_order_acquire) != i + 1)
+            continue;
+        memcpy((char *) &out[n] + sizeof e->seq, (char *) e + sizeof e->seq,
+               sizeof *e - sizeof e->seq);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == i + 1)
+            n++;
+    }
+    return n;
+}
+
+/* Print 's' as a JSON string */
+static void
+print_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/* Microseconds since 'base', the unit of Chrome's "ts" and "dur" */
+static double
+usec(uint64_t ns, uint64_t base)
+{
+    return (ns - base) / 1000.0;
+}
+
+bool
+trace_dump(const char *path)
+{
+    static struct trace_entry events[TRACE_RING_SIZE];
+    static unsigned char named[TRACE_MAX_JID / 8];  /* jids given a name */
+    size_t n = ring != NULL ? snapshot(events) : 0;
+    uint64_t base = n > 0 ? events[0].ns : 0;
+    pid_t shell = getpid();
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return false;
+
+    /* Each job is shown as a process and each of its commands as a
+     * thread; events of the shell itself belong to "process" 0. */
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"cush\"}}");
+    memset(named, 0, sizeof named);
+    for (size_t i = 0; i < n; i++) {
+        struct trace_entry *e = &events[i];
+        if (e->type != TRACE_JOB || e->jid >= TRACE_MAX_JID
+            || (named[e->jid / 8] & (1 << e->jid % 8)))
+            continue;
+        named[e->jid / 8] |= 1 << e->jid % 8;
+        fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                    "\"args\":{\"name\":\"job %d\"}}", e->jid, e->jid);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        struct trace_entry *e = &events[i];
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"cush\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%d",
+                event_names[e->type], usec(e->ns, base), e->jid,
+                e->pid != 0 ? e->pid : shell, e->arg);
+        if (e->name[0] != '\0') {
+            fprintf(f, ",\"cmd\":");
+            print_json_string(f, e->name);
+        }
+        fprintf(f, "}}");
+
+        /* A command's lifetime, from its spawn to the matching reap */
+        if (e->type != TRACE_REAP)
+            continue;
+        for (size_t j = i; j-- > 0; ) {
+            if (events[j].type == TRACE_SPAWN && events[j].pid == e->pid) {
+                fprintf(f, ",\n{\"name\":");
+                print_json_string(f, events[j].name);
+                fprintf(f, ",\"cat\":\"process\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"pid\":%d,\"tid\":%d,\"args\":{\"status\":%d}}",
+                        usec(events[j].ns, base), usec(e->ns, events[j].ns),
+                        e->jid, e->pid, e->arg);
+                break;
+            }
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+    return ok;
+}
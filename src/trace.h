@@ -0,0 +1,47 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Number of events kept; older events are overwritten.  Power of 2. */
+#define TRACE_RING_SIZE 8192
+
+/* Kinds of events recorded by the shell */
+enum trace_event {
+    TRACE_JOB,          /* job created for a pipeline */
+    TRACE_SPAWN,        /* process forked, 'arg' is its stage */
+    TRACE_EXEC,         /* child about to exec, recorded by the child */
+    TRACE_STOP,         /* process stopped, 'arg' is the signal */
+    TRACE_CONTINUE,     /* job continued by fg or bg */
+    TRACE_REAP,         /* process reaped, 'arg' is its wait status */
+    TRACE_TERMINAL,     /* terminal system calls for process group 'pid',
+                           'arg' has TRACE_TTY_* bits for the ones made */
+    TRACE_PROMPT,       /* shell about to read a command */
+};
+
+/* System calls recorded by TRACE_TERMINAL */
+#define TRACE_TTY_SETPGRP 1
+#define TRACE_TTY_SETATTR 2
+#define TRACE_TTY_GETATTR 4
+
+/* Map the ring buffer.  It is shared with the shell's children, so
+ * that they can record their own exec.  Without it, recording is a
+ * no-op. */
+void trace_init(void);
+
+/* Record an event with a nanosecond timestamp.  Lock-free and
+ * async-signal-safe; 'name' (a command, may be NULL) is truncated. */
+void trace_record(enum trace_event type, int jid, pid_t pid, int arg,
+                  const char *name);
+
+/* Number of events recorded since trace_init, including those
+ * that have been overwritten */
+unsigned long trace_count(void);
+
+/* Write the events in the ring as Chrome trace-event JSON, which
+ * chrome://tracing and Perfetto open.  Returns false with errno set
+ * if the file could not be written. */
+bool trace_dump(const char *path);
+
+#endif /* __TRACE_H */
@@ -0,0 +1,61 @@
+#!/usr/bin/python
+#
+# Tests the event trace: 'trace dump file.json' writes the recorded
+# spawn, exec, reap, terminal and prompt events in Chrome's
+# trace-event format.
+#
+import json, os
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+path = '/tmp/cush_trace_test_%d.json' % os.getpid()
+
+#################################################################
+# Step 1. Run a foreground pipeline and a background job.
+#
+sendline('echo traced | cat')
+expect_exact('traced', "pipeline did not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline('sleep 0.2 &')
+expect_regex(r'\[1\] (\d+)\r\n')
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('sleep 0.5')
+expect_prompt("Shell did not print expected prompt (4)")
+
+#################################################################
+# Step 2. Dump the trace and check its events.
+#
+sendline('trace dump %s' % path)
+expect_prompt("Shell did not print expected prompt (5)")
+
+events = json.load(open(path))['traceEvents']
+os.unlink(path)
+
+def find(name, cmd=None):
+    return [e for e in events if e['name'] == name and e.get('ph') == 'i'
+            and (cmd is None or e['args'].get('cmd') == cmd)]
+
+for cmd in ('echo', 'cat', 'sleep'):
+    assert find('spawn', cmd), "no spawn event for %s" % cmd
+    assert find('exec', cmd), "no exec event for %s" % cmd
+assert len(find('reap')) == 4, "not every process was reaped in the trace"
+assert find('terminal'), "no terminal handover in the trace"
+assert len(find('prompt')) >= 4, "prompts missing from the trace"
+
+# each command's lifetime is a slice from its spawn to its reap
+slices = [e for e in events if e.get('ph') == 'X']
+assert sorted(e['name'] for e in slices) == ['cat', 'echo', 'sleep', 'sleep'], \
+    "commands are not shown as slices"
+assert all(e['dur'] > 0 for e in slices), "slice has no duration"
+
+# timestamps are in order
+stamps = [e['ts'] for e in events if e.get('ph') == 'i']
+assert stamps == sorted(stamps), "events are not in order"
+
+test_success()
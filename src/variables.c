@@ -0,0 +1,464 @@
+/*
+ * Shell variables and the environment.
+ *
+ * Variables live in an open-addressing hash table with linear
+ * probing; removing one shifts the following entries of its probe
+ * sequence back, so there are no tombstones.  Each variable is stored
+ * as a single "NAME=value" string, which is also what the environment
+ * of a child process consists of.
+ *
+ * The environment passed to children, and pointed to by 'environ',
+ * is an array of pointers to the strings of the exported variables.
+ * Each exported variable knows its index in it, so setting, exporting
+ * or removing one updates a single entry, and neither sourcing many
+ * exports nor starting a command builds or copies the environment.
+ *
+ * A hint remembers the slot a variable was found in, and is good while
+ * the table's generation is the one it was taken in: the generation
+ * changes when the table grows or an entry is removed, which are all
+ * that move variables, so a compiled loop looks up its variables once.
+ *
+ * The shell keeps the exit status in the variable '?', and lists
+ * such as PIPESTATUS as a value of space-separated words, of which
+ * ${NAME[i]} selects one.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "variables.h"
+#include "glob_expansion.h"
+#include "utils.h"
+
+/* 32 bytes, as names and the environment are short: an rc file that
+ * sets thousands of variables touches fewer pages of the table */
+struct variable {
+    char *string;               /* "NAME=value", NULL if the slot is empty */
+    size_t size;                /* bytes allocated for string */
+    uint32_t name_len;
+    uint32_t hash;
+    uint32_t env_index;         /* of string in envp, if exported */
+    bool exported;
+};
+
+static struct variable *table;
+static size_t table_size;       /* power of 2 */
+static size_t nvariables;
+static unsigned long generation = 1;    /* changes when variables move */
+
+static char **envp;             /* strings of the exported variables */
+static size_t nenv, env_capacity;
+
+extern char **environ;
+
+static uint32_t
+hash_name(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+
+/* Return the slot holding name[0..len), or the empty slot where it
+ * would be inserted */
+static struct variable *
+find_slot(const char *name, size_t len, uint32_t hash)
+{
+    size_t mask = table_size - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        struct variable *v = &table[i];
+        if (v->string == NULL
+            || (v->hash == hash && v->name_len == len
+                && memcmp(v->string, name, len) == 0))
+            return v;
+    }
+}
+
+static struct variable *
+lookup(const char *name, size_t len)
+{
+    if (table_size == 0)
+        return NULL;
+    struct variable *v = find_slot(name, len, hash_name(name, len));
+    return v->string != NULL ? v : NULL;
+}
+
+static void
+grow_table(void)
+{
+    struct variable *old = table;
+    size_t old_size = table_size;
+
+    generation++;
+    table_size = old_size ? 2 * old_size : VARIABLES_INITIAL_SLOTS;
+    table = calloc(table_size, sizeof *table);
+    if (table == NULL)
+        utils_fatal_error("out of memory growing the variable table: ");
+
+    for (size_t i = 0; i < old_size; i++)
+        if (old[i].string != NULL)
+            *find_slot(old[i].string, old[i].name_len, old[i].hash) = old[i];
+    free(old);
+}
+
+/* Make room for 'n' strings and the NULL that ends envp */
+static void
+reserve_env(size_t n)
+{
+    if (n + 1 <= env_capacity)
+        return;
+    env_capacity = env_capacity ? 2 * env_capacity : VARIABLES_INITIAL_SLOTS;
+    while (env_capacity < n + 1)
+        env_capacity *= 2;
+    envp = realloc(envp, env_capacity * sizeof *envp);
+    if (envp == NULL)
+        utils_fatal_error("out of memory building the environment: ");
+    environ = envp;
+}
+
+/* Add the string of 'v', which has just been exported, to envp */
+static void
+env_add(struct variable *v)
+{
+    reserve_env(nenv + 1);
+    v->env_index = nenv;
+    envp[nenv++] = v->string;
+    envp[nenv] = NULL;
+}
+
+/* Take the string of the exported 'v' out of envp, moving the last
+ * string into its place */
+static void
+env_remove(struct variable *v)
+{
+    char *last = envp[--nenv];
+    envp[nenv] = NULL;
+    if (v->env_index == nenv)
+        return;
+    envp[v->env_index] = last;
+    struct variable *moved = lookup(last, strchr(last, '=') - last);
+    moved->env_index = v->env_index;
+}
+
+/* Set name[0..len) to 'value'; the old string is freed only after
+ * the environment no longer refers to it */
+static void
+set_variable(const char *name, size_t len, const char *value, bool export)
+{
+    if ((nvariables + 1) * 4 > table_size * 3)
+        grow_table();
+
+    size_t vlen = strlen(value);
+    uint32_t hash = hash_name(name, len);
+    struct variable *v = find_slot(name, len, hash);
+
+    /* a shell variable that is set over and over, such as the
+     * variable of a loop, keeps its string if the value fits */
+    if (v->string != NULL && !v->exported && !export
+        && v->size >= len + vlen + 2) {
+        memmove(v->string + len + 1, value, vlen + 1);
+        return;
+    }
+
+    char *string = malloc(len + vlen + 2);
+    if (string == NULL)
+        utils_fatal_error("out of memory setting a variable: ");
+    memcpy(string, name, len);
+    string[len] = '=';
+    memcpy(string + len + 1, value, vlen + 1);
+
+    char *old = v->string;
+    if (old == NULL) {
+        *v = (struct variable) { .name_len = len, .hash = hash };
+        nvariables++;
+    }
+    v->string = string;
+    v->size = len + vlen + 2;
+    if (v->exported)
+        envp[v->env_index] = string;
+    else if (export) {
+        v->exported = true;
+        env_add(v);
+    }
+    free(old);
+}
+
+void
+variables_init(char **initial)
+{
+    reserve_env(0);
+    for (char **e = initial; *e != NULL; e++) {
+        char *eq = strchr(*e, '=');
+        /* like getenv, the first of several definitions counts */
+        if (eq != NULL && eq > *e && lookup(*e, eq - *e) == NULL)
+            set_variable(*e, eq - *e, eq + 1, true);
+    }
+}
+
+const char *
+variables_get(const char *name)
+{
+    struct variable *v = lookup(name, strlen(name));
+    return v != NULL ? v->string + v->name_len + 1 : NULL;
+}
+
+void
+variables_set(const char *name, const char *value, bool export)
+{
+    set_variable(name, strlen(name), value, export);
+}
+
+void
+variables_export(const char *name)
+{
+    struct variable *v = lookup(name, strlen(name));
+    if (v == NULL) {
+        variables_set(name, "", true);
+    } else if (!v->exported) {
+        v->exported = true;
+        env_add(v);
+    }
+}
+
+void
+variables_unset(const char *name)
+{
+    struct variable *v = lookup(name, strlen(name));
+    if (v == NULL)
+        return;
+
+    char *old = v->string;
+    if (v->exported)
+        env_remove(v);
+    size_t mask = table_size - 1;
+
+    /* Move back each following entry whose home slot is not between
+     * the hole and the entry itself. */
+    size_t hole = v - table;
+    for (size_t j = (hole + 1) & mask; table[j].string != NULL; j = (j + 1) & mask) {
+        size_t home = table[j].hash & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table[hole] = table[j];
+            hole = j;
+        }
+    }
+    table[hole].string = NULL;
+    nvariables--;
+    generation++;
+    free(old);
+}
+
+/* Return the variable 'name', or NULL, from where 'hint' says it was
+ * if the hint is still good */
+static struct variable *
+lookup_hinted(const char *name, struct variables_hint *hint)
+{
+    if (hint != NULL && hint->generation == generation)
+        return &table[hint->index];
+    struct variable *v = lookup(name, strlen(name));
+    if (v != NULL && hint != NULL)
+        *hint = (struct variables_hint) { generation, v - table };
+    return v;
+}
+
+const char *
+variables_get_hinted(const char *name, struct variables_hint *hint)
+{
+    struct variable *v = lookup_hinted(name, hint);
+    return v != NULL ? v->string + v->name_len + 1 : NULL;
+}
+
+void
+variables_set_hinted(const char *name, const char *value,
+                     struct variables_hint *hint)
+{
+    struct variable *v = lookup_hinted(name, hint);
+    size_t vlen = strlen(value);
+    if (v == NULL || v->exported || v->size < v->name_len + vlen + 2) {
+        set_variable(name, strlen(name), value, false);
+        return;
+    }
+    memmove(v->string + v->name_len + 1, value, vlen + 1);
+}
+
+bool
+variables_valid_name(const char *name, size_t len)
+{
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9'))
+        return false;
+    /* the shell runs in the C locale, where these are what isalnum
+     * accepts; comparing is cheaper than its table for the names of
+     * an rc file */
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+              || (c >= '0' && c <= '9') || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+    const struct variable *va = *(struct variable * const *) a;
+    const struct variable *vb = *(struct variable * const *) b;
+    size_t len = va->name_len < vb->name_len ? va->name_len : vb->name_len;
+    int c = memcmp(va->string, vb->string, len);
+    return c != 0 ? c : (va->name_len > vb->name_len) - (va->name_len < vb->name_len);
+}
+
+void
+variables_print_exported(FILE *out)
+{
+    struct variable **sorted = malloc((nvariables + 1) * sizeof *sorted);
+    if (sorted == NULL)
+        utils_fatal_error("out of memory listing variables: ");
+
+    size_t n = 0;
+    for (size_t i = 0; i < table_size; i++)
+        if (table[i].string != NULL && table[i].exported)
+            sorted[n++] = &table[i];
+    qsort(sorted, n, sizeof *sorted, compare_names);
+
+    for (size_t i = 0; i < n; i++)
+        fprintf(out, "export %.*s=\"%s\"\n", (int) sorted[i]->name_len, sorted[i]->string,
+               sorted[i]->string + sorted[i]->name_len + 1);
+    free(sorted);
+}
+
+char **
+variables_envp(void)
+{
+    return envp;
+}
+
+/* Make room for len more bytes and a NUL in the malloc'd buffer
+ * *buf of *size bytes */
+static void
+reserve(char **buf, size_t *used, size_t *size, size_t len)
+{
+    if (*used + len + 1 > *size) {
+        *size = 2 * (*used + len + 1);
+        *buf = realloc(*buf, *size);
+        if (*buf == NULL)
+            utils_fatal_error("out of memory expanding variables: ");
+    }
+}
+
+/* Append s[0..len) to the malloc'd buffer *buf of *size bytes */
+static void
+append(char **buf, size_t *used, size_t *size, const char *s, size_t len)
+{
+    reserve(buf, used, size, len);
+    memcpy(*buf + *used, s, len);
+    *used += len;
+    (*buf)[*used] = '\0';
+}
+
+/* True if name[0..len) is one of the parameters the shell sets
+ * itself: $?, the positional parameters $1, $2, ... of a function
+ * call, their number $# and all of them, $@ */
+static bool
+special_name(const char *name, size_t len)
+{
+    if (len == 1 && strchr("?#@", *name) != NULL)
+        return true;
+    for (size_t i = 0; i < len; i++)
+        if (!isdigit((unsigned char) name[i]))
+            return false;
+    return len > 0;
+}
+
+/* Return the index'th word of the space-separated list 'value' in
+ * *len bytes, or all of it if index is "@" or "*" */
+static const char *
+select_element(const char *value, const char *index, size_t index_len, size_t *len)
+{
+    *len = strlen(value);
+    if (index_len == 1 && (*index == '@' || *index == '*'))
+        return value;
+
+    size_t n = 0;
+    for (size_t i = 0; i < index_len; i++) {
+        if (!isdigit((unsigned char) index[i])) {
+            *len = 0;
+            return value;
+        }
+        n = n * 10 + (index[i] - '0');
+    }
+    while (*value == ' ')
+        value++;
+    for (; n > 0 && *value != '\0'; n--) {
+        value += strcspn(value, " ");
+        value += strspn(value, " ");
+    }
+    *len = strcspn(value, " ");
+    return value;
+}
+
+char *
+variables_expand(const char *word)
+{
+    size_t used = 0, size = strlen(word) + 1;
+    char *out = malloc(size);
+    if (out == NULL)
+        utils_fatal_error("out of memory expanding variables: ");
+    out[0] = '\0';
+
+    const char *s = word;
+    while (*s != '\0') {
+        const char *dollar = strchr(s, '$');
+        if (dollar == NULL) {
+            append(&out, &used, &size, s, strlen(s));
+            break;
+        }
+        append(&out, &used, &size, s, dollar - s);
+
+        /* $NAME, ${NAME}, ${NAME[index]}, or one of $? $# $@ $0-9;
+         * anything else is a literal '$' */
+        const char *name = dollar + 1, *end = name, *index = NULL;
+        bool braced = *name == '{';
+        if (braced) {
+            name++;
+            end = strchr(name, '}');
+            if (end != NULL && end[-1] == ']')
+                index = memchr(name, '[', end - name);
+        } else if (*name != '\0' && (strchr("?#@", *name) != NULL
+                                      || isdigit((unsigned char) *name))) {
+            end = name + 1;
+        } else {
+            while (isalnum((unsigned char) *end) || *end == '_')
+                end++;
+        }
+        size_t name_len = end == NULL ? 0 : (index != NULL ? index : end) - name;
+        bool special = special_name(name, name_len);
+        if (end == NULL || !(special || variables_valid_name(name, name_len))) {
+            append(&out, &used, &size, "$", 1);
+            s = dollar + 1;
+            continue;
+        }
+
+        struct variable *v = lookup(name, name_len);
+        if (v != NULL) {
+            const char *value = v->string + v->name_len + 1;
+            size_t len = strlen(value);
+            if (index != NULL)
+                value = select_element(value, index + 1, end - index - 2, &len);
+            reserve(&out, &used, &size, 2 * len);
+            used += glob_quote_into(out + used, value, len);
+        } else if (special) {
+            /* no function call is running; left to a command such as
+             * sh -c "echo $1" */
+            const char *next = braced ? end + 1 : end;
+            append(&out, &used, &size, dollar, next - dollar);
+        }
+        s = braced ? end + 1 : end;
+    }
+    return out;
+}
@@ -0,0 +1,60 @@
+#ifndef __VARIABLES_H
+#define __VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Initial number of slots in the variable table, a power of 2 */
+#define VARIABLES_INITIAL_SLOTS 64
+
+/* Import the environment 'envp' as exported variables */
+void variables_init(char **envp);
+
+/* Return the value of variable 'name', or NULL if it is not set */
+const char *variables_get(const char *name);
+
+/* Set variable 'name' to 'value'.  The variable stays exported if it
+ * was, and becomes exported if 'export' is set. */
+void variables_set(const char *name, const char *value, bool export);
+
+/* Mark variable 'name' as exported, creating it empty if needed */
+void variables_export(const char *name);
+
+/* Remove variable 'name' */
+void variables_unset(const char *name);
+
+/* Where a variable was found in the table, for a caller that looks up
+ * the same name over and over, such as a compiled loop.  A zeroed hint
+ * knows nothing. */
+struct variables_hint {
+    unsigned long generation;       /* of the table when it was found */
+    size_t index;
+};
+
+/* variables_get and variables_set(name, value, false), looking first
+ * where 'hint' says 'name' was, and remembering where it is; 'hint'
+ * may be NULL */
+const char *variables_get_hinted(const char *name, struct variables_hint *hint);
+void variables_set_hinted(const char *name, const char *value,
+                          struct variables_hint *hint);
+
+/* True if name[0..len) is a valid variable name */
+bool variables_valid_name(const char *name, size_t len);
+
+/* Print the exported variables to 'out' in a form that 'export' accepts */
+void variables_print_exported(FILE *out);
+
+/* Return the environment for child processes, an array of "NAME=value"
+ * strings that is only rebuilt when an exported variable changes.
+ * 'environ' is kept pointing to it. */
+char **variables_envp(void);
+
+/* Return a malloc'd copy of 'word' with $NAME and ${NAME} replaced by
+ * the variables' values, which are glob-quoted and not split.  $?, $#,
+ * $@ and $1, $2, ... (${10} past 9) are the values of the variables so
+ * named, or left as they are while unset, and ${NAME[i]} the i-th space-separated word of the value of
+ * NAME (all of it for i = @ or *). */
+char *variables_expand(const char *word);
+
+#endif /* __VARIABLES_H */
@@ -0,0 +1,54 @@
+#!/usr/bin/python
+#
+# Tests shell variables: 'NAME=value', $NAME and ${NAME} expansion,
+# and 'export' and 'unset', which decide what children see.
+#
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+#################################################################
+# Step 1. An assignment sets a shell variable, which is expanded
+# but not passed to children.
+#
+sendline('CUSHTESTVAR=hello')
+expect_prompt("Shell did not print expected prompt (2)")
+sendline('echo $CUSHTESTVAR x${CUSHTESTVAR}y [$CUSHTESTUNSET]')
+expect_exact('hello xhelloy []', "variable was not expanded")
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline('env')
+expect_prompt("Shell did not print expected prompt (4)")
+assert 'CUSHTESTVAR' not in console.before, "unexported variable was passed to a child"
+
+#################################################################
+# Step 2. Exported variables are passed to children.
+#
+sendline('export CUSHTESTVAR CUSHTESTNEW=world')
+expect_prompt("Shell did not print expected prompt (5)")
+sendline('env')
+expect_prompt("Shell did not print expected prompt (6)")
+assert 'CUSHTESTVAR=hello' in console.before, "exported variable was not passed to a child"
+assert 'CUSHTESTNEW=world' in console.before, "export NAME=value did not export"
+
+# a later assignment changes the environment as well
+sendline('CUSHTESTVAR=again')
+expect_prompt("Shell did not print expected prompt (7)")
+sendline('env')
+expect_prompt("Shell did not print expected prompt (8)")
+assert 'CUSHTESTVAR=again' in console.before, "assignment did not update the environment"
+
+#################################################################
+# Step 3. Unset variables disappear from the environment.
+#
+sendline('unset CUSHTESTVAR')
+expect_prompt("Shell did not print expected prompt (9)")
+sendline('env')
+expect_prompt("Shell did not print expected prompt (10)")
+assert 'CUSHTESTVAR' not in console.before, "unset variable was passed to a child"
+assert 'CUSHTESTNEW=world' in console.before, "unset removed the wrong variable"
+
+test_success()